@@ -4,16 +4,76 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
+../src/AardvarkLocalBackend.cpp \
+../src/AardvarkRsdBackend.cpp \
+../src/AsyncLog.cpp \
+../src/DeviceLockTable.cpp \
+../src/DeviceQueue.cpp \
+../src/DeviceRegistry.cpp \
 ../src/I2c.cpp \
-../src/I2cPlugin.cpp 
+../src/I2cBackend.cpp \
+../src/I2cDevBackend.cpp \
+../src/I2cPlugin.cpp \
+../src/I2cSchema.cpp \
+../src/I2cStats.cpp \
+../src/MsgPack.cpp \
+../src/NameIndex.cpp \
+../src/ReadCoalescer.cpp \
+../src/Recorder.cpp \
+../src/SessionSweeper.cpp \
+../src/ShmRing.cpp \
+../src/SimDevice.cpp \
+../src/SimulatedBackend.cpp \
+../src/Tracer.cpp \
+../src/WorkspacePool.cpp 
 
 OBJS += \
+./src/AardvarkLocalBackend.o \
+./src/AardvarkRsdBackend.o \
+./src/AsyncLog.o \
+./src/DeviceLockTable.o \
+./src/DeviceQueue.o \
+./src/DeviceRegistry.o \
 ./src/I2c.o \
-./src/I2cPlugin.o 
+./src/I2cBackend.o \
+./src/I2cDevBackend.o \
+./src/I2cPlugin.o \
+./src/I2cSchema.o \
+./src/I2cStats.o \
+./src/MsgPack.o \
+./src/NameIndex.o \
+./src/ReadCoalescer.o \
+./src/Recorder.o \
+./src/SessionSweeper.o \
+./src/ShmRing.o \
+./src/SimDevice.o \
+./src/SimulatedBackend.o \
+./src/Tracer.o \
+./src/WorkspacePool.o 
 
 CPP_DEPS += \
+./src/AardvarkLocalBackend.d \
+./src/AardvarkRsdBackend.d \
+./src/AsyncLog.d \
+./src/DeviceLockTable.d \
+./src/DeviceQueue.d \
+./src/DeviceRegistry.d \
 ./src/I2c.d \
-./src/I2cPlugin.d 
+./src/I2cBackend.d \
+./src/I2cDevBackend.d \
+./src/I2cPlugin.d \
+./src/I2cSchema.d \
+./src/I2cStats.d \
+./src/MsgPack.d \
+./src/NameIndex.d \
+./src/ReadCoalescer.d \
+./src/Recorder.d \
+./src/SessionSweeper.d \
+./src/ShmRing.d \
+./src/SimDevice.d \
+./src/SimulatedBackend.d \
+./src/Tracer.d \
+./src/WorkspacePool.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
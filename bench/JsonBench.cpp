@@ -0,0 +1,257 @@
+/**
+ * Microbenchmarks of the json paths of I2c, with payloads from 1 byte to 64 KiB.
+ * Every benchmark does the same calls as the code path it is named after, so changes of the message pipeline can be
+ * measured without RSD and without hardware.
+ *
+ * Needs Google Benchmark, build: make -C Release bench
+ */
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+#include <benchmark/benchmark.h>
+
+#include "JsonRPC.hpp"
+#include "I2cSchema.hpp"
+#include "MsgPack.hpp"
+
+using namespace std;
+
+
+/** Generates the text of a i2c.write main-request with length bytes as json array.*/
+static string makeWriteRequest(unsigned int length)
+{
+	string request = "{\"jsonrpc\":\"2.0\",\"method\":\"i2c.write\",\"params\":{\"device\":2237839440,\"slave_addr\":80,\"data_out\":[";
+
+	for(unsigned int i = 0; i < length; i++)
+	{
+		if(i > 0)
+			request += ",";
+		request += "171";
+	}
+	request += "]},\"id\":1}";
+	return request;
+}
+
+
+/** Generates the text of a i2c.write main-request with length bytes as base64 string.*/
+static string makeBase64WriteRequest(unsigned int length)
+{
+	vector<unsigned char> data(length, 0xAB);
+	string encoded;
+	string request = "{\"jsonrpc\":\"2.0\",\"method\":\"i2c.write\",\"params\":{\"device\":2237839440,\"slave_addr\":80,\"data_out\":\"";
+
+	Base64::encode(&data[0], data.size(), encoded);
+	request += encoded;
+	request += "\"},\"id\":1}";
+	return request;
+}
+
+
+/** Generates the text of the sub-response of Aardvark.aa_i2c_read with length bytes.*/
+static string makeReadSubResponse(unsigned int length)
+{
+	string response = "{\"jsonrpc\":\"2.0\",\"result\":{\"returnCode\":";
+	char count[16];
+
+	snprintf(count, sizeof(count), "%u", length);
+	response += count;
+	response += ",\"data_in\":[";
+	for(unsigned int i = 0; i < length; i++)
+	{
+		if(i > 0)
+			response += ",";
+		response += "171";
+	}
+	response += "]},\"id\":1}";
+	return response;
+}
+
+
+/** I2c::process: parsing a main-request.*/
+static void BM_ParseRequest(benchmark::State &state)
+{
+	JsonRPC json;
+	Document dom;
+	string request = makeWriteRequest(state.range(0));
+
+	while(state.KeepRunning())
+		json.parse(&dom, &request);
+
+	state.SetBytesProcessed(state.iterations() * request.size());
+}
+BENCHMARK(BM_ParseRequest)->RangeMultiplier(8)->Range(1, 64 << 10);
+
+
+/** I2c::process + I2cSchema: parsing a main-request and its params, data_out as json array.*/
+static void BM_ParseWriteParams(benchmark::State &state)
+{
+	JsonRPC json;
+	Document dom;
+	I2cWriteParams params;
+	string request = makeWriteRequest(state.range(0));
+
+	while(state.KeepRunning())
+	{
+		json.parse(&dom, &request);
+		I2cSchema::parse(*json.tryTogetParams(&dom), params);
+	}
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParseWriteParams)->RangeMultiplier(8)->Range(1, 64 << 10);
+
+
+/** I2c::process + I2cSchema: parsing a main-request and its params, data_out as base64 string.*/
+static void BM_ParseBase64WriteParams(benchmark::State &state)
+{
+	JsonRPC json;
+	Document dom;
+	I2cWriteParams params;
+	string request = makeBase64WriteRequest(state.range(0));
+
+	while(state.KeepRunning())
+	{
+		json.parse(&dom, &request);
+		I2cSchema::parse(*json.tryTogetParams(&dom), params);
+	}
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParseBase64WriteParams)->RangeMultiplier(8)->Range(1, 64 << 10);
+
+
+/** AardvarkRsdBackend::write: generating the sub-request Aardvark.aa_i2c_write.*/
+static void BM_GenerateRequest(benchmark::State &state)
+{
+	JsonRPC json;
+	Document paramDom;
+	Value method;
+	Value params;
+	Value dataOut;
+	Value id;
+	MemoryPoolAllocator<> &allocator = paramDom.GetAllocator();
+
+	method.SetString("Aardvark.aa_i2c_write", allocator);
+	id.SetInt(1);
+	params.SetObject();
+	params.AddMember("handle", 1, allocator);
+	params.AddMember("slave_addr", 80, allocator);
+	params.AddMember("flags", 0, allocator);
+	params.AddMember("num_bytes", (int)state.range(0), allocator);
+	dataOut.SetArray();
+	for(int i = 0; i < state.range(0); i++)
+		dataOut.PushBack(171, allocator);
+	params.AddMember("data_out", dataOut, allocator);
+
+	while(state.KeepRunning())
+		benchmark::DoNotOptimize(json.generateRequest(method, params, id));
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GenerateRequest)->RangeMultiplier(8)->Range(1, 64 << 10);
+
+
+/** I2c::read: generating the response with data_in as json array.*/
+static void BM_GenerateResponse(benchmark::State &state)
+{
+	JsonRPC json;
+	Value result;
+	Value dataIn;
+	Value id;
+
+	id.SetInt(1);
+	while(state.KeepRunning())
+	{
+		MemoryPoolAllocator<> &allocator = json.getResponseDOM()->GetAllocator();
+		result.SetObject();
+		dataIn.SetArray();
+		for(int i = 0; i < state.range(0); i++)
+			dataIn.PushBack(171, allocator);
+		result.AddMember("data_in", dataIn, allocator);
+		result.AddMember("returnCode", "OK", allocator);
+		benchmark::DoNotOptimize(json.generateResponse(id, result));
+	}
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GenerateResponse)->RangeMultiplier(8)->Range(1, 64 << 10);
+
+
+/** I2c::isSubResponse: parsing a sub-response and comparing its id with the id of the main-request.*/
+static void BM_IsSubResponse(benchmark::State &state)
+{
+	JsonRPC json;
+	Document dom;
+	Value requestId;
+	Value tempId;
+	string response = makeReadSubResponse(state.range(0));
+
+	requestId.SetInt(1);
+	while(state.KeepRunning())
+	{
+		json.parse(&dom, &response);
+		if(json.isResponse(&dom))
+		{
+			tempId.CopyFrom(*(json.getId(&dom)), dom.GetAllocator());
+			benchmark::DoNotOptimize(tempId == requestId);
+		}
+	}
+
+	state.SetBytesProcessed(state.iterations() * response.size());
+}
+BENCHMARK(BM_IsSubResponse)->RangeMultiplier(8)->Range(1, 64 << 10);
+
+
+/** AardvarkRsdBackend::copyResultBytes: finding data_in within a parsed sub-response and copying the bytes.*/
+static void BM_FindObjectMember(benchmark::State &state)
+{
+	JsonRPC json;
+	Document dom;
+	Value* result = NULL;
+	Value* array = NULL;
+	vector<unsigned char> data(state.range(0));
+	string response = makeReadSubResponse(state.range(0));
+
+	json.parse(&dom, &response);
+	result = json.tryTogetResult(&dom);
+	while(state.KeepRunning())
+	{
+		array = json.findObjectMember(*result, "data_in", kArrayType);
+		for(unsigned int i = 0; i < array->Size(); i++)
+			data[i] = (unsigned char)(*array)[i].GetUint();
+		benchmark::DoNotOptimize(&data[0]);
+	}
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FindObjectMember)->RangeMultiplier(8)->Range(1, 64 << 10);
+
+
+/** I2c::isSubResponse: copying the params of a sub-response into another DOM, like Value::CopyFrom of bigger values.*/
+static void BM_CopyFrom(benchmark::State &state)
+{
+	JsonRPC json;
+	Document dom;
+	Document target;
+	Value copy;
+	string response = makeReadSubResponse(state.range(0));
+
+	json.parse(&dom, &response);
+	while(state.KeepRunning())
+	{
+		//the pool would grow with every copy
+		copy.SetNull();
+		target.GetAllocator().Clear();
+		copy.CopyFrom(*json.tryTogetResult(&dom), target.GetAllocator());
+		benchmark::DoNotOptimize(&copy);
+	}
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CopyFrom)->RangeMultiplier(8)->Range(1, 64 << 10);
+
+
+BENCHMARK_MAIN();
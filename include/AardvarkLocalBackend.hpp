@@ -0,0 +1,146 @@
+#ifndef INCLUDE_AARDVARKLOCALBACKEND_HPP_
+#define INCLUDE_AARDVARKLOCALBACKEND_HPP_
+
+#ifdef AARDVARK_INPROCESS
+
+#include <pthread.h>
+#include <map>
+
+#include "document.h"
+
+#include "I2cBackend.hpp"
+
+using namespace rapidjson;
+
+class RemoteAardvark;
+
+
+/**
+ * \class AardvarkLocalBackend
+ * \brief I2cBackend which calls RemoteAardvark directly within the process of I2c-Plugin.
+ * Instead of sending sub-requests through RSD to the Aardvark-Plugin, the rpc functions of RemoteAardvark
+ * are called as normal memberfunctions. There is no socket and no json text between I2c and the driver, a
+ * transaction only costs function calls. Because the Aardvark-Plugin is bypassed, this backend is shared by all
+ * I2c instances of the plugin and serializes the access to RemoteAardvark with a mutex.
+ * \note Only available if I2c-Plugin is build with AARDVARK_INPROCESS defined and linked against
+ * RemoteAardvark.o and the aardvark shared library of Totalphase.
+ */
+class AardvarkLocalBackend : public I2cBackend{
+
+	public:
+
+		/**Base-constructor.*/
+		AardvarkLocalBackend();
+
+
+		/**Base-destructor, closes all open handles and deletes all RemoteAardvark instances.*/
+		~AardvarkLocalBackend();
+
+
+		const char* getName(){return "Aardvark";}
+
+
+		/** Calls aa_find_devices_ext and adds a I2cDevice for every found Aardvark.*/
+		void findDevices(list<I2cDevice*> &deviceList);
+
+
+		/**
+		 * Calls aa_open of the RemoteAardvark for port.
+		 * \throws Error If aa_open returns a negative handle.
+		 */
+		int open(int port);
+
+
+		/**
+		 * Calls aa_target_power.
+		 * \throws Error If aa_target_power returns a negative return code.
+		 */
+		void targetPower(int handle, int powerMask);
+
+
+		/**
+		 * Calls aa_i2c_write.
+		 * \throws Error If aa_i2c_write returns a negative return code.
+		 */
+		void write(int handle, int slaveAddr, int flags, const unsigned char* data, unsigned int length);
+
+
+		/**
+		 * Calls aa_i2c_read.
+		 * \throws Error If aa_i2c_read returns a negative return code.
+		 */
+		unsigned int read(int handle, int slaveAddr, int flags, unsigned char* data, unsigned int length);
+
+
+		/**
+		 * Calls aa_i2c_bitrate.
+		 * \throws Error If aa_i2c_bitrate returns a negative return code.
+		 */
+		int configure(int handle, int bitrate);
+
+
+		/**
+		 * Calls aa_configure (I²C and SPI), aa_spi_configure and aa_spi_master_ss_polarity.
+		 * \throws Error If a function returns a negative return code.
+		 */
+		void spiConfigure(int handle, int polarity, int phase, int bitorder, int ssPolarity);
+
+
+		/**
+		 * Calls aa_spi_bitrate.
+		 * \throws Error If aa_spi_bitrate returns a negative return code.
+		 */
+		int spiBitrate(int handle, int bitrate);
+
+
+		/**
+		 * Calls aa_spi_write.
+		 * \throws Error If aa_spi_write returns a negative return code.
+		 */
+		unsigned int spiWrite(int handle, const unsigned char* dataOut, unsigned int lengthOut, unsigned char* dataIn,
+				unsigned int lengthIn);
+
+
+		/**
+		 * Calls aa_close.
+		 * \throws Error If aa_close returns a negative return code.
+		 */
+		void close(int handle);
+
+
+	private:
+
+		/*! One RemoteAardvark for every port, created at the first aa_open.*/
+		map<int, RemoteAardvark*> aardvarks;
+		/*! Maps a open handle to the RemoteAardvark which got it.*/
+		map<int, RemoteAardvark*> handles;
+		/*! RemoteAardvark with port -1, only used for aa_find_devices_ext.*/
+		RemoteAardvark* finder;
+		/*! DOM for generating the params of the rpc functions, its allocator is cleared after every call.*/
+		Document paramDom;
+		/*! Serializes the access to RemoteAardvark and paramDom.*/
+		pthread_mutex_t mutex;
+
+
+		/** Frees the params of the current call and unlocks mutex.*/
+		void unlock();
+
+
+		/**
+		 * \param handle A handle returned by open().
+		 * \return The RemoteAardvark which holds the handle.
+		 * \throws Error If the handle is unknown.
+		 */
+		RemoteAardvark* getAardvark(int handle);
+
+
+		/**
+		 * Checks the member "returnCode" of a result.
+		 * \throws Error If the return code is negative, with the code I2C_BUS_ERROR_CODE() if the result contains a "status".
+		 */
+		void checkReturnCode(Value &result, const char* errorMsg);
+};
+
+#endif /* AARDVARK_INPROCESS */
+
+#endif /* INCLUDE_AARDVARKLOCALBACKEND_HPP_ */
@@ -0,0 +1,246 @@
+#ifndef INCLUDE_AARDVARKRSDBACKEND_HPP_
+#define INCLUDE_AARDVARKRSDBACKEND_HPP_
+
+#include <vector>
+
+#include "document.h"
+
+#include "I2cBackend.hpp"
+#include "ShmRing.hpp"
+#include "MsgPack.hpp"
+
+using namespace rapidjson;
+
+/*! Payloads with at least this number of bytes are exchanged through shared memory, if the Aardvark-Plugin supports it.*/
+#ifndef SHM_PAYLOAD_THRESHOLD
+#define SHM_PAYLOAD_THRESHOLD 1024
+#endif
+
+/*! Value of the param "encoding" of Aardvark.aa_set_encoding.*/
+#define AARDVARK_ENCODING_MSGPACK "msgpack"
+/*! Member of params and results which contains the MessagePack encoded bytes as base64.*/
+#define AARDVARK_MSGPACK_MEMBER "msgpack"
+
+
+class I2c;
+struct _function;
+
+
+/**
+ * \class AardvarkRsdBackend
+ * \brief I2cBackend which uses the Aardvark-Plugin through RSD.
+ * Every function is translated to a json rpc request (sub-request) for the Aardvark-Plugin.
+ * The sub-request is send through the ComPointB of the I2c instance which owns this backend, the
+ * function will block till the corresponding sub-response was received.
+ * Big payloads of aa_i2c_write and aa_i2c_read can be exchanged through a ShmRing instead of json arrays. At the first big
+ * payload, the backend offers the ring with the sub-request "Aardvark.aa_shm_attach" (params "pid", "fd" and "size").
+ * If the Aardvark-Plugin answers with an error, because it does not know the function, json arrays will be used for the
+ * rest of the connection. Otherwise the sub-requests contain a member "data_shm" with "offset" and "length" of the payload
+ * within the ring, instead of "data_out" or "data_in".
+ * Before the first sub-request of aa_open, aa_target_power, aa_i2c_write, aa_i2c_read, aa_i2c_bitrate, the SPI functions
+ * and aa_close, the backend
+ * asks with "Aardvark.aa_set_encoding" (param "encoding": "msgpack") for MessagePack. If the Aardvark-Plugin accepts it, the
+ * params of these sub-requests are a MessagePack array with the values in the order of the paramArray of the function
+ * (numbers as int, byte arrays as bin, nil for a payload in shared memory, followed by a map with "offset" and "length"
+ * for shm). The result is a MessagePack map with the same members as the json result. The encoded bytes are transported
+ * as base64 within the member "msgpack" of params and result, because RSD routes the messages by the json rpc envelope.
+ * Otherwise json will be used for the rest of the connection. SPI payloads are always part of the params.
+ */
+class AardvarkRsdBackend : public I2cBackend{
+
+	public:
+
+		/**
+		 * Base-constructor.
+		 * \param i2c The I2c instance which sends the sub-requests and receives the sub-responses.
+		 */
+		AardvarkRsdBackend(I2c* i2c);
+
+
+		/**Base-destructor, deletes the ShmRing.*/
+		~AardvarkRsdBackend();
+
+
+		const char* getName(){return "Aardvark";}
+
+
+		/**
+		 * Sends aa_find_devices_ext as sub-request and adds a I2cDevice for every found Aardvark.
+		 */
+		void findDevices(list<I2cDevice*> &deviceList);
+
+
+		/**
+		 * Sends aa_open as sub-request.
+		 * \throws Error If the sub-response contains a negative handle.
+		 */
+		int open(int port);
+
+
+		/**
+		 * Sends aa_target_power as sub-request.
+		 * \throws Error If the sub-response contains a negative return code.
+		 */
+		void targetPower(int handle, int powerMask);
+
+
+		/**
+		 * Sends aa_i2c_write as sub-request.
+		 * \throws Error If the sub-response contains a negative return code.
+		 */
+		void write(int handle, int slaveAddr, int flags, const unsigned char* data, unsigned int length);
+
+
+		/**
+		 * Sends aa_i2c_read as sub-request and copies the member "data_in" of the sub-response to data.
+		 * \throws Error If the sub-response contains a negative return code.
+		 */
+		unsigned int read(int handle, int slaveAddr, int flags, unsigned char* data, unsigned int length);
+
+
+		/**
+		 * Sends aa_i2c_bitrate as sub-request.
+		 * \throws Error If the sub-response contains a negative return code.
+		 */
+		int configure(int handle, int bitrate);
+
+
+		/**
+		 * Sends aa_configure (I²C and SPI), aa_spi_configure and aa_spi_master_ss_polarity as sub-requests.
+		 * \throws Error If a sub-response contains a negative return code.
+		 */
+		void spiConfigure(int handle, int polarity, int phase, int bitorder, int ssPolarity);
+
+
+		/**
+		 * Sends aa_spi_bitrate as sub-request.
+		 * \throws Error If the sub-response contains a negative return code.
+		 */
+		int spiBitrate(int handle, int bitrate);
+
+
+		/**
+		 * Sends aa_spi_write as sub-request and copies the member "data_in" of the sub-response to dataIn.
+		 * \throws Error If the sub-response contains a negative return code.
+		 */
+		unsigned int spiWrite(int handle, const unsigned char* dataOut, unsigned int lengthOut, unsigned char* dataIn,
+				unsigned int lengthIn);
+
+
+		/**
+		 * Sends aa_close as sub-request.
+		 * \throws Error If the sub-response contains a negative return code.
+		 */
+		void close(int handle);
+
+
+	private:
+
+		/*! I2c instance which owns this backend.*/
+		I2c* i2c;
+		/*! Shared memory for big payloads, NULL if not negotiated (yet).*/
+		ShmRing* shm;
+		/*! True if the Aardvark-Plugin was asked for using shared memory.*/
+		bool shmNegotiated;
+		/*! True if params and results are encoded with MessagePack.*/
+		bool msgPack;
+		/*! True if the Aardvark-Plugin was asked for using MessagePack.*/
+		bool encodingNegotiated;
+		/*! Function of the current sub-request.*/
+		_function* function;
+		/*! Json params of the current sub-request.*/
+		Value params;
+		/*! MessagePack params of the current sub-request.*/
+		MsgPackWriter writer;
+		/*! Json result of the last sub-response.*/
+		Value* subResult;
+		/*! Decoded MessagePack result of the last sub-response.*/
+		vector<unsigned char> resultBuffer;
+
+
+		/**
+		 * Checks if a payload should be exchanged through shared memory, negotiates the shared memory at the first big payload.
+		 * \param length Number of bytes of the payload.
+		 * \return True if the payload has to be exchanged through shm.
+		 */
+		bool useShm(unsigned int length);
+
+
+		/**
+		 * Checks if MessagePack should be used, negotiates the encoding at the first call.
+		 * \return True if the params and results are encoded with MessagePack.
+		 */
+		bool useMsgPack();
+
+
+		/**
+		 * Starts the params of a new sub-request, the params have to be added in the order of function.paramArray.
+		 * \param function Function of the Aardvark-Plugin which will be called.
+		 * \param withShm True if addShmDescriptor() will be called.
+		 */
+		void beginParams(_function &function, bool withShm);
+
+
+		/**
+		 * Adds a number to the params.
+		 * \param index Index of the param within the paramArray of the function.
+		 * \param value Value of the param.
+		 */
+		void addParam(unsigned int index, int value);
+
+
+		/**
+		 * Adds a byte array to the params, a empty array is added too.
+		 * \param index Index of the param within the paramArray of the function.
+		 * \param data Bytes of the param, may be NULL if length is 0 or the payload is exchanged through shm.
+		 * \param length Number of bytes.
+		 * \param inShm True if the payload is exchanged through shm, only its position is kept within the params.
+		 */
+		void addParam(unsigned int index, const unsigned char* data, unsigned int length, bool inShm = false);
+
+
+		/**
+		 * Adds the position of a payload within shm to the params ("data_shm" for json).
+		 * \param offset Offset of the payload within shm.
+		 * \param length Number of bytes of the payload.
+		 */
+		void addShmDescriptor(size_t offset, unsigned int length);
+
+
+		/**
+		 * Sends the params as sub-request and waits for the sub-response.
+		 * \throws Error If the sub-response is an error or the result can not be decoded.
+		 */
+		void sendParams();
+
+
+		/**
+		 * Searches a number within the result of the last sub-response.
+		 * \param name Name of the member.
+		 * \param value Will be set to the value of the member.
+		 * \return True if the member was found.
+		 */
+		bool findResultInt(const char* name, long long &value);
+
+
+		/**
+		 * Copies a byte array of the result of the last sub-response.
+		 * \param name Name of the member.
+		 * \param data Buffer for the bytes.
+		 * \param length Size of the buffer.
+		 * \return Number of copied bytes.
+		 * \throws Error If the member was not found.
+		 */
+		unsigned int copyResultBytes(const char* name, unsigned char* data, unsigned int length);
+
+
+		/**
+		 * Checks the member "returnCode" of the result of the last sub-response.
+		 * \param errorMsg Message of the Error which is thrown on a negative return code.
+		 * \return The return code.
+		 * \throws Error If the return code is negative, with the code I2C_BUS_ERROR_CODE() if the result contains a "status".
+		 */
+		int checkReturnCode(const char* errorMsg);
+};
+
+#endif /* INCLUDE_AARDVARKRSDBACKEND_HPP_ */
@@ -0,0 +1,133 @@
+#ifndef INCLUDE_ASYNCLOG_HPP_
+#define INCLUDE_ASYNCLOG_HPP_
+
+#include <pthread.h>
+
+/*! Number of entries of the ring of every thread, has to be a power of 2. A message is dropped if the ring is full.*/
+#ifndef I2C_LOG_RING_SIZE
+#define I2C_LOG_RING_SIZE 256
+#endif
+
+/*! Maximum number of bytes of a logged message, longer messages are truncated.*/
+#ifndef I2C_LOG_MAX_PAYLOAD
+#define I2C_LOG_MAX_PAYLOAD 240
+#endif
+
+/*! Only every n-th message of a thread is logged, 1 logs every message.*/
+#ifndef I2C_LOG_SAMPLE_RATE
+#define I2C_LOG_SAMPLE_RATE 1
+#endif
+
+/*! Milliseconds between two runs of the drain thread.*/
+#ifndef I2C_LOG_DRAIN_INTERVAL
+#define I2C_LOG_DRAIN_INTERVAL 50
+#endif
+
+
+/**
+ * \class AsyncLog
+ * \brief Logger which keeps syslog off the request path.
+ * Every thread which logs gets its own ring of fixed size entries (single producer, single consumer), so log() only
+ * copies the (truncated) message and publishes it with an atomic store, it never blocks and never calls syslog.
+ * A background thread drains all rings and writes the entries to syslog. If a ring is full, the message is dropped
+ * and counted. The ring of a thread is released by the drain thread after the thread exited and its ring is empty.
+ */
+class AsyncLog{
+
+	public:
+
+		/**
+		 * Base-constructor, starts the drain thread.
+		 * \param facility Syslog facility of the entries, like LOG_LOCAL2.
+		 */
+		AsyncLog(int facility);
+
+
+		/**Base-destructor, stops the drain thread and writes all remaining entries.*/
+		~AsyncLog();
+
+
+		/**
+		 * Records a message, called by any thread.
+		 * \param direction Short description of the message, like "in" or "out", has to be a string literal.
+		 * \param message The message, it is copied.
+		 * \param length Number of bytes of message, only I2C_LOG_MAX_PAYLOAD bytes are logged.
+		 */
+		void log(const char* direction, const char* message, unsigned int length);
+
+
+		/** \return Number of messages which were dropped, because the ring of their thread was full.*/
+		unsigned long long getDropped();
+
+
+	private:
+
+		/**
+		 * \struct Entry
+		 * One logged message.
+		 */
+		struct Entry{
+			/*! Description of the message, points to a string literal.*/
+			const char* direction;
+			/*! Length of the whole message.*/
+			unsigned int length;
+			/*! Number of bytes within text.*/
+			unsigned int stored;
+			/*! The (truncated) message.*/
+			char text[I2C_LOG_MAX_PAYLOAD];
+		};
+
+		/**
+		 * \struct Ring
+		 * Entries of one thread, head is only written by the thread, tail only by the drain thread.
+		 */
+		struct Ring{
+			/*! The entries, indexed by head or tail modulo I2C_LOG_RING_SIZE.*/
+			Entry entries[I2C_LOG_RING_SIZE];
+			/*! Number of published entries.*/
+			unsigned int head;
+			/*! Number of written entries.*/
+			unsigned int tail;
+			/*! Number of messages of the thread, for sampling.*/
+			unsigned int messages;
+			/*! True if the thread exited.*/
+			bool orphaned;
+			/*! Next ring within the list of all rings.*/
+			Ring* next;
+		};
+
+		/*! Syslog facility of the entries.*/
+		int facility;
+		/*! List of all rings.*/
+		Ring* rings;
+		/*! Protects the list of rings (not the entries).*/
+		pthread_mutex_t mutex;
+		/*! Ring of the calling thread.*/
+		pthread_key_t ringKey;
+		/*! Background thread which writes the entries to syslog.*/
+		pthread_t drainThread;
+		/*! True if the drain thread was started.*/
+		bool draining;
+		/*! Set by the destructor for stopping the drain thread.*/
+		bool stop;
+		/*! Number of dropped messages.*/
+		unsigned long long dropped;
+
+
+		/** \return Ring of the calling thread, it is created at the first call.*/
+		Ring* getRing();
+
+
+		/** Writes all published entries of all rings and releases the rings of exited threads.*/
+		void drain();
+
+
+		/** Thread function of the drain thread, arg is the AsyncLog.*/
+		static void* drainLoop(void* arg);
+
+
+		/** Destructor of ringKey, marks the ring of a exiting thread.*/
+		static void releaseRing(void* ring);
+};
+
+#endif /* INCLUDE_ASYNCLOG_HPP_ */
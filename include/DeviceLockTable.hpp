@@ -0,0 +1,153 @@
+#ifndef INCLUDE_DEVICELOCKTABLE_HPP_
+#define INCLUDE_DEVICELOCKTABLE_HPP_
+
+#include <pthread.h>
+#include <cstddef>
+#include <ctime>
+#include <map>
+
+using namespace std;
+
+/*! Seconds a request waits for a device which is locked or used by another client.*/
+#ifndef I2C_LOCK_WAIT_TIMEOUT
+#define I2C_LOCK_WAIT_TIMEOUT 10
+#endif
+
+/*! Lease in seconds of i2c.lock, if the request does not contain "lease".*/
+#ifndef I2C_LOCK_DEFAULT_LEASE
+#define I2C_LOCK_DEFAULT_LEASE 30
+#endif
+
+
+/**
+ * \class DeviceLockTable
+ * \brief Plugin-wide table of locked and used devices, shared by all I2c instances.
+ * Every operation on a device is enclosed by enter() and leave(). A client (owner, the I2c instance of a connection)
+ * can lock a device with lock(), afterwards enter() of all other clients waits till the device is unlocked or the lease expired.
+ * The lease starts again at every enter() of the owner, so a lock only expires if the owner does not use the device.
+ * lock() itself waits till no other client uses the device. Waiting clients are woken up in the order of the condition variable.
+ */
+class DeviceLockTable{
+
+	public:
+
+		/**Base-constructor.*/
+		DeviceLockTable();
+
+
+		/**Base-destructor.*/
+		~DeviceLockTable();
+
+
+		/**
+		 * Locks a device for a client.
+		 * \param device Unique id of the device.
+		 * \param owner Client which locks the device.
+		 * \param lease Seconds till the lock expires, if the owner does not use the device.
+		 * \throws Error If the device is locked or used by another client for longer than I2C_LOCK_WAIT_TIMEOUT.
+		 */
+		void lock(unsigned int device, const void* owner, unsigned int lease);
+
+
+		/**
+		 * Unlocks a device.
+		 * \param device Unique id of the device.
+		 * \param owner Client which locked the device.
+		 * \throws Error If the device is not locked by owner.
+		 */
+		void unlock(unsigned int device, const void* owner);
+
+
+		/**
+		 * Marks the device as used by a client, waits while it is locked by another client.
+		 * \param device Unique id of the device.
+		 * \param owner Client which uses the device.
+		 * \throws Error If the device is locked by another client for longer than I2C_LOCK_WAIT_TIMEOUT.
+		 */
+		void enter(unsigned int device, const void* owner);
+
+
+		/**
+		 * Marks the end of a use, which was started with enter().
+		 * \param device Unique id of the device.
+		 * \param owner Client which used the device.
+		 */
+		void leave(unsigned int device, const void* owner);
+
+
+		/**
+		 * \param device Unique id of the device.
+		 * \param owner A client.
+		 * \return True if the device is locked by owner and the lease did not expire.
+		 */
+		bool isOwner(unsigned int device, const void* owner);
+
+
+		/**
+		 * Removes all locks and uses of a client, for a closed connection.
+		 * \param owner The client.
+		 */
+		void releaseAll(const void* owner);
+
+
+	private:
+
+		/**
+		 * \struct Entry
+		 * Lock state of one device.
+		 */
+		struct Entry{
+			/*! Client which locked the device or NULL.*/
+			const void* owner;
+			/*! Lease of the lock in seconds.*/
+			unsigned int lease;
+			/*! Time when the lock expires, CLOCK_MONOTONIC.*/
+			struct timespec expires;
+			/*! Number of uses (enter() without leave()) of every client.*/
+			map<const void*, unsigned int> users;
+
+			Entry()
+			{
+				owner = NULL;
+				lease = 0;
+				expires.tv_sec = 0;
+				expires.tv_nsec = 0;
+			}
+		};
+
+		/*! All devices which are locked or used, mapped by their unique id.*/
+		map<unsigned int, Entry> entries;
+		/*! Protects entries.*/
+		pthread_mutex_t mutex;
+		/*! Signaled at every unlock and leave.*/
+		pthread_cond_t changed;
+
+
+		/** \return True if the device is locked by another client and the lease did not expire.*/
+		bool isLockedByOther(Entry &entry, const void* owner, struct timespec &now);
+
+
+		/** \return True if another client uses the device.*/
+		bool isUsedByOther(Entry &entry, const void* owner);
+
+
+		/**
+		 * Waits for a change of entries, but not longer than till deadline or the expiration of a lock.
+		 * \return False if deadline was reached.
+		 */
+		bool wait(Entry &entry, struct timespec &deadline);
+
+
+		/** Removes the entry of a device, if it is neither locked nor used.*/
+		void cleanup(unsigned int device);
+
+
+		/** \return Current time of CLOCK_MONOTONIC.*/
+		static struct timespec now();
+
+
+		/** \return True if a is before b.*/
+		static bool before(const struct timespec &a, const struct timespec &b);
+};
+
+#endif /* INCLUDE_DEVICELOCKTABLE_HPP_ */
@@ -0,0 +1,245 @@
+#ifndef INCLUDE_DEVICEQUEUE_HPP_
+#define INCLUDE_DEVICEQUEUE_HPP_
+
+#include <pthread.h>
+#include <ctime>
+#include <list>
+#include <map>
+
+using namespace std;
+
+/*! Maximum number of requests waiting for one device, further requests are rejected.*/
+#ifndef I2C_DEVICE_QUEUE_LIMIT
+#define I2C_DEVICE_QUEUE_LIMIT 16
+#endif
+
+/*! Maximum number of requests waiting for any device, further requests are rejected.*/
+#ifndef I2C_QUEUE_LIMIT
+#define I2C_QUEUE_LIMIT 128
+#endif
+
+/*! Milliseconds a request waits for its turn on a device before it is rejected.*/
+#ifndef I2C_QUEUE_WAIT_TIMEOUT
+#define I2C_QUEUE_WAIT_TIMEOUT 5000
+#endif
+
+/*! Assumed milliseconds of one use of a device, before the first use was measured.*/
+#ifndef I2C_QUEUE_DEFAULT_HOLD
+#define I2C_QUEUE_DEFAULT_HOLD 10
+#endif
+
+/*! Bytes a client may transfer on a device per round of the deficit round robin.*/
+#ifndef I2C_QUEUE_QUANTUM
+#define I2C_QUEUE_QUANTUM 256
+#endif
+
+/*! Waiting bulk requests get the device at the latest after this many interactive requests.*/
+#ifndef I2C_QUEUE_BULK_SHARE
+#define I2C_QUEUE_BULK_SHARE 4
+#endif
+
+/*! Error code of a request which was rejected because a queue is full, the message contains "retry after <ms> ms".*/
+#define I2C_OVERLOADED_ERROR_CODE -33200
+
+
+/** Priority classes of DeviceQueue.*/
+enum QueuePriority{
+	QUEUE_INTERACTIVE = 0,
+	QUEUE_BULK = 1,
+	QUEUE_NUMBER_OF_PRIORITIES = 2
+};
+
+
+/**
+ * \class DeviceQueue
+ * \brief Plugin-wide admission control: every device is used by one request at a time, the others wait in a bounded queue.
+ * A request which finds the queue of its device or all queues together full is rejected at once with
+ * I2C_OVERLOADED_ERROR_CODE and a retry-after estimate (queue length times the average use of the device), instead of
+ * waiting till a sub-request times out. A client which already uses a device (like with a session) can use it again
+ * without waiting, every enter() needs its leave().
+ * Waiting requests are ordered by priority class and client: interactive requests go before bulk requests, but a
+ * waiting bulk request gets the device after at most I2C_QUEUE_BULK_SHARE interactive requests. Within a class the
+ * clients take turns by deficit round robin, every client gets I2C_QUEUE_QUANTUM bytes per round, so a client with
+ * many or big requests does not starve the others.
+ */
+class DeviceQueue{
+
+	public:
+
+		/**
+		 * \struct Counters
+		 * Copy of the queue metrics at one point in time.
+		 */
+		struct Counters{
+			/*! Requests which are currently waiting for any device.*/
+			unsigned int waiting;
+			/*! Maximum of waiting since the start.*/
+			unsigned int maxWaiting;
+			/*! Requests which got the device at once.*/
+			unsigned long long admitted;
+			/*! Requests which got the device after waiting.*/
+			unsigned long long queued;
+			/*! Requests which were rejected because a queue was full.*/
+			unsigned long long rejected;
+			/*! Requests which were rejected because they waited longer than I2C_QUEUE_WAIT_TIMEOUT.*/
+			unsigned long long timedOut;
+		};
+
+
+		/**Base-constructor.*/
+		DeviceQueue();
+
+
+		/**Base-destructor.*/
+		~DeviceQueue();
+
+
+		/**
+		 * Waits till the client is allowed to use the device.
+		 * \param device Unique id of the device.
+		 * \param owner Client which uses the device.
+		 * \param priority Priority class of the request.
+		 * \param cost Bytes which the request transfers, charged against the deficit of the client.
+		 * \throws Error With I2C_OVERLOADED_ERROR_CODE if a queue is full or the turn did not come within I2C_QUEUE_WAIT_TIMEOUT.
+		 */
+		void enter(unsigned int device, const void* owner, QueuePriority priority = QUEUE_INTERACTIVE, unsigned int cost = 0);
+
+
+		/**
+		 * Ends a use, which was started with enter(). The next waiting request gets the device.
+		 * \param device Unique id of the device.
+		 * \param owner Client which used the device.
+		 */
+		void leave(unsigned int device, const void* owner);
+
+
+		/**
+		 * \param device Unique id of the device.
+		 * \return True if requests wait for the device, a bulk transfer should then give it up between two chunks.
+		 */
+		bool hasWaiters(unsigned int device);
+
+
+		/**
+		 * Ends all uses of a client, for a closed connection.
+		 * \param owner The client.
+		 */
+		void releaseAll(const void* owner);
+
+
+		/** \param counters Will contain the current metrics.*/
+		void get(Counters &counters);
+
+
+		/** \param depths Will contain the number of waiting requests of every device with waiting requests.*/
+		void getDepths(map<unsigned int, unsigned int> &depths);
+
+
+	private:
+
+		/**
+		 * \struct Waiter
+		 * Request which waits for a device.
+		 */
+		struct Waiter{
+			/*! Client of the request.*/
+			const void* owner;
+			/*! Bytes which the request transfers.*/
+			unsigned int cost;
+			/*! Set when the request got the device.*/
+			bool granted;
+		};
+
+		/**
+		 * \struct Flow
+		 * Waiting requests of one client within one priority class.
+		 */
+		struct Flow{
+			/*! The client.*/
+			const void* owner;
+			/*! Bytes the client may still transfer in this round.*/
+			unsigned long long deficit;
+			/*! Waiting requests in the order of their arrival.*/
+			list<Waiter*> waiters;
+		};
+
+		/**
+		 * \struct Entry
+		 * Queue of one device.
+		 */
+		struct Entry{
+			/*! Client which uses the device or NULL.*/
+			const void* holder;
+			/*! Number of enter() of holder without leave().*/
+			unsigned int holds;
+			/*! Start of the current use.*/
+			struct timespec since;
+			/*! Average use of the device in microseconds.*/
+			unsigned long long averageHold;
+			/*! Clients with waiting requests of every priority class, in the order of their turns.*/
+			list<Flow> flows[QUEUE_NUMBER_OF_PRIORITIES];
+			/*! Number of waiting requests.*/
+			unsigned int waiting;
+			/*! Interactive requests which got the device since the last bulk request.*/
+			unsigned int interactiveTurns;
+
+			Entry()
+			{
+				holder = NULL;
+				holds = 0;
+				since.tv_sec = 0;
+				since.tv_nsec = 0;
+				averageHold = I2C_QUEUE_DEFAULT_HOLD * 1000;
+				waiting = 0;
+				interactiveTurns = 0;
+			}
+		};
+
+		/*! Queues of all devices which were used.*/
+		map<unsigned int, Entry> entries;
+		/*! Metrics.*/
+		Counters counters;
+		/*! Protects entries and counters.*/
+		pthread_mutex_t mutex;
+		/*! Signaled whenever a waiter got its device.*/
+		pthread_cond_t changed;
+
+
+		/**
+		 * Rejects a request with I2C_OVERLOADED_ERROR_CODE, mutex has to be locked and is unlocked.
+		 * \param entry Queue of the requested device.
+		 * \param reason Reason of the rejection.
+		 * \param counter Counter of the rejection, like counters.rejected.
+		 * \throws Error Always.
+		 */
+		void reject(Entry &entry, const char* reason, unsigned long long &counter);
+
+
+		/** Gives the device to the next waiter, mutex has to be locked.*/
+		void finishUse(Entry &entry);
+
+
+		/**
+		 * Gives a free device to the next waiter by priority class and deficit round robin, mutex has to be locked.
+		 * \param entry Queue of the device.
+		 */
+		void grantNext(Entry &entry);
+
+
+		/**
+		 * Removes a waiter which gave up, mutex has to be locked.
+		 * \param flows Flows of the priority class of the waiter.
+		 * \param waiter The waiter.
+		 */
+		static void removeWaiter(list<Flow> &flows, Waiter* waiter);
+
+
+		/** \return Current time of CLOCK_MONOTONIC.*/
+		static struct timespec now();
+
+
+		/** \return Microseconds from a to b.*/
+		static unsigned long long elapsed(const struct timespec &a, const struct timespec &b);
+};
+
+#endif /* INCLUDE_DEVICEQUEUE_HPP_ */
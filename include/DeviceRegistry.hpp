@@ -0,0 +1,135 @@
+#ifndef INCLUDE_DEVICEREGISTRY_HPP_
+#define INCLUDE_DEVICEREGISTRY_HPP_
+
+#include <pthread.h>
+#include <list>
+#include <map>
+
+#include "I2cBackend.hpp"
+#include "I2cDevice.hpp"
+
+using namespace std;
+
+/*! Milliseconds between two discoveries of the background thread.*/
+#ifndef I2C_DISCOVERY_INTERVAL
+#define I2C_DISCOVERY_INTERVAL 5000
+#endif
+
+/*! Minimum milliseconds between two discoveries caused by requests with unknown devices.*/
+#ifndef I2C_DISCOVERY_MIN_INTERVAL
+#define I2C_DISCOVERY_MIN_INTERVAL 500
+#endif
+
+/*! Directory which is watched for new or removed i2c-dev devices.*/
+#define I2C_DISCOVERY_WATCH_DIR "/dev"
+
+
+/**
+ * \class DeviceRegistry
+ * \brief Plugin-wide table of all devices, consulted by all I2c instances.
+ * A background thread discovers the devices of the shared backends (in-process Aardvark, i2c-dev, simulated buses) at
+ * start(), every I2C_DISCOVERY_INTERVAL and whenever a i2c-dev device is created or removed in I2C_DISCOVERY_WATCH_DIR,
+ * so clients can use a device without calling i2c.getI2cDevices first. Devices of the Aardvark-Plugin can only be found
+ * with sub-requests, so I2c instances discover them and store them with replace().
+ * Lookups only take the read lock of a rwlock, so concurrent requests do not block each other. A discovery calls
+ * findDevices() of the backends without holding the lock.
+ */
+class DeviceRegistry{
+
+	public:
+
+		/**
+		 * Base-constructor.
+		 * \param backends Backends whose devices are discovered, the list is read at every discovery.
+		 */
+		DeviceRegistry(list<I2cBackend*>* backends);
+
+
+		/**Base-destructor, stops the background thread.*/
+		~DeviceRegistry();
+
+
+		/**
+		 * Starts the background thread, which begins with the first discovery. Requests for devices which are not yet
+		 * discovered wait for this discovery, see discover().
+		 * \throws Error If the thread can not be created.
+		 */
+		void start();
+
+
+		/** Stops the background thread, afterwards the backends can be deleted.*/
+		void stop();
+
+
+		/**
+		 * Discovers the devices of all backends and replaces their devices within the table. Backends which fail are skipped,
+		 * their devices stay in the table till a later discovery of the backend succeeds.
+		 * \param force If false, the discovery is skipped if the last one was less than I2C_DISCOVERY_MIN_INTERVAL ago.
+		 */
+		void discover(bool force);
+
+
+		/**
+		 * Searches a device by its unique id.
+		 * \param uniqueId The unique id of the device.
+		 * \param name Gets the name of the device, which is the name of its backend.
+		 * \param port Gets the port of the device.
+		 * \return True if the device is known.
+		 */
+		bool find(unsigned int uniqueId, const char* &name, int &port);
+
+
+		/**
+		 * Replaces all devices of a backend. A device whose id is already used by another backend is ignored and logged.
+		 * \param name Name of the backend, has to stay valid as long as the registry.
+		 * \param found New devices of the backend, they are deleted and removed from the list.
+		 */
+		void replace(const char* name, list<I2cDevice*> &found);
+
+
+		/**
+		 * \param name Name of a backend.
+		 * \param ids Gets the unique ids of all devices of the backend.
+		 */
+		void getIds(const char* name, list<unsigned int> &ids);
+
+
+	private:
+		/**
+		 * \struct Device
+		 * Entry of the table.
+		 */
+		struct Device{
+			/*! Name of the device, which is the name of its backend.*/
+			const char* name;
+			/*! Port of the device.*/
+			int port;
+		};
+
+		/*! Backends which are discovered by discover().*/
+		list<I2cBackend*>* backends;
+		/*! Table of all devices, mapped by their unique id.*/
+		map<unsigned int, Device> devices;
+		/*! Protects devices, lookups only take the read lock.*/
+		pthread_rwlock_t devicesLock;
+		/*! Serializes discoveries and protects lastDiscovery.*/
+		pthread_mutex_t discoveryMutex;
+		/*! Milliseconds of CLOCK_MONOTONIC of the last discovery, 0 before the first one.*/
+		unsigned long long lastDiscovery;
+		/*! Background thread.*/
+		pthread_t thread;
+		/*! True if the background thread was started.*/
+		bool running;
+		/*! Pipe for stopping the background thread.*/
+		int stopPipe[2];
+
+
+		/** Discovers the devices, till the pipe is written.*/
+		static void* discoveryThread(void* arg);
+
+
+		/** \return Milliseconds of CLOCK_MONOTONIC.*/
+		static unsigned long long now();
+};
+
+#endif /* INCLUDE_DEVICEREGISTRY_HPP_ */
@@ -4,8 +4,42 @@
 /*! Timeout in seconds for waiting for a subresponse*/
 #define SUBRESPONSE_TIMEOUT 180
 
+/*! A session which was not used for this number of seconds will be closed.*/
+#ifndef I2C_SESSION_IDLE_TIMEOUT
+#define I2C_SESSION_IDLE_TIMEOUT 60
+#endif
+
+/*! Retries of a bus transaction which failed with a status of I2C_RETRY_STATUS_MASK, if the request has no "retries".*/
+#ifndef I2C_RETRY_DEFAULT_COUNT
+#define I2C_RETRY_DEFAULT_COUNT 3
+#endif
+
+/*! Backoff in microseconds before the first retry, it is doubled for every further retry.*/
+#ifndef I2C_RETRY_BACKOFF_BASE
+#define I2C_RETRY_BACKOFF_BASE 500
+#endif
+
+/*! Maximum backoff in microseconds before a retry.*/
+#ifndef I2C_RETRY_BACKOFF_MAX
+#define I2C_RETRY_BACKOFF_MAX 20000
+#endif
+
+/*! Bit mask of the AardvarkI2cStatus values which are retried, a transaction with any other error is never repeated.*/
+#ifndef I2C_RETRY_STATUS_MASK
+#define I2C_RETRY_STATUS_MASK ((1 << AA_I2C_STATUS_SLA_NACK) | (1 << AA_I2C_STATUS_ARB_LOST) | (1 << AA_I2C_STATUS_BUS_ERROR))
+#endif
+
+/*! Bytes of one chunk of a read with "priority": "bulk", between two chunks waiting requests can use the device.
+ * Has to be smaller than the 256 byte register space, only reads within it are split.*/
+#ifndef I2C_BULK_CHUNK_SIZE
+#define I2C_BULK_CHUNK_SIZE 32
+#endif
+
 #include <pthread.h>
+#include <signal.h>
 #include <ctime>
+#include <map>
+#include <string>
 
 #include "document.h"
 #include "writer.h"
@@ -16,6 +50,18 @@
 #include "ProcessInterfaceB.hpp"
 #include "JsonRPC.hpp"
 #include "I2cDevice.hpp"
+#include "I2cBackend.hpp"
+#include "I2cSchema.hpp"
+#include "DeviceLockTable.hpp"
+#include "ReadCoalescer.hpp"
+#include "I2cStats.hpp"
+#include "AsyncLog.hpp"
+#include "Tracer.hpp"
+#include "Recorder.hpp"
+#include "DeviceRegistry.hpp"
+#include "WorkspacePool.hpp"
+#include "DeviceQueue.hpp"
+#include "SessionSweeper.hpp"
 #include "OutgoingMsg.hpp"
 #include "IncomingMsg.hpp"
 
@@ -44,8 +90,28 @@ class I2c : public ProcessInterfaceB, public RPCInterface<I2c*, i2cfptr>
 {
 	public:
 
-		/**Base-constructor.*/
-		I2c();
+		/**
+		 * Base-constructor.
+		 * \param sharedBackends Backends which are shared by all I2c instances, like in-process drivers or simulated buses.
+		 * If the list does not contain a backend for Aardvark devices, I2c will use the Aardvark-Plugin through RSD.
+		 * Shared backends will not be deleted by I2c.
+		 * \param sharedLocks Plugin-wide table of device locks, I2c uses a own table if it is NULL.
+		 * \param sharedReads Plugin-wide coalescer of reads, I2c uses a own coalescer if it is NULL.
+		 * \param sharedStats Plugin-wide counters, I2c uses own counters if it is NULL.
+		 * \param sharedLog Plugin-wide logger for all main- and sub-messages, messages are not logged by I2c if it is NULL.
+		 * \param sharedTracer Plugin-wide tracer, I2c records no spans if it is NULL.
+		 * \param sharedRecorder Plugin-wide recording of all main- and sub-messages, nothing is recorded if it is NULL.
+		 * \param sharedRegistry Plugin-wide devices of sharedBackends, I2c uses a own registry without background discovery
+		 * if it is NULL.
+		 * \param sharedWorkspaces Plugin-wide pool of parsers and DOMs, I2c uses a own pool if it is NULL.
+		 * \param sharedQueue Plugin-wide queues of the devices, I2c uses own queues if it is NULL.
+		 * \param sharedSweeper Plugin-wide sweeper of idle sessions, idle sessions are only closed at the next request of
+		 * this connection if it is NULL.
+		 */
+		I2c(list<I2cBackend*>* sharedBackends = NULL, DeviceLockTable* sharedLocks = NULL, ReadCoalescer* sharedReads = NULL,
+				I2cStats* sharedStats = NULL, AsyncLog* sharedLog = NULL, Tracer* sharedTracer = NULL,
+				Recorder* sharedRecorder = NULL, DeviceRegistry* sharedRegistry = NULL, WorkspacePool* sharedWorkspaces = NULL,
+				DeviceQueue* sharedQueue = NULL, SessionSweeper* sharedSweeper = NULL);
 
 
 		/**Base-destructor.*/
@@ -72,18 +138,60 @@ class I2c : public ProcessInterfaceB, public RPCInterface<I2c*, i2cfptr>
 		bool isSubResponse(RPCMsg* rpcMsg);
 
 
+		/**
+		 * Closes the sessions which were not used for I2C_SESSION_IDLE_TIMEOUT seconds, called by the SessionSweeper.
+		 * Does nothing while a request is processed, process() sweeps the sessions itself. Sessions of the Aardvark-Plugin
+		 * can only be closed with sub-requests, so they only release their lock table entry and their queue slot and are
+		 * closed at the next request.
+		 */
+		void sweepIdleSessions();
+
+
+		/**
+		 * Sends a json rpc request (sub-request) with the json rpc id of the current main-request and
+		 * waits for the corresponding sub-response.
+		 * \param method Name of the requested function of the other plugin.
+		 * \param params Params of the sub-request.
+		 * \return The member "result" of the sub-response.
+		 * \throws Error If a json rpc error response was received as sub-response or no sub-response was received.
+		 */
+		Value* sendSubRequest(Value &method, Value &params);
+
+
+		/** \return Json RPC parser of the current request, can be used to analyze the result of sendSubRequest().*/
+		JsonRPC* getJson(){return this->json;}
+
+
+		/** \return Allocator of the current request for generating the params of sub-requests.*/
+		MemoryPoolAllocator<> &getSubRequestAllocator(){return this->workspace->subRequestAllocator;}
+
+
 	private:
 
-		/** Stores all I2cDevices which can be get through rpc messages to the corresponding plugins.*/
-		list<I2cDevice*> deviceList;
-		/** Json RPC parser.*/
+		/*! Devices of all backends, shared by all I2c instances of the plugin.*/
+		DeviceRegistry* registry;
+		/*! Own registry, if the constructor got no shared registry.*/
+		DeviceRegistry* ownRegistry;
+		/*! Shared backends, which are discovered by the own registry.*/
+		list<I2cBackend*> registryBackends;
+		/*! Pool of parsers and DOMs, shared by all I2c instances of the plugin.*/
+		WorkspacePool* workspaces;
+		/*! Own pool, if the constructor got no shared pool.*/
+		WorkspacePool* ownWorkspaces;
+		/*! Workspace of the current request, NULL between requests.*/
+		Workspace* workspace;
+		/*! Protects workspace and requestId against isSubResponse(), which runs in the receive thread.*/
+		pthread_mutex_t workspaceMutex;
+		/** Json RPC parser of the workspace.*/
 		JsonRPC* json;
-		/** DOM for the main-request.*/
+		/** DOM for the main-request of the workspace.*/
 		Document* mainRequestDom;
-		/** DOM for the sub-response.*/
+		/** DOM for the sub-response of the workspace.*/
 		Document* subResponseDom;
-		/** */
-		rapidjson::MemoryPoolAllocator<> subRequestAllocator;
+		/*! Backend for Aardvark devices which sends sub-requests to the Aardvark-Plugin.*/
+		I2cBackend* rsdBackend;
+		/*! All backends which can be used by this instance, the name of a backend is the name of its devices.*/
+		list<I2cBackend*> backends;
 
 		/*! Final response message.*/
 		const char* mainResponse;
@@ -97,6 +205,148 @@ class I2c : public ProcessInterfaceB, public RPCInterface<I2c*, i2cfptr>
 		Value* requestId;
 		/*! Containing the value "result" of the las sub-response.*/
 		Value* subResult;
+		/*! Member functions of the methods, indexed by I2cMethod.*/
+		i2cfptr methods[I2C_NUMBER_OF_METHODS];
+
+		/**
+		 * \struct Session
+		 * A device which is kept open by i2c.open.
+		 */
+		struct Session{
+			/*! Token of the session, only valid for this connection.*/
+			unsigned int token;
+			/*! Unique id of the device.*/
+			unsigned int device;
+			/*! Backend of the device.*/
+			I2cBackend* backend;
+			/*! Handle of the opened device.*/
+			int handle;
+			/*! Time of the last use, in seconds of CLOCK_MONOTONIC.*/
+			time_t lastUsed;
+			/*! True if the SessionSweeper released the device within the lock table and the queue, but not the handle.*/
+			bool released;
+		};
+
+		/**
+		 * \struct ScanJob
+		 * Scan of one device by i2c.scan.
+		 */
+		struct ScanJob{
+			/*! Unique id of the device.*/
+			unsigned int device;
+			/*! Backend of the device.*/
+			I2cBackend* backend;
+			/*! Handle of the opened device or -1.*/
+			int handle;
+			/*! First address to probe.*/
+			int first;
+			/*! Last address to probe.*/
+			int last;
+			/*! True for probing with a single-byte read instead of a zero-length write.*/
+			bool read;
+			/*! Addresses of the responding slaves.*/
+			vector<int> addresses;
+			/*! True if the scan of the device failed.*/
+			bool failed;
+			/*! Message of the error, if the scan failed.*/
+			string error;
+		};
+
+		/**
+		 * \struct TransferPlan
+		 * Messages of a i2c.transfer.
+		 */
+		struct TransferPlan{
+			/*! Messages which are executed.*/
+			vector<I2cMessage> messages;
+			/*! True for every message which ends a transaction.*/
+			vector<bool> ends;
+			/*! Data of every message.*/
+			vector< vector<unsigned char> > buffers;
+			/*! Index of the message of every op.*/
+			vector<unsigned int> opMessage;
+			/*! Offset of the data of every op within the data of its message.*/
+			vector<unsigned int> opOffset;
+		};
+
+		/**
+		 * \struct SpiOp
+		 * One SPI transfer of a spi.transfer or spi.batch.
+		 */
+		struct SpiOp{
+			/*! Bytes to write.*/
+			vector<unsigned char> dataOut;
+			/*! Buffer for the read bytes, its size is the number of bytes to read.*/
+			vector<unsigned char> dataIn;
+			/*! Number of bytes which were really read.*/
+			unsigned int count;
+		};
+
+		/**
+		 * \struct SpiJob
+		 * Settings and ops of a spi.transfer or spi.batch.
+		 */
+		struct SpiJob{
+			/*! Unique id of the device.*/
+			unsigned int device;
+			/*! True if the SPI bitrate has to be configured.*/
+			bool hasBitrate;
+			/*! SPI bitrate in kHz.*/
+			int bitrate;
+			/*! AardvarkSpiPolarity.*/
+			int polarity;
+			/*! AardvarkSpiPhase.*/
+			int phase;
+			/*! AardvarkSpiBitorder.*/
+			int bitorder;
+			/*! AardvarkSpiSSPolarity.*/
+			int ssPolarity;
+			/*! Priority class within the queue of the device.*/
+			QueuePriority priority;
+			/*! True if "data_in" is returned as base64 string.*/
+			bool base64;
+			/*! Transfers which are executed in this order.*/
+			vector<SpiOp> ops;
+		};
+
+		/*! All open sessions of this connection, mapped by their token.*/
+		map<unsigned int, Session*> sessions;
+		/*! Token for the next session.*/
+		unsigned int nextSessionToken;
+		/*! Protects sessions, held by process() while a request is processed.*/
+		pthread_mutex_t sessionMutex;
+		/*! Sweeper of idle sessions or NULL, shared by all I2c instances of the plugin.*/
+		SessionSweeper* sweeper;
+		/*! Table of device locks, shared by all I2c instances of the plugin.*/
+		DeviceLockTable* locks;
+		/*! Own table of device locks, if the constructor got no shared table.*/
+		DeviceLockTable* ownLocks;
+		/*! Queues of the devices, shared by all I2c instances of the plugin.*/
+		DeviceQueue* queue;
+		/*! Own queues, if the constructor got no shared queues.*/
+		DeviceQueue* ownQueue;
+		/*! Coalescer of identical reads, shared by all I2c instances of the plugin.*/
+		ReadCoalescer* reads;
+		/*! Own coalescer, if the constructor got no shared coalescer.*/
+		ReadCoalescer* ownReads;
+		/*! Counters of bus transactions, shared by all I2c instances of the plugin.*/
+		I2cStats* stats;
+		/*! Own counters, if the constructor got no shared counters.*/
+		I2cStats* ownStats;
+		/*! Logger for all messages or NULL, shared by all I2c instances of the plugin.*/
+		AsyncLog* asyncLog;
+		/*! Tracer for spans of requests and sub-requests or NULL, shared by all I2c instances of the plugin.*/
+		Tracer* tracer;
+		/*! Recording of all messages or NULL, shared by all I2c instances of the plugin.*/
+		Recorder* recorder;
+		/*! Number of this connection within the recording.*/
+		unsigned int recordConnection;
+		/*! Json rpc id of the current main-request as string, for tagging spans.*/
+		char traceRequestId[I2C_TRACE_NAME_LENGTH];
+		/*! Unique id of the device of the current main-request or -1, for tagging spans.*/
+		long long traceDevice;
+		/*! Seed for the jitter of the retry backoff.*/
+		unsigned int retrySeed;
 
 
 		/*Sigset for configuring SIGUSR2 to signal the Reception of subresponses.*/
@@ -105,11 +355,9 @@ class I2c : public ProcessInterfaceB, public RPCInterface<I2c*, i2cfptr>
 		struct timespec timeout;
 
 
-		/** Deletes the deviceList, all Devices will be deallocated.*/
-		void deleteDeviceList();
-
 		/**
-		 * Calls all function to gather information about all devices with I²C interfaces.
+		 * Searches for devices with all backends to gather information about all devices with I²C interfaces.
+		 * A backend which fails (like a not registered Aardvark-Plugin) will be skipped.
 		 * \params Can be an empty rapidjson::Value.
 		 * \return Will contain a named array for every different I²C hardware.
 		 *  The array-name will be the name of the hardware and will contain the unique identifiers.
@@ -119,59 +367,150 @@ class I2c : public ProcessInterfaceB, public RPCInterface<I2c*, i2cfptr>
 
 		/**
 		 * Gets all Aardvark devices and saves them to a list.
-		 * For getting the information about the aardvark devices, a sub-request to the Aardvark-Plugin will be send
-		 * and a sub-response will be received.
+		 * For getting the information about the aardvark devices, the backend for Aardvark devices will be used.
 		 * \return Will contain a array named "Aardvark" and all serial numbers of the different Aardvark devices which are available.
 		 */
 		bool getAardvarkDevices(Value &params, Value &result);
 
 
 		/**
-		 * Sends aa_open, aa_target_power, aa_i2c_write and aa_close as json rpc requests to the Aardvark-Plugin.
-		 * Every request is send as sub-request, while waiting for a sub-response the function will block. Every
-		 * sub-request will have the same json rpc id as the main request. Because of that, a sub-response can assigned
-		 * to a sub-request and/or the main-request. If everything works fine, the function will send a json rpc response for
-		 * the main-request. If something goes wrong a json rpc error response will be send immediately and aa_write will be aborted.
-		 *
+		 * Opens the device, activates the target power, writes "data_out" to the slave "slave_addr" and closes the device.
+		 * If the optional member "bitrate" is set, the I²C bitrate (kHz) will be configured before writing.
+		 * "data_out" can be a array of bytes or a base64 string.
+		 * All params are validated before the device is opened and the device is closed on every error path.
+		 * Every step is executed through the backend of the device, like the Aardvark-Plugin (through RSD), an in-process driver
+		 * or a simulated bus. A write which fails with a NACK, lost arbitration or bus error is repeated on the open device,
+		 * up to the optional "retries" (default I2C_RETRY_DEFAULT_COUNT) times.
+		 * The optional "priority" ("interactive", default, or "bulk") is the priority class within the queue of the device,
+		 * see DeviceQueue.
+		 * If everything works fine, the function will generate a json rpc response for the main-request. If something goes wrong
+		 * an Error will be thrown and a json rpc error response will be send.
 		 */
 		bool write(Value &params, Value &result);
 
 
-
+		/**
+		 * Opens the device, activates the target power, writes "mem_addr" and reads "num_bytes" bytes after a repeated start
+		 * from the slave "slave_addr" and closes the device. The optional member "bitrate" is handled like in write().
+		 * \return The member "data_in" containing the read bytes, written into result. If the optional member "encoding" is
+		 * "base64", "data_in" will be a base64 string instead of a array.
+		 * Identical reads (device, slave_addr, mem_addr, num_bytes, bitrate) of several clients at the same time share one bus
+		 * transaction. With the optional member "max_age" (ms), a cached result of a identical read which is not older will be
+		 * returned without any bus transaction, this should only be used for registers without side effects on reading.
+		 * Failed bus transactions are repeated like in write(). With "priority": "bulk" (see write()) the read is split into
+		 * chunks of I2C_BULK_CHUNK_SIZE bytes and other requests can use the device between two chunks, so a big read does
+		 * not delay small requests. Every chunk writes its own register address (mem_addr plus offset). A read which would
+		 * cross register 0xFF is never split, because slaves differ in what follows 0xFF (wrap around to 0x00, next page,
+		 * no auto-increment), so such a read is one transaction like without "priority".
+		 */
 		bool read(Value &params, Value &result);
 
 
 		/**
-		 * Sends a json rpc request (sub-request) to the Aardvark-plugin and waits for the
-		 * corresponding sub-response. On success the function will add the received result
-		 * to the value params, so that further functions can use it.
-		 * \throws Error If a json rpc error response was received as sub-response.
+		 * Opens the device "device" (and configures the optional "bitrate") and keeps it open for this connection.
+		 * The device stays open till i2c.close, the connection is closed or the session was not used for
+		 * I2C_SESSION_IDLE_TIMEOUT seconds.
+		 * \return The member "session" containing the token for i2c.transfer and i2c.close, written into result.
+		 */
+		bool openSession(Value &params, Value &result);
+
+
+		/**
+		 * Executes the array "ops" on the device of the session "session". Every op is a object with "op" ("write" or "read"),
+		 * "slave_addr", optional "AardvarkI2cFlags" and "data_out" for writes or "num_bytes" for reads. Consecutive ops are
+		 * executed as one I²C transaction with repeated starts, a op with "stop": true ends the transaction.
+		 * All ops are validated before the first one is executed.
+		 * A write op can contain "mem_addr", which is send in front of "data_out". Write ops with "mem_addr" which are
+		 * transactions by themselves and write to the next registers of the same slave are merged into one bus write,
+		 * because the slave increments the register address. The optional "page_size" of the first op prevents merging
+		 * over a page boundary (EEPROMs wrap around at the end of a page). The results still contain one "count" per op.
+		 * A failed transaction is repeated like in write(), only the failed transaction is repeated, not the whole batch.
+		 * \return The member "results" with a object for every op, read ops contain "data_in" (base64 string if "encoding"
+		 * is "base64"), written into result.
+		 */
+		bool transfer(Value &params, Value &result);
+
+
+		/**
+		 * Closes the device of the session "session".
+		 */
+		bool closeSession(Value &params, Value &result);
+
+
+		/**
+		 * Locks the device "device" for this connection, so a sequence of requests can not be interleaved with requests of
+		 * other clients. Requests of other clients on this device wait till i2c.unlock, the connection is closed or the
+		 * optional "lease" (seconds, default I2C_LOCK_DEFAULT_LEASE) expired. Every use of the device renews the lease.
+		 * Waits till other clients finished their current use of the device.
+		 */
+		bool lock(Value &params, Value &result);
+
+
+		/**
+		 * Unlocks the device "device", which was locked by i2c.lock of this connection.
 		 */
-		void aa_open(Value &params);
+		bool unlock(Value &params, Value &result);
 
 
 		/**
-		 * Sends a json rpc request (sub-request) to the Aardvark-plugin and waits for the corresponding
-		 * sub-response.
-		 * \throws Error If the received json rpc response contains a negative return value.
+		 * \return Plugin-wide counters of bus transactions: "transactions", "retries", "recovered" (successful after a retry),
+		 * "exhausted" (failed after all retries), the object "busErrors" with the number of failed transactions for
+		 * every AardvarkI2cStatus, like "SLA_NACK", the object "memory" with the open "connections", the
+		 * "connectionBytes" of this connection, "workspacesInUse", "idleWorkspaces" and "idleWorkspaceBytes" and the object
+		 * "queue" with the metrics of DeviceQueue and the array "devices" of {"device", "waiting"} for every device with
+		 * waiting requests, written into result.
 		 */
-		void aa_target_power(Value &params);
+		bool getStats(Value &params, Value &result);
 
 
+		/**
+		 * Probes the addresses "first" to "last" (default I2C_SCAN_FIRST_ADDR to I2C_SCAN_LAST_ADDR) of the device "device"
+		 * or of every device within the array "devices". Every device is opened once (with the optional "bitrate") and every
+		 * address is probed with a zero-length write ("mode": "quick", default) or a single-byte read ("mode": "read"), a
+		 * slave which acknowledges its address responds. Read mode should be used for backends which do not report a NACK
+		 * of a write, like the Aardvark-Plugin. Devices of in-process backends are scanned concurrently, one thread per device.
+		 * The optional "priority" is handled like in write().
+		 * \return The member "devices" with a object for every device: "device", "addresses" (the responding addresses)
+		 * and "error" if the device could not be opened or the scan stopped because of a error other than a NACK, written
+		 * into result.
+		 */
+		bool scan(Value &params, Value &result);
+
+
+		/**
+		 * Enables ("enable": true) or disables the plugin-wide recording of spans. Spans are recorded for processing a main-request,
+		 * every sub-request (send, wait for the sub-response, parse) and the generation of the response, tagged with the
+		 * json rpc id and the device. The last I2C_TRACE_SPANS spans are kept.
+		 */
+		bool trace(Value &params, Value &result);
 
-		void aa_write(Value &params);
 
+		/**
+		 * Writes the recorded spans as Chrome trace json (chrome://tracing, Perfetto) to I2C_TRACE_FILE.
+		 * \return The members "file" and "spans" (number of written spans), written into result.
+		 */
+		bool dumpTrace(Value &params, Value &result);
 
 
-		void aa_read(Value &params, Value &result);
+		/**
+		 * Opens the device "device", enables its SPI master and writes "data_out" to the SPI slave. The full-duplex response
+		 * of "num_bytes" bytes (default: the length of "data_out") is read while writing, if "num_bytes" is bigger the written
+		 * bytes are padded. The optional "polarity", "phase", "bitorder" (default 0: mode 0, MSB first), "ss_polarity"
+		 * (default 0: active low) and "bitrate" (kHz) configure the SPI master, "priority" is handled like in write().
+		 * Only devices with a SPI master support it, like the Aardvark.
+		 * \return The member "data_in" (base64 string if "encoding" is "base64"), written into result.
+		 */
+		bool spiTransfer(Value &params, Value &result);
 
 
 		/**
-		 * Sends a json rpc request (sub-request) to the Aardvark-plugin and waits for the corresponding
-		 * sub-response.
-		 * \throws Error If the received json rpc response contains a negative return value.
+		 * Executes the array "ops" on the SPI master of the device "device" with one open and one configuration. Every op is
+		 * a object with "data_out" and the optional "num_bytes", which is written like in spiTransfer() with its own slave
+		 * select, like the commands of a SPI flash. The other params are handled like in spiTransfer(), all ops are validated
+		 * before the device is opened.
+		 * \return The member "results" with a object with "data_in" for every op, written into result.
 		 */
-		void aa_close(Value &params);
+		bool spiBatch(Value &params, Value &result);
 
 
 		/**
@@ -192,11 +531,242 @@ class I2c : public ProcessInterfaceB, public RPCInterface<I2c*, i2cfptr>
 
 
 		/**
-		 * Searches for a device in the deviceList by its uniqueId and return the corresponding port.
+		 * Searches for a device in the registry by its uniqueId. If the device is unknown, the devices
+		 * are discovered again, so a client does not need to call i2c.getI2cDevices first.
 		 * \param uniqueId The unique id of the device (most likely the serial number).
-		 * \param The corresponding port.
+		 * \param backend Will be set to the backend of the device.
+		 * \return The port of the device.
+		 * \throws Error If there is no device with this uniqueId.
+		 */
+		int getPortByUniqueId(unsigned int uniqueId, I2cBackend* &backend);
+
+
+		/**
+		 * Searches for a device in the registry by its uniqueId.
+		 * \param uniqueId The unique id of the device.
+		 * \param backend Will be set to the backend of the device.
+		 * \param port Will be set to the port of the device.
+		 * \return True if the device is known.
+		 */
+		bool findDevice(unsigned int uniqueId, I2cBackend* &backend, int &port);
+
+
+		/**
+		 * Discovers the devices of the Aardvark-Plugin with a sub-request and stores them in the registry.
+		 * \throws Error If the Aardvark-Plugin could not be asked.
+		 */
+		void discoverRsdDevices();
+
+
+		/**
+		 * \param name Name of a backend, which is also the name of its devices.
+		 * \return The backend with this name.
+		 * \throws Error If there is no backend with this name.
+		 */
+		I2cBackend* getBackend(const char* name);
+
+
+		/**
+		 * Opens a device, activates the target power and configures the bitrate if it was requested.
+		 * The device is marked as used within the lock table, this waits while another client has locked the device.
+		 * \param uniqueId Unique id of the device.
+		 * \param hasBitrate True if the bitrate has to be configured.
+		 * \param bitrate Bitrate in kHz.
+		 * \param backend Will be set to the backend of the device.
+		 * \param priority Priority class within the queue of the device.
+		 * \param cost Bytes which will be transferred, for the fairness between the clients of the device.
+		 * \return Handle of the opened device.
+		 */
+		int openDevice(unsigned int uniqueId, bool hasBitrate, int bitrate, I2cBackend* &backend,
+				QueuePriority priority = QUEUE_INTERACTIVE, unsigned int cost = 0);
+
+
+		/**
+		 * Closes a device after a successful operation and ends its use within the lock table.
+		 * \param uniqueId Unique id of the device.
+		 * \param backend Backend of the device.
+		 * \param handle Handle of the device, will be set to -1 before closing, so a failing close is not repeated.
+		 * \throws Error If the device could not be closed.
+		 */
+		void closeDevice(unsigned int uniqueId, I2cBackend* backend, int &handle);
+
+
+		/**
+		 * Closes a device on a error path, errors of close are ignored so the original error reaches the client.
+		 * \param uniqueId Unique id of the device.
+		 * \param backend Backend of the device.
+		 * \param handle Handle of the device.
+		 */
+		void closeDeviceQuietly(unsigned int uniqueId, I2cBackend* backend, int handle);
+
+
+		/**
+		 * Gives the turn of a opened device to the requests waiting in its queue and waits for the next turn. The lock of the
+		 * device is kept and the target power is not set again. The handle has to be reopened, because all backends open a
+		 * device exclusively.
+		 * \param uniqueId Unique id of the device.
+		 * \param hasBitrate True if the bitrate has to be configured again, a waiting request may have changed it.
+		 * \param bitrate Bitrate in kHz.
+		 * \param backend Backend of the device.
+		 * \param handle Handle of the device, gets the new handle or -1 if the device was closed because of a error.
+		 * \param priority Priority class within the queue of the device.
+		 * \param cost Bytes which are transferred in the next turn.
+		 * \throws Error If the device can not be reopened or configured.
+		 */
+		void yieldDevice(unsigned int uniqueId, bool hasBitrate, int bitrate, I2cBackend* backend, int &handle,
+				QueuePriority priority, unsigned int cost);
+
+
+		/**
+		 * \param hasPriority True if the request contains "priority".
+		 * \param priority The validated "priority" of the request.
+		 * \return The priority class, QUEUE_INTERACTIVE if the request has no priority.
+		 */
+		static QueuePriority getPriority(bool hasPriority, const char* priority);
+
+
+		/**
+		 * Opens the device of a read, writes the register address and reads the bytes after a repeated start.
+		 * A bulk read is split into chunks, see read().
+		 * \param readParams Params of i2c.read.
+		 * \param data Buffer for the read bytes, its size is the number of bytes to read.
+		 * \return Number of read bytes.
+		 * \throws Error If the read fails, the device is closed in this case.
+		 */
+		unsigned int readRegister(I2cReadParams &readParams, vector<unsigned char> &data);
+
+
+		/**
+		 * Invalidates the coalesced reads of all slaves which were written by messages.
+		 * \param device Unique id of the device.
+		 * \param messages Messages of a i2c.transfer.
+		 */
+		void invalidateReads(unsigned int device, vector<I2cMessage> &messages);
+
+
+		/**
+		 * Executes a transaction and repeats it after a backoff, if it fails with a status of I2C_RETRY_STATUS_MASK.
+		 * The backoff starts with I2C_RETRY_BACKOFF_BASE, doubles for every retry and is randomized (between half and the
+		 * whole backoff), so clients which disturbed each other do not retry at the same time.
+		 * \param backend Backend of the device.
+		 * \param handle Handle of the opened device.
+		 * \param messages Messages of the transaction.
+		 * \param numMessages Number of messages.
+		 * \param retries Maximum number of retries.
+		 * \throws Error The error of the last try.
+		 */
+		void transferWithRetry(I2cBackend* backend, int handle, I2cMessage* messages, unsigned int numMessages, unsigned int retries);
+
+
+		/**
+		 * \param error Error thrown by a backend.
+		 * \return The AardvarkI2cStatus of a failed bus transaction or AA_I2C_STATUS_OK for any other error.
+		 */
+		static int getBusStatus(Error &error);
+
+
+		/**
+		 * Probes all addresses of a scan on the opened device, a error other than a NACK stops the scan.
+		 * \param job The scan, addresses or error will be set.
+		 */
+		static void scanDevice(ScanJob &job);
+
+
+		/** Thread function for scanning a device concurrently, arg is a ScanJob.*/
+		static void* scanThread(void* arg);
+
+
+		/**
+		 * Generates the json rpc response of the current main-request and stores it as mainResponse.
+		 * \param result The result of the response.
+		 */
+		void generateResponse(Value &result);
+
+
+		/**
+		 * Sets the json rpc id and the device of the current main-request for tagging spans.
+		 * \param id Json rpc id of the main-request.
+		 * \param params Params of the main-request, the device is taken from the member "device".
+		 */
+		void setTraceContext(Value &id, Value &params);
+
+
+		/**
+		 * Translates the ops of i2c.transfer into messages and merges writes to consecutive registers.
+		 * \param ops Validated ops.
+		 * \param plan Will contain the messages.
+		 */
+		void planTransfer(vector<I2cTransferOpParams> &ops, TransferPlan &plan);
+
+
+		/**
+		 * Copies the settings of a spi.transfer or spi.batch into a job, missing settings are 0.
+		 * \param params Validated I2cSpiTransferParams or I2cSpiBatchParams.
+		 * \param job The job.
+		 */
+		template<class SpiParams> void setSpiSettings(SpiParams &params, SpiJob &job);
+
+
+		/**
+		 * Opens the device of a job, configures its SPI master, executes all ops and closes the device.
+		 * \param job The job, the read bytes are stored within its ops.
+		 * \throws Error If a op fails, the device is closed in this case.
+		 */
+		void executeSpi(SpiJob &job);
+
+
+		/**
+		 * \param op A executed SPI op.
+		 * \param base64 True for a base64 string, false for a array.
+		 * \param dataIn Gets the read bytes of the op, allocated by the response DOM.
+		 */
+		void encodeSpiData(SpiOp &op, bool base64, Value &dataIn);
+
+
+		/** \return True if the op is a write with "mem_addr" and a transaction by itself.*/
+		bool isMergeableWrite(vector<I2cTransferOpParams> &ops, unsigned int index);
+
+
+		/** \return True if the op is the last op of a transaction.*/
+		bool endsTransaction(vector<I2cTransferOpParams> &ops, unsigned int index);
+
+
+		/**
+		 * \param first First op of a merged write.
+		 * \param lastAddr Register address of the last byte of the merged write.
+		 * \return True if the last byte is within the page of the first op.
+		 */
+		bool isSamePage(I2cTransferOpParams &first, unsigned int lastAddr);
+
+
+		/**
+		 * \param token Token of a session of this connection.
+		 * \return The session, its time of last use is updated.
+		 * \throws Error If there is no session with this token.
+		 */
+		Session* getSession(unsigned int token);
+
+
+		/**
+		 * Closes all sessions which were not used for I2C_SESSION_IDLE_TIMEOUT seconds.
+		 * Has to be called while processing a main-request, because closing can need sub-requests.
+		 */
+		void closeIdleSessions();
+
+
+		/** \return Seconds of CLOCK_MONOTONIC.*/
+		static time_t now();
+
+
+		/**
+		 * Executes the method of a main-request. The method is found by a perfect hash over the names of I2C_METHODS,
+		 * instead of searching funcMap.
+		 * \param method Member "method" of the main-request.
+		 * \param params Member "params" of the main-request.
+		 * \param result Will contain the result of the method.
+		 * \throws Error If the method is unknown or fails.
 		 */
-		int getPortByUniqueId(unsigned int uniqueId);
+		void dispatch(Value &method, Value &params, Value &result);
 
 };
 
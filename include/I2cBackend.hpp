@@ -0,0 +1,185 @@
+#ifndef INCLUDE_I2CBACKEND_HPP_
+#define INCLUDE_I2CBACKEND_HPP_
+
+#include <list>
+
+#include "I2cDevice.hpp"
+
+using namespace std;
+
+/*! Error code of a failed bus transaction is I2C_BUS_ERROR_BASE - status, status is a AardvarkI2cStatus like AA_I2C_STATUS_SLA_NACK.*/
+#define I2C_BUS_ERROR_BASE -33100
+/*! Error code of a failed bus transaction with the AardvarkI2cStatus status.*/
+#define I2C_BUS_ERROR_CODE(status) (I2C_BUS_ERROR_BASE - (status))
+/*! Number of AardvarkI2cStatus values (AA_I2C_STATUS_OK to AA_I2C_STATUS_LAST_DATA_ACK).*/
+#define I2C_NUMBER_OF_BUS_STATUS 8
+
+
+/**
+ * \struct I2cMessage
+ * One part of a I²C transaction, a read or write to one slave. Several messages can be executed as one
+ * transaction by I2cBackend::transfer(), every message except the last one ends with a repeated start instead of a stop.
+ */
+struct I2cMessage{
+	/*! I²C address of the slave device.*/
+	int slaveAddr;
+	/*! AardvarkI2cFlags like AA_I2C_10_BIT_ADDR, AA_I2C_NO_STOP will be set by the backend.*/
+	int flags;
+	/*! True for reading from the slave, false for writing to the slave.*/
+	bool read;
+	/*! Bytes to write or buffer for the read bytes.*/
+	unsigned char* data;
+	/*! Number of bytes to write or to read.*/
+	unsigned int length;
+	/*! Number of bytes which were really transferred, set by the backend.*/
+	unsigned int count;
+};
+
+
+/**
+ * \class I2cBackend
+ * \brief Interface between I2c and the driver of an I²C hardware.
+ * I2c does not care how a I²C transaction reaches the hardware. It uses an I2cBackend, which
+ * can be a plugin that is reached through RSD (sub-requests) or a driver that is called directly
+ * within the process of I2c-Plugin or a simulation of a I²C bus. All functions throw an Error if the underlying
+ * driver reports a negative return code. If the driver tells why a bus transaction failed, the Error has the code
+ * I2C_BUS_ERROR_CODE(status), so I2c can retry transactions which failed because of a NACK or lost arbitration. Backends which can execute a whole transaction at once should override
+ * transfer(), the default implementation executes every message as separate write() or read().
+ * Backends of hardware with a SPI master (the Aardvark) override spiConfigure(), spiBitrate() and spiWrite(), the default
+ * implementations throw an Error.
+ */
+class I2cBackend{
+
+	public:
+
+		/**Base-destructor.*/
+		virtual ~I2cBackend(){};
+
+
+		/** \return Name of the hardware which is accessed through this backend, like "Aardvark".*/
+		virtual const char* getName() = 0;
+
+
+		/**
+		 * Searches for all devices which can be accessed through this backend.
+		 * \param deviceList Every found device will be added as new I2cDevice to this list.
+		 */
+		virtual void findDevices(list<I2cDevice*> &deviceList) = 0;
+
+
+		/**
+		 * Opens a device.
+		 * \param port Accesspoint of the device, see I2cDevice::getPort().
+		 * \return Handle for all further operations on this device.
+		 */
+		virtual int open(int port) = 0;
+
+
+		/**
+		 * Activates/deactivates the target power pins of a device.
+		 * \param handle A handle returned by open().
+		 * \param powerMask Mask of the power pins, like AA_TARGET_POWER_BOTH.
+		 */
+		virtual void targetPower(int handle, int powerMask) = 0;
+
+
+		/**
+		 * Writes a stream of bytes to a I²C slave.
+		 * \param handle A handle returned by open().
+		 * \param slaveAddr I²C address of the slave device.
+		 * \param flags AardvarkI2cFlags like AA_I2C_NO_STOP.
+		 * \param data Bytes to write.
+		 * \param length Number of bytes within data.
+		 */
+		virtual void write(int handle, int slaveAddr, int flags, const unsigned char* data, unsigned int length) = 0;
+
+
+		/**
+		 * Reads a stream of bytes from a I²C slave.
+		 * \param handle A handle returned by open().
+		 * \param slaveAddr I²C address of the slave device.
+		 * \param flags AardvarkI2cFlags like AA_I2C_NO_STOP.
+		 * \param data Buffer for the read bytes, has to be at least length bytes big.
+		 * \param length Number of bytes to read.
+		 * \return Number of bytes which were really read.
+		 */
+		virtual unsigned int read(int handle, int slaveAddr, int flags, unsigned char* data, unsigned int length) = 0;
+
+
+		/**
+		 * Configures the I²C bitrate of a device.
+		 * \param handle A handle returned by open().
+		 * \param bitrate Bitrate in kilohertz.
+		 * \return The bitrate which was really set.
+		 */
+		virtual int configure(int handle, int bitrate) = 0;
+
+
+		/**
+		 * Executes several messages as one transaction, separated by repeated starts.
+		 * \param handle A handle returned by open().
+		 * \param messages Messages of the transaction, the member count of every message will be set.
+		 * \param numMessages Number of messages.
+		 */
+		virtual void transfer(int handle, I2cMessage* messages, unsigned int numMessages);
+
+
+		/**
+		 * Writes to a slave and reads from the same slave after a repeated start, like reading a register.
+		 * \param handle A handle returned by open().
+		 * \param slaveAddr I²C address of the slave device.
+		 * \param dataOut Bytes to write, like a register address.
+		 * \param lengthOut Number of bytes within dataOut.
+		 * \param dataIn Buffer for the read bytes.
+		 * \param lengthIn Number of bytes to read.
+		 * \return Number of bytes which were really read.
+		 */
+		virtual unsigned int combined(int handle, int slaveAddr, const unsigned char* dataOut, unsigned int lengthOut,
+				unsigned char* dataIn, unsigned int lengthIn);
+
+
+		/**
+		 * Enables the SPI master of a device and configures its mode.
+		 * \param handle A handle returned by open().
+		 * \param polarity AardvarkSpiPolarity of the clock.
+		 * \param phase AardvarkSpiPhase of the clock.
+		 * \param bitorder AardvarkSpiBitorder.
+		 * \param ssPolarity AardvarkSpiSSPolarity of the slave select line.
+		 * \throws Error If the device has no SPI master.
+		 */
+		virtual void spiConfigure(int handle, int polarity, int phase, int bitorder, int ssPolarity);
+
+
+		/**
+		 * Configures the SPI bitrate of a device.
+		 * \param handle A handle returned by open().
+		 * \param bitrate Bitrate in kilohertz.
+		 * \return The bitrate which was really set.
+		 * \throws Error If the device has no SPI master.
+		 */
+		virtual int spiBitrate(int handle, int bitrate);
+
+
+		/**
+		 * Writes a stream of bytes to the SPI slave and reads the full-duplex response, the slave select line is active
+		 * for the whole transfer.
+		 * \param handle A handle returned by open().
+		 * \param dataOut Bytes to write.
+		 * \param lengthOut Number of bytes within dataOut.
+		 * \param dataIn Buffer for the read bytes.
+		 * \param lengthIn Number of bytes to read, if it is bigger than lengthOut the written bytes are padded.
+		 * \return Number of bytes which were really read.
+		 * \throws Error If the device has no SPI master.
+		 */
+		virtual unsigned int spiWrite(int handle, const unsigned char* dataOut, unsigned int lengthOut, unsigned char* dataIn,
+				unsigned int lengthIn);
+
+
+		/**
+		 * Closes a device.
+		 * \param handle A handle returned by open().
+		 */
+		virtual void close(int handle) = 0;
+};
+
+#endif /* INCLUDE_I2CBACKEND_HPP_ */
@@ -0,0 +1,188 @@
+#ifndef INCLUDE_I2CDEVBACKEND_HPP_
+#define INCLUDE_I2CDEVBACKEND_HPP_
+
+#include <pthread.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <string>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "I2cBackend.hpp"
+
+/*! Directory of the sysfs which contains a entry i2c-N for every i2c-dev adapter.*/
+#define I2CDEV_SYSFS_PATH "/sys/class/i2c-dev"
+/*! Prefix of the device files of the adapters, the adapter number will be appended.*/
+#define I2CDEV_DEVICE_PATH "/dev/i2c-"
+/*! Unique ids of the adapters are I2CDEV_UNIQUE_ID_BASE plus a 28 bit hash, above the ids of the simulated buses.*/
+#define I2CDEV_UNIQUE_ID_BASE 0xF0000000U
+
+
+/**
+ * \class I2cDevBackend
+ * \brief I2cBackend for I²C buses of the Linux kernel, which are accessible through /dev/i2c-N.
+ * Every adapter is shown as device "I2cDev" with port = N. The adapters are found through the sysfs. The adapter number
+ * changes if a USB adapter is plugged in again, so the unique id is derived from the parent device of the adapter in the
+ * sysfs (the bus or USB port it hangs on) and the name of the adapter, see getUniqueId().
+ * A whole transaction (write + repeated start read or a batch of messages) is submitted with a single I2C_RDWR ioctl,
+ * so the kernel executes it without any stop between the messages. The device file of an adapter is opened at the first
+ * open() and kept open till the backend is deleted, so further transactions do not pay for opening the device file.
+ * A write with AA_I2C_NO_STOP is kept back and submitted together with the next message of the same handle, its count
+ * is 0 because it was not executed yet.
+ * The access to the kernel is done by the virtual functions openAdapter() and ioctlRdwr(), which can be overwritten
+ * for using a fake ioctl layer. For a test with the real kernel interface, the module i2c-stub can be used.
+ */
+class I2cDevBackend : public I2cBackend{
+
+	public:
+
+		/**
+		 * Base-constructor.
+		 * \param sysfsPath Directory with a entry i2c-N for every adapter.
+		 * \param devicePath Prefix of the device files, the adapter number will be appended.
+		 */
+		I2cDevBackend(const char* sysfsPath = I2CDEV_SYSFS_PATH, const char* devicePath = I2CDEV_DEVICE_PATH);
+
+
+		/**Base-destructor, closes all device files.*/
+		virtual ~I2cDevBackend();
+
+
+		const char* getName(){return "I2cDev";}
+
+
+		/** Adds a I2cDevice for every entry i2c-N of the sysfs.*/
+		void findDevices(list<I2cDevice*> &deviceList);
+
+
+		/**
+		 * Derives the unique id of a adapter, which stays the same as long as the adapter hangs on the same place.
+		 * \param entry Entry i2c-N of the adapter within the sysfs.
+		 * \param used Ids of the adapters found before in this discovery, the new id is added. Two adapters with the same
+		 * parent and name (e.g. channels of a mux) get different ids in the order of their numbers.
+		 * \return I2CDEV_UNIQUE_ID_BASE plus a hash of the place and the name of the adapter.
+		 */
+		unsigned int getUniqueId(const char* entry, set<unsigned int> &used);
+
+
+		/**
+		 * Opens a adapter, the device file will be opened at the first time and kept open.
+		 * Like a Aardvark, a adapter can only be opened once at a time.
+		 * \throws Error If the device file can not be opened or the adapter is already open.
+		 */
+		int open(int port);
+
+
+		/** Does nothing, the power of a bus of the kernel can not be controlled.*/
+		void targetPower(int handle, int powerMask){};
+
+
+		/** \throws Error If the ioctl fails.*/
+		void write(int handle, int slaveAddr, int flags, const unsigned char* data, unsigned int length);
+
+
+		/** \throws Error If the ioctl fails.*/
+		unsigned int read(int handle, int slaveAddr, int flags, unsigned char* data, unsigned int length);
+
+
+		/**
+		 * The bitrate of a kernel bus is configured by the device tree or the driver.
+		 * \throws Error Always.
+		 */
+		int configure(int handle, int bitrate);
+
+
+		/**
+		 * Submits all messages with one I2C_RDWR ioctl.
+		 * \throws Error If the ioctl fails or there are more messages than I2C_RDWR_IOCTL_MAX_MSGS.
+		 */
+		void transfer(int handle, I2cMessage* messages, unsigned int numMessages);
+
+
+		/**
+		 * Submits a kept back message and releases the adapter, the device file stays open.
+		 * \throws Error If the kept back message failed, the adapter is released anyway.
+		 */
+		void close(int handle);
+
+
+	protected:
+
+		/**
+		 * Opens a device file.
+		 * \param path Path of the device file.
+		 * \return File descriptor or -1 with errno set.
+		 */
+		virtual int openAdapter(const char* path);
+
+
+		/**
+		 * Executes the I2C_RDWR ioctl.
+		 * \param fd File descriptor returned by openAdapter().
+		 * \param data Messages of the transaction.
+		 * \return Number of executed messages or -1 with errno set.
+		 */
+		virtual int ioctlRdwr(int fd, struct i2c_rdwr_ioctl_data* data);
+
+
+		/**
+		 * Closes a device file.
+		 * \param fd File descriptor returned by openAdapter().
+		 */
+		virtual void closeAdapter(int fd);
+
+
+	private:
+
+		/**
+		 * \struct Adapter
+		 * State of one opened adapter.
+		 */
+		struct Adapter{
+			/*! File descriptor of the device file.*/
+			int fd;
+			/*! True while the adapter is opened by a client.*/
+			bool opened;
+			/*! Header of a message which was kept back because of AA_I2C_NO_STOP.*/
+			I2cMessage pending;
+			/*! True if pending contains a kept back message.*/
+			bool hasPending;
+			/*! Copy of the data of the kept back message.*/
+			vector<unsigned char> pendingData;
+			/*! Serializes the transactions on the adapter.*/
+			pthread_mutex_t mutex;
+		};
+
+		/*! Directory with a entry i2c-N for every adapter.*/
+		string sysfsPath;
+		/*! Prefix of the device files.*/
+		string devicePath;
+		/*! All adapters which were opened once, mapped by their number.*/
+		map<int, Adapter*> adapters;
+		/*! Protects adapters and the opened flags.*/
+		pthread_mutex_t mutex;
+
+
+		/** \return 28 bit FNV-1a hash of text.*/
+		static unsigned int hash(const string &text);
+
+
+		/**
+		 * \param handle A handle returned by open().
+		 * \return The opened adapter of the handle.
+		 * \throws Error If the handle is not valid.
+		 */
+		Adapter* getAdapter(int handle);
+
+
+		/**
+		 * Executes messages with one ioctl, a kept back message of the adapter will be executed in front of them.
+		 * If the last message has AA_I2C_NO_STOP set, it will be kept back instead and its count stays 0.
+		 * \throws Error If the ioctl fails.
+		 */
+		void submit(Adapter* adapter, I2cMessage* messages, unsigned int numMessages);
+};
+
+#endif /* INCLUDE_I2CDEVBACKEND_HPP_ */
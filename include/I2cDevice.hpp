@@ -6,8 +6,8 @@
  * \class I2cDevice
  * \brief Represents  an I²C device.
  * I2cDevice represents an I²C device regardless what hardware the device has.
- * Currently we just know Totalphase Aardvark as I²C device, adding other hardware devices
- * can result in adding additional variables to this class.
+ * The name of a device is the name of the I2cBackend which has to be used to access it,
+ * the meaning of the port depends on the backend (Aardvark port, number of a simulated bus, ...).
  */
 class I2cDevice{
 
@@ -15,8 +15,8 @@ class I2cDevice{
 
 		/**
 		 * Base-constructor.
-		 * \param name Name of the device hardware.
-		 * \param port Accesspoint to open a AArdvark device.
+		 * \param name Name of the device hardware, which is the name of its I2cBackend.
+		 * \param port Accesspoint to open the device with its I2cBackend.
 		 * \param identification Unique identification of a device, like serial number.
 		 */
 		I2cDevice(const char* name, int port, unsigned int identification)
@@ -47,7 +47,7 @@ class I2cDevice{
 		const char* name;
 		/* Unique identification of a device, like serial number.*/
 		unsigned int identification;
-		/* Accesspoint to open a AArdvark device.*/
+		/* Accesspoint to open the device with its I2cBackend.*/
 		int port;
 
 };
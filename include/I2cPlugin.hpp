@@ -3,6 +3,17 @@
 
 
 #include "PluginInterface.hpp"
+#include "I2cBackend.hpp"
+#include "DeviceLockTable.hpp"
+#include "ReadCoalescer.hpp"
+#include "I2cStats.hpp"
+#include "AsyncLog.hpp"
+#include "Tracer.hpp"
+#include "Recorder.hpp"
+#include "DeviceRegistry.hpp"
+#include "WorkspacePool.hpp"
+#include "DeviceQueue.hpp"
+#include "SessionSweeper.hpp"
 
 /*! Path to unix domain socket for registering to RSD.*/
 #define REG_PATH "/tmp/RsdRegister.uds"
@@ -48,6 +59,32 @@ class I2cPlugin :public PluginInterface{
 		 * \note Because PluginInterfaceB inherits from AcceptThread, this function will run in a separate thread.
 		 */
 		void thread_accept();
+
+
+	private:
+
+		/*! Backends which are shared by all I2c instances, without a backend for Aardvark devices every I2c uses the Aardvark-Plugin.*/
+		list<I2cBackend*> sharedBackends;
+		/*! Locks of the devices, shared by all I2c instances.*/
+		DeviceLockTable locks;
+		/*! Coalescer of identical reads, shared by all I2c instances.*/
+		ReadCoalescer reads;
+		/*! Counters of bus transactions, shared by all I2c instances.*/
+		I2cStats stats;
+		/*! Logger of all I2c instances, if the plugin is build with I2C_ASYNC_LOG, otherwise NULL.*/
+		AsyncLog* asyncLog;
+		/*! Tracer of all I2c instances, enabled by i2c.trace.*/
+		Tracer tracer;
+		/*! Recording of all I2c instances, if the plugin is build with I2C_RECORD, otherwise NULL.*/
+		Recorder* recorder;
+		/*! Devices of sharedBackends, discovered in the background and shared by all I2c instances.*/
+		DeviceRegistry registry;
+		/*! Parsers and DOMs, borrowed by the I2c instances while they process a request.*/
+		WorkspacePool workspaces;
+		/*! Bounded queues of the devices, shared by all I2c instances.*/
+		DeviceQueue queue;
+		/*! Closes the idle sessions of all I2c instances.*/
+		SessionSweeper sweeper;
 };
 
 #endif /* INCLUDE_I2CPLUGIN_HPP_ */
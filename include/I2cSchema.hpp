@@ -0,0 +1,310 @@
+#ifndef INCLUDE_I2CSCHEMA_HPP_
+#define INCLUDE_I2CSCHEMA_HPP_
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "document.h"
+
+using namespace std;
+using namespace rapidjson;
+
+
+/*! Maximum number of bytes of a single write or read.*/
+#ifndef I2C_MAX_TRANSFER_SIZE
+#define I2C_MAX_TRANSFER_SIZE 65535
+#endif
+
+/*! Maximum number of retries of a bus transaction, bigger "retries" params are rejected.*/
+#ifndef I2C_RETRY_MAX_COUNT
+#define I2C_RETRY_MAX_COUNT 10
+#endif
+
+/*! First and last address of i2c.scan, if the request has no "first" or "last" (the addresses which are not reserved).*/
+#ifndef I2C_SCAN_FIRST_ADDR
+#define I2C_SCAN_FIRST_ADDR 0x08
+#endif
+#ifndef I2C_SCAN_LAST_ADDR
+#define I2C_SCAN_LAST_ADDR 0x77
+#endif
+
+/*! Maximum number of devices of a i2c.scan.*/
+#ifndef I2C_SCAN_MAX_DEVICES
+#define I2C_SCAN_MAX_DEVICES 32
+#endif
+
+/*! Maximum number of ops of a i2c.transfer or spi.batch.*/
+#ifndef I2C_MAX_TRANSFER_OPS
+#define I2C_MAX_TRANSFER_OPS 256
+#endif
+
+
+/**
+ * Schema of the rpc functions of I2c. Every list is a X-macro, the entries are expanded by the macro which is given as X.
+ * From these lists the preprocessor generates the method enum, the registration of the member functions, the typed
+ * param structs and their parsers. Adding a method or param only needs a new entry in the corresponding list.
+ *
+ * I2C_METHODS entries: X(enum name, rpc name, member function of I2c)
+ * I2C_*_PARAMS entries: X(struct member, json name, type, required)
+ * Types: INT (int), UINT (unsigned int), BOOL (bool), STRING (const char*, points into the request DOM),
+ * ARRAY (Value*, points into the request DOM) and BYTES (vector<unsigned char>, json array of bytes or base64 string).
+ * After the types, the parser checks the ranges of the values (slave address, mem_addr, sizes, ...), so a malformed
+ * request fails before the first sub-request is send.
+ */
+#define I2C_METHODS(X) \
+	X(I2C_GET_I2C_DEVICES, "i2c.getI2cDevices", getI2cDevices) \
+	X(I2C_GET_AARDVARK_DEVICES, "i2c.getAardvarkDevices", getAardvarkDevices) \
+	X(I2C_WRITE, "i2c.write", write) \
+	X(I2C_READ, "i2c.read", read) \
+	X(I2C_OPEN, "i2c.open", openSession) \
+	X(I2C_TRANSFER, "i2c.transfer", transfer) \
+	X(I2C_CLOSE, "i2c.close", closeSession) \
+	X(I2C_LOCK, "i2c.lock", lock) \
+	X(I2C_UNLOCK, "i2c.unlock", unlock) \
+	X(I2C_GET_STATS, "i2c.getStats", getStats) \
+	X(I2C_SCAN, "i2c.scan", scan) \
+	X(I2C_TRACE, "i2c.trace", trace) \
+	X(I2C_DUMP_TRACE, "i2c.dumpTrace", dumpTrace) \
+	X(SPI_TRANSFER, "spi.transfer", spiTransfer) \
+	X(SPI_BATCH, "spi.batch", spiBatch)
+
+
+#define I2C_WRITE_PARAMS(X) \
+	X(device, "device", UINT, true) \
+	X(slaveAddr, "slave_addr", INT, true) \
+	X(flags, "AardvarkI2cFlags", INT, false) \
+	X(dataOut, "data_out", BYTES, true) \
+	X(bitrate, "bitrate", INT, false) \
+	X(retries, "retries", UINT, false) \
+	X(priority, "priority", STRING, false)
+
+
+#define I2C_READ_PARAMS(X) \
+	X(device, "device", UINT, true) \
+	X(slaveAddr, "slave_addr", INT, true) \
+	X(memAddr, "mem_addr", UINT, true) \
+	X(numBytes, "num_bytes", UINT, true) \
+	X(bitrate, "bitrate", INT, false) \
+	X(encoding, "encoding", STRING, false) \
+	X(maxAge, "max_age", UINT, false) \
+	X(retries, "retries", UINT, false) \
+	X(priority, "priority", STRING, false)
+
+
+#define I2C_OPEN_PARAMS(X) \
+	X(device, "device", UINT, true) \
+	X(bitrate, "bitrate", INT, false)
+
+
+#define I2C_TRANSFER_PARAMS(X) \
+	X(session, "session", UINT, true) \
+	X(ops, "ops", ARRAY, true) \
+	X(encoding, "encoding", STRING, false) \
+	X(retries, "retries", UINT, false)
+
+
+/*! Params of one element of "ops" of i2c.transfer.*/
+#define I2C_TRANSFER_OP_PARAMS(X) \
+	X(op, "op", STRING, true) \
+	X(slaveAddr, "slave_addr", INT, true) \
+	X(flags, "AardvarkI2cFlags", INT, false) \
+	X(dataOut, "data_out", BYTES, false) \
+	X(memAddr, "mem_addr", UINT, false) \
+	X(pageSize, "page_size", UINT, false) \
+	X(numBytes, "num_bytes", UINT, false) \
+	X(stop, "stop", BOOL, false)
+
+
+#define I2C_CLOSE_PARAMS(X) \
+	X(session, "session", UINT, true)
+
+
+#define I2C_LOCK_PARAMS(X) \
+	X(device, "device", UINT, true) \
+	X(lease, "lease", UINT, false)
+
+
+#define I2C_UNLOCK_PARAMS(X) \
+	X(device, "device", UINT, true)
+
+
+#define I2C_TRACE_PARAMS(X) \
+	X(enable, "enable", BOOL, true)
+
+
+/*! Either "device" or "devices" (array of unique ids) is required.*/
+#define I2C_SCAN_PARAMS(X) \
+	X(device, "device", UINT, false) \
+	X(devices, "devices", ARRAY, false) \
+	X(first, "first", INT, false) \
+	X(last, "last", INT, false) \
+	X(mode, "mode", STRING, false) \
+	X(bitrate, "bitrate", INT, false) \
+	X(priority, "priority", STRING, false)
+
+
+/*! "polarity", "phase" and "bitorder" are AardvarkSpiPolarity, AardvarkSpiPhase and AardvarkSpiBitorder, "ss_polarity" is AardvarkSpiSSPolarity.*/
+#define I2C_SPI_TRANSFER_PARAMS(X) \
+	X(device, "device", UINT, true) \
+	X(dataOut, "data_out", BYTES, true) \
+	X(numBytes, "num_bytes", UINT, false) \
+	X(bitrate, "bitrate", INT, false) \
+	X(polarity, "polarity", INT, false) \
+	X(phase, "phase", INT, false) \
+	X(bitorder, "bitorder", INT, false) \
+	X(ssPolarity, "ss_polarity", INT, false) \
+	X(encoding, "encoding", STRING, false) \
+	X(priority, "priority", STRING, false)
+
+
+#define I2C_SPI_BATCH_PARAMS(X) \
+	X(device, "device", UINT, true) \
+	X(ops, "ops", ARRAY, true) \
+	X(bitrate, "bitrate", INT, false) \
+	X(polarity, "polarity", INT, false) \
+	X(phase, "phase", INT, false) \
+	X(bitorder, "bitorder", INT, false) \
+	X(ssPolarity, "ss_polarity", INT, false) \
+	X(encoding, "encoding", STRING, false) \
+	X(priority, "priority", STRING, false)
+
+
+/*! Params of one element of "ops" of spi.batch.*/
+#define I2C_SPI_OP_PARAMS(X) \
+	X(dataOut, "data_out", BYTES, true) \
+	X(numBytes, "num_bytes", UINT, false)
+
+
+
+#define I2C_PARAM_TYPE_INT int
+#define I2C_PARAM_TYPE_UINT unsigned int
+#define I2C_PARAM_TYPE_STRING const char*
+#define I2C_PARAM_TYPE_BYTES vector<unsigned char>
+#define I2C_PARAM_TYPE_BOOL bool
+#define I2C_PARAM_TYPE_ARRAY Value*
+
+#define I2C_METHOD_ENUM(id, name, function) id,
+#define I2C_PARAM_MEMBER(member, name, type, required) I2C_PARAM_TYPE_##type member; bool has_##member;
+
+/*! Generates a struct with a member and a has_ flag for every entry of a param list.*/
+#define I2C_DEFINE_PARAMS_STRUCT(structName, list) \
+	struct structName{ list(I2C_PARAM_MEMBER) };
+
+
+/** Methods of I2c, the value is the index within the method table.*/
+enum I2cMethod{ I2C_METHODS(I2C_METHOD_ENUM) I2C_NUMBER_OF_METHODS };
+
+
+I2C_DEFINE_PARAMS_STRUCT(I2cWriteParams, I2C_WRITE_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cReadParams, I2C_READ_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cOpenParams, I2C_OPEN_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cTransferParams, I2C_TRANSFER_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cTransferOpParams, I2C_TRANSFER_OP_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cCloseParams, I2C_CLOSE_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cLockParams, I2C_LOCK_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cUnlockParams, I2C_UNLOCK_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cScanParams, I2C_SCAN_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cTraceParams, I2C_TRACE_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cSpiTransferParams, I2C_SPI_TRANSFER_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cSpiBatchParams, I2C_SPI_BATCH_PARAMS)
+I2C_DEFINE_PARAMS_STRUCT(I2cSpiOpParams, I2C_SPI_OP_PARAMS)
+
+
+
+/**
+ * \class I2cSchema
+ * \brief Dispatching and param parsing, generated from the schema lists.
+ * Method names and param names are found by a perfect hash (NameIndex), so a request costs one hash and one
+ * compare per name instead of a search through a map.
+ */
+class I2cSchema{
+
+	public:
+
+		/**
+		 * \param method Member "method" of a request.
+		 * \return Method of the request or I2C_NUMBER_OF_METHODS if the method is unknown.
+		 */
+		static I2cMethod findMethod(Value &method);
+
+
+		/** \return Rpc name of a method.*/
+		static const char* getMethodName(I2cMethod method);
+
+
+		/**
+		 * Rpc names of all methods for announcing them to RSD, without creating a I2c instance.
+		 * \return New list with new strings, like RPCInterface::getAllFunctionNames().
+		 */
+		static list<string*>* getMethodNames();
+
+
+		/**
+		 * Validates params and copies them into a typed struct, with one pass over the members of params.
+		 * Unknown members are ignored.
+		 * \param params Member "params" of a request.
+		 * \param result Will contain the params, has_ flags tell which optional params were found.
+		 * \throws Error If params is no object, a required param is missing, a param has the wrong type or is out of range.
+		 */
+		static void parse(Value &params, I2cWriteParams &result);
+
+
+		/** \see parse(Value&, I2cWriteParams&)*/
+		static void parse(Value &params, I2cReadParams &result);
+
+
+		/** \see parse(Value&, I2cWriteParams&)*/
+		static void parse(Value &params, I2cOpenParams &result);
+
+
+		/** \see parse(Value&, I2cWriteParams&)*/
+		static void parse(Value &params, I2cTransferParams &result);
+
+
+		/**
+		 * Parses one element of "ops" of i2c.transfer, "op" has to be "write" with "data_out" or "read" with "num_bytes".
+		 * \see parse(Value&, I2cWriteParams&)
+		 */
+		static void parse(Value &params, I2cTransferOpParams &result);
+
+
+		/** \see parse(Value&, I2cWriteParams&)*/
+		static void parse(Value &params, I2cCloseParams &result);
+
+
+		/** \see parse(Value&, I2cWriteParams&)*/
+		static void parse(Value &params, I2cLockParams &result);
+
+
+		/** \see parse(Value&, I2cWriteParams&)*/
+		static void parse(Value &params, I2cUnlockParams &result);
+
+
+		/** \see parse(Value&, I2cWriteParams&)*/
+		static void parse(Value &params, I2cScanParams &result);
+
+
+		/** \see parse(Value&, I2cWriteParams&)*/
+		static void parse(Value &params, I2cTraceParams &result);
+
+
+		/** \see parse(Value&, I2cWriteParams&)*/
+		static void parse(Value &params, I2cSpiTransferParams &result);
+
+
+		/**
+		 * Parses the params of spi.batch, the elements of "ops" have to be parsed one by one with parse(Value&, I2cSpiOpParams&).
+		 * \see parse(Value&, I2cWriteParams&)
+		 */
+		static void parse(Value &params, I2cSpiBatchParams &result);
+
+
+		/**
+		 * Parses one element of "ops" of spi.batch.
+		 * \see parse(Value&, I2cWriteParams&)
+		 */
+		static void parse(Value &params, I2cSpiOpParams &result);
+};
+
+#endif /* INCLUDE_I2CSCHEMA_HPP_ */
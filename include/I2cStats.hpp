@@ -0,0 +1,86 @@
+#ifndef INCLUDE_I2CSTATS_HPP_
+#define INCLUDE_I2CSTATS_HPP_
+
+#include <pthread.h>
+
+#include "I2cBackend.hpp"
+
+
+/**
+ * \class I2cStats
+ * \brief Plugin-wide counters of bus transactions and their retries, shared by all I2c instances.
+ */
+class I2cStats{
+
+	public:
+
+		/**
+		 * \struct Counters
+		 * Copy of all counters at one point in time.
+		 */
+		struct Counters{
+			/*! Executed bus transactions, every retry is a transaction.*/
+			unsigned long long transactions;
+			/*! Transactions which were repeated after a bus error.*/
+			unsigned long long retries;
+			/*! Transactions which succeeded after at least one retry.*/
+			unsigned long long recovered;
+			/*! Transactions which still failed after all retries.*/
+			unsigned long long exhausted;
+			/*! Failed transactions for every AardvarkI2cStatus, retried or not.*/
+			unsigned long long busErrors[I2C_NUMBER_OF_BUS_STATUS];
+			/*! Open connections (I2c instances).*/
+			unsigned long long connections;
+		};
+
+
+		/**Base-constructor.*/
+		I2cStats();
+
+
+		/**Base-destructor.*/
+		~I2cStats();
+
+
+		/** Counts a bus transaction.*/
+		void countTransaction();
+
+
+		/**
+		 * Counts a failed bus transaction.
+		 * \param status AardvarkI2cStatus of the failure.
+		 * \param retried True if the transaction will be repeated.
+		 */
+		void countBusError(int status, bool retried);
+
+
+		/** Counts a transaction which succeeded after a retry.*/
+		void countRecovered();
+
+
+		/** Counts a transaction which failed after all retries.*/
+		void countExhausted();
+
+
+		/** \param opened True for a new connection, false for a closed one.*/
+		void countConnection(bool opened);
+
+
+		/**
+		 * \param counters Will contain the current counters.
+		 */
+		void get(Counters &counters);
+
+
+		/** \return Name of a AardvarkI2cStatus without the prefix AA_I2C_STATUS_, like "SLA_NACK".*/
+		static const char* getStatusName(int status);
+
+
+	private:
+		/*! All counters.*/
+		Counters counters;
+		/*! Protects counters.*/
+		pthread_mutex_t mutex;
+};
+
+#endif /* INCLUDE_I2CSTATS_HPP_ */
@@ -0,0 +1,175 @@
+#ifndef INCLUDE_MSGPACK_HPP_
+#define INCLUDE_MSGPACK_HPP_
+
+#include <vector>
+#include <string>
+
+using namespace std;
+
+
+/**
+ * \class MsgPackWriter
+ * \brief Encodes values into the binary format MessagePack.
+ * Only the types which are needed for sub-requests are supported: nil, integers, byte arrays (bin), strings, arrays and maps.
+ * The encoded bytes are appended to an internal buffer.
+ */
+class MsgPackWriter{
+
+	public:
+
+		/**Base-constructor.*/
+		MsgPackWriter(){};
+
+
+		/**Base-destructor.*/
+		~MsgPackWriter(){};
+
+
+		/** Clears the buffer, so the writer can be reused.*/
+		void clear(){buffer.clear();}
+
+
+		/** Encodes nil, the placeholder for a missing value.*/
+		void writeNil(){buffer.push_back(0xc0);}
+
+
+		/** \param size Number of following elements of the array.*/
+		void writeArray(unsigned int size);
+
+
+		/** \param size Number of following key/value pairs of the map.*/
+		void writeMap(unsigned int size);
+
+
+		/** \param value Integer which will be encoded with the smallest possible format.*/
+		void writeInt(long long value);
+
+
+		/**
+		 * \param data Bytes of the byte array.
+		 * \param length Number of bytes.
+		 */
+		void writeBin(const unsigned char* data, unsigned int length);
+
+
+		/** \param value Zero terminated string.*/
+		void writeString(const char* value);
+
+
+		/** \return All encoded bytes.*/
+		const vector<unsigned char> &getBuffer(){return this->buffer;}
+
+
+	private:
+		/*! All encoded bytes.*/
+		vector<unsigned char> buffer;
+
+
+		/** Appends a number in big endian byte order.*/
+		void writeBigEndian(unsigned long long value, unsigned int bytes);
+};
+
+
+
+/**
+ * \class MsgPackReader
+ * \brief Finds members of a MessagePack map, like the result of a sub-response.
+ * The reader does not copy anything, byte arrays point into the decoded buffer.
+ */
+class MsgPackReader{
+
+	public:
+
+		/**
+		 * Base-constructor.
+		 * \param data Encoded bytes, has to contain a map as first value.
+		 * \param length Number of encoded bytes.
+		 */
+		MsgPackReader(const unsigned char* data, unsigned int length);
+
+
+		/**Base-destructor.*/
+		~MsgPackReader(){};
+
+
+		/**
+		 * Searches the map for an integer member.
+		 * \param key Name of the member.
+		 * \param value Will be set to the value of the member.
+		 * \return True if the member was found.
+		 * \throws Error If the encoded bytes are invalid.
+		 */
+		bool findInt(const char* key, long long &value);
+
+
+		/**
+		 * Searches the map for a byte array member.
+		 * \param key Name of the member.
+		 * \param data Will point to the bytes of the member.
+		 * \param length Will be set to the number of bytes.
+		 * \return True if the member was found.
+		 * \throws Error If the encoded bytes are invalid.
+		 */
+		bool findBin(const char* key, const unsigned char* &data, unsigned int &length);
+
+
+	private:
+		/*! Encoded bytes.*/
+		const unsigned char* data;
+		/*! Number of encoded bytes.*/
+		unsigned int length;
+		/*! Current read position.*/
+		unsigned int position;
+
+
+		/**
+		 * Positions the reader at the value of a member of the map.
+		 * \return True if the member was found.
+		 */
+		bool findKey(const char* key);
+
+
+		/** Skips the value at the current position.*/
+		void skip();
+
+
+		/** Reads a number in big endian byte order.*/
+		unsigned long long readBigEndian(unsigned int bytes);
+
+
+		/** Reads the length of a str, bin, array or map, depending on its header byte.*/
+		unsigned int readLength(unsigned char header, unsigned char fixMask, unsigned char fixBase, unsigned char base);
+
+
+		/** \throws Error If less than bytes bytes are left.*/
+		void need(unsigned int bytes);
+};
+
+
+
+/**
+ * \class Base64
+ * \brief Encodes bytes to base64 text and decodes them, for binary data within json strings.
+ */
+class Base64{
+
+	public:
+
+		/**
+		 * \param data Bytes to encode.
+		 * \param length Number of bytes.
+		 * \param text The base64 text will be appended.
+		 */
+		static void encode(const unsigned char* data, unsigned int length, string &text);
+
+
+		/**
+		 * \param text Base64 text.
+		 * \param length Number of characters.
+		 * \param data The decoded bytes will be appended.
+		 * \throws Error If the text contains invalid characters.
+		 */
+		static void decode(const char* text, unsigned int length, vector<unsigned char> &data);
+};
+
+#endif /* INCLUDE_MSGPACK_HPP_ */
@@ -0,0 +1,57 @@
+#ifndef INCLUDE_NAMEINDEX_HPP_
+#define INCLUDE_NAMEINDEX_HPP_
+
+#include <vector>
+
+using namespace std;
+
+
+/**
+ * \class NameIndex
+ * \brief Perfect hash table for a fixed set of names, like the methods or params of a rpc schema.
+ * The constructor searches a seed for which every name gets its own slot, so find() only needs one hash
+ * and one compare to verify the candidate. The names are not copied, they have to live as long as the index
+ * (string literals of a schema).
+ */
+class NameIndex{
+
+	public:
+
+		/**
+		 * Base-constructor, builds the hash table.
+		 * \param names Array of different names.
+		 * \param count Number of names.
+		 */
+		NameIndex(const char* const* names, unsigned int count);
+
+
+		/**Base-destructor.*/
+		~NameIndex(){};
+
+
+		/**
+		 * \param name Name to search, does not need to be zero terminated.
+		 * \param length Number of characters of name.
+		 * \return Index of the name within the array of the constructor or -1 if it is unknown.
+		 */
+		int find(const char* name, unsigned int length) const;
+
+
+	private:
+		/*! Names of the constructor.*/
+		const char* const* names;
+		/*! Lengths of the names.*/
+		vector<unsigned int> lengths;
+		/*! Index of the name of every slot or -1 for a empty slot.*/
+		vector<int> slots;
+		/*! Number of slots - 1, the number of slots is a power of 2.*/
+		unsigned int mask;
+		/*! Seed of the hash function, which maps every name to its own slot.*/
+		unsigned int seed;
+
+
+		/** FNV-1a hash of name, started with seed.*/
+		static unsigned int hash(const char* name, unsigned int length, unsigned int seed);
+};
+
+#endif /* INCLUDE_NAMEINDEX_HPP_ */
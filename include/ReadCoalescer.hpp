@@ -0,0 +1,154 @@
+#ifndef INCLUDE_READCOALESCER_HPP_
+#define INCLUDE_READCOALESCER_HPP_
+
+#include <pthread.h>
+#include <map>
+#include <vector>
+
+#include "JsonRPC.hpp"
+
+using namespace std;
+
+/*! Maximum age in milliseconds of a cached read result, bigger "max_age" params are rejected.*/
+#ifndef I2C_READ_CACHE_MAX_AGE
+#define I2C_READ_CACHE_MAX_AGE 5000
+#endif
+
+
+/**
+ * \struct ReadKey
+ * Identifies reads which return the same bytes: same device, slave, register, length and requested bitrate.
+ */
+struct ReadKey{
+	/*! Unique id of the device.*/
+	unsigned int device;
+	/*! I²C address of the slave.*/
+	int slaveAddr;
+	/*! Register address which is written before reading.*/
+	unsigned int memAddr;
+	/*! Number of bytes to read.*/
+	unsigned int length;
+	/*! Bitrate in kHz which the read configures, 0 if it uses the current bitrate of the device.*/
+	int bitrate;
+
+	bool operator<(const ReadKey &other) const
+	{
+		if(device != other.device)
+			return device < other.device;
+		if(slaveAddr != other.slaveAddr)
+			return slaveAddr < other.slaveAddr;
+		if(memAddr != other.memAddr)
+			return memAddr < other.memAddr;
+		if(length != other.length)
+			return length < other.length;
+		return bitrate < other.bitrate;
+	}
+};
+
+
+/**
+ * \class ReadCoalescer
+ * \brief Plugin-wide single-flight for identical reads of different clients.
+ * The first client which reads a ReadKey becomes the leader of a flight and executes the bus transaction. Clients which
+ * read the same key while the flight is in progress wait for it and get the same bytes (or the same Error).
+ * A successful flight stays in the table as cached result, a client can accept it with a maximum age, which should only
+ * be used for registers where reading has no side effect. Writes to a slave invalidate all flights and results of the slave.
+ *
+ * Usage: join(), then the leader calls complete() or fail() and all other participants call wait().
+ */
+class ReadCoalescer{
+
+	public:
+
+		/**
+		 * \struct Flight
+		 * One bus transaction and its result.
+		 */
+		struct Flight{
+			/*! True if the result or error is available.*/
+			bool done;
+			/*! Read bytes of a successful flight.*/
+			vector<unsigned char> data;
+			/*! Error of a failed flight or NULL.*/
+			Error* error;
+			/*! Time of completion in ms of CLOCK_MONOTONIC.*/
+			unsigned long long doneTime;
+			/*! Number of participants + 1 while the flight is within the table.*/
+			unsigned int references;
+		};
+
+
+		/**Base-constructor.*/
+		ReadCoalescer();
+
+
+		/**Base-destructor, deletes all flights.*/
+		~ReadCoalescer();
+
+
+		/**
+		 * Joins a flight for key or starts a new one.
+		 * \param key The read.
+		 * \param maxAge Age in ms of a cached result which is accepted, 0 for only joining a flight in progress.
+		 * \param leader Will be true if the caller has to execute the read and call complete() or fail().
+		 * \return The flight.
+		 */
+		Flight* join(const ReadKey &key, unsigned int maxAge, bool &leader);
+
+
+		/**
+		 * Publishes the read bytes of a flight and leaves it, called by the leader.
+		 * \param flight Flight returned by join().
+		 * \param data The read bytes.
+		 * \param count Number of read bytes.
+		 */
+		void complete(Flight* flight, const unsigned char* data, unsigned int count);
+
+
+		/**
+		 * Publishes the error of a flight and leaves it, called by the leader.
+		 * \param flight Flight returned by join().
+		 * \param error The error of the read.
+		 */
+		void fail(Flight* flight, Error &error);
+
+
+		/**
+		 * Waits for the result of a flight and leaves it, called by all participants except the leader.
+		 * \param flight Flight returned by join().
+		 * \param data Will contain the read bytes.
+		 * \throws Error A copy of the error of the leader.
+		 */
+		void wait(Flight* flight, vector<unsigned char> &data);
+
+
+		/**
+		 * Removes all flights and results of a slave, a new read will start a new flight.
+		 * \param device Unique id of the device.
+		 * \param slaveAddr I²C address of the slave.
+		 */
+		void invalidate(unsigned int device, int slaveAddr);
+
+
+	private:
+		/*! Flights in progress and cached results.*/
+		map<ReadKey, Flight*> flights;
+		/*! Protects flights and all members of the flights.*/
+		pthread_mutex_t mutex;
+		/*! Signaled when a flight is done.*/
+		pthread_cond_t done;
+
+
+		/** Decrements the references of a flight and deletes it, if it was the last one.*/
+		void release(Flight* flight);
+
+
+		/** Removes cached results which are older than I2C_READ_CACHE_MAX_AGE.*/
+		void removeExpired(unsigned long long now);
+
+
+		/** \return Milliseconds of CLOCK_MONOTONIC.*/
+		static unsigned long long now();
+};
+
+#endif /* INCLUDE_READCOALESCER_HPP_ */
@@ -0,0 +1,112 @@
+#ifndef INCLUDE_RECORDER_HPP_
+#define INCLUDE_RECORDER_HPP_
+
+#include <cstddef>
+
+/*! File of the recording, if the plugin is build with I2C_RECORD.*/
+#ifndef I2C_RECORD_FILE
+#define I2C_RECORD_FILE "/tmp/i2c-record.bin"
+#endif
+
+/*! Maximum size of the recording in bytes, the file is mapped with this size and recording stops if it is full.*/
+#ifndef I2C_RECORD_FILE_SIZE
+#define I2C_RECORD_FILE_SIZE (64 * 1024 * 1024)
+#endif
+
+/*! First bytes of a recording.*/
+#define I2C_RECORD_MAGIC "I2CREC01"
+/*! Size of the file header (the magic).*/
+#define I2C_RECORD_HEADER_SIZE 8
+/*! Size of the header of a record: length (4), type (1), 3 bytes padding, connection (4), 4 bytes padding, time (8).*/
+#define I2C_RECORD_ENTRY_HEADER_SIZE 24
+
+
+/** Types of records.*/
+enum RecordType{
+	RECORD_MAIN_REQUEST = 1,
+	RECORD_MAIN_RESPONSE = 2,
+	RECORD_SUB_REQUEST = 3,
+	RECORD_SUB_RESPONSE = 4
+};
+
+
+/**
+ * \struct RecordHeader
+ * Header of every record, followed by length bytes of the message (json text, not terminated).
+ * All numbers are in the byte order of the recording host, a record starts at a multiple of 8.
+ */
+struct RecordHeader{
+	/*! Number of bytes of the message, 0 marks the end of the recording.*/
+	unsigned int length;
+	/*! RecordType.*/
+	unsigned char type;
+	/*! Padding.*/
+	unsigned char reserved[3];
+	/*! Connection (I2c instance) of the message.*/
+	unsigned int connection;
+	/*! Padding.*/
+	unsigned int reserved2;
+	/*! Microseconds of CLOCK_MONOTONIC.*/
+	unsigned long long time;
+};
+
+
+/**
+ * \class Recorder
+ * \brief Plugin-wide, append-only recording of all main-requests, main-responses, sub-requests and sub-responses.
+ * The file is memory-mapped with I2C_RECORD_FILE_SIZE bytes. A record is appended by reserving its space with an atomic
+ * add and copying it into the mapping, so threads of different connections never wait for each other. The length of
+ * a record is stored last, a reader stops at the first length 0. tools/I2cReplay replays a recording.
+ */
+class Recorder{
+
+	public:
+
+		/**
+		 * Base-constructor, creates (or truncates) the file and maps it.
+		 * \param path Path of the recording.
+		 * \throws Error If the file can not be created or mapped.
+		 */
+		Recorder(const char* path);
+
+
+		/**Base-destructor, unmaps the file and truncates it to the recorded size.*/
+		~Recorder();
+
+
+		/** \return A new number for a connection.*/
+		unsigned int nextConnection();
+
+
+		/**
+		 * Appends a record, the message is dropped if the file is full.
+		 * \param type RecordType of the message.
+		 * \param connection Number of the connection, see nextConnection().
+		 * \param message The message.
+		 * \param length Number of bytes of message.
+		 */
+		void record(RecordType type, unsigned int connection, const char* message, unsigned int length);
+
+
+		/** \return Number of dropped records, because the file was full.*/
+		unsigned long long getDropped();
+
+
+	private:
+		/*! File descriptor of the recording.*/
+		int fd;
+		/*! Mapping of the file.*/
+		char* mapping;
+		/*! Offset of the next record.*/
+		size_t end;
+		/*! Number of the next connection.*/
+		unsigned int connections;
+		/*! Number of dropped records.*/
+		unsigned long long dropped;
+
+
+		/** \return Microseconds of CLOCK_MONOTONIC.*/
+		static unsigned long long now();
+};
+
+#endif /* INCLUDE_RECORDER_HPP_ */
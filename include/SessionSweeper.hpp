@@ -0,0 +1,76 @@
+#ifndef INCLUDE_SESSIONSWEEPER_HPP_
+#define INCLUDE_SESSIONSWEEPER_HPP_
+
+#include <pthread.h>
+#include <list>
+
+using namespace std;
+
+/*! Milliseconds between two sweeps of the idle sessions of all connections.*/
+#ifndef I2C_SESSION_SWEEP_INTERVAL
+#define I2C_SESSION_SWEEP_INTERVAL 1000
+#endif
+
+
+class I2c;
+
+
+/**
+ * \class SessionSweeper
+ * \brief Plugin-wide background thread, which closes the idle sessions of connections which send no requests.
+ * A I2c instance only closes its idle sessions when it processes a request, so a client which opens a session and
+ * goes quiet would keep the device, its lock table entry and its queue slot forever. The thread calls
+ * I2c::sweepIdleSessions() of every added I2c instance every I2C_SESSION_SWEEP_INTERVAL.
+ */
+class SessionSweeper{
+
+	public:
+
+		/**Base-constructor.*/
+		SessionSweeper();
+
+
+		/**Base-destructor, stops the background thread.*/
+		~SessionSweeper();
+
+
+		/**
+		 * Starts the background thread.
+		 * \throws Error If the thread can not be created.
+		 */
+		void start();
+
+
+		/** Stops the background thread, afterwards the backends can be deleted.*/
+		void stop();
+
+
+		/** \param i2c I2c instance whose sessions will be swept.*/
+		void add(I2c* i2c);
+
+
+		/**
+		 * Removes a I2c instance, waits for a running sweep of it.
+		 * \param i2c The I2c instance.
+		 */
+		void remove(I2c* i2c);
+
+
+	private:
+		/*! All I2c instances whose sessions are swept.*/
+		list<I2c*> instances;
+		/*! Protects instances, held during a sweep.*/
+		pthread_mutex_t mutex;
+		/*! Background thread.*/
+		pthread_t thread;
+		/*! True if the background thread was started.*/
+		bool running;
+		/*! Pipe for stopping the background thread.*/
+		int stopPipe[2];
+
+
+		/** Sweeps the sessions, till the pipe is written.*/
+		static void* sweepThread(void* arg);
+};
+
+#endif /* INCLUDE_SESSIONSWEEPER_HPP_ */
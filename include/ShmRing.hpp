@@ -0,0 +1,72 @@
+#ifndef INCLUDE_SHMRING_HPP_
+#define INCLUDE_SHMRING_HPP_
+
+#include <cstddef>
+
+/*! Size of the shared memory ring of a connection in bytes.*/
+#ifndef SHM_RING_SIZE
+#define SHM_RING_SIZE (1024 * 1024)
+#endif
+
+
+/**
+ * \class ShmRing
+ * \brief Ring of shared memory for exchanging payload bytes with another plugin.
+ * The memory is a memfd, another process of the same user can map it through /proc/<pid>/fd/<fd>.
+ * Instead of serializing the payload into a json rpc message, the payload is written once into the ring
+ * and the message only carries its position (offset and length). Because a I2c instance only has one sub-request
+ * at a time, a payload is not needed anymore when the next one is reserved, so the ring has no free operation.
+ */
+class ShmRing{
+
+	public:
+
+		/**
+		 * Base-constructor, creates and maps the memfd.
+		 * \param size Size of the ring in bytes.
+		 * \throws Error If the memfd can not be created or mapped.
+		 */
+		ShmRing(size_t size);
+
+
+		/**Base-destructor, unmaps and closes the memfd.*/
+		~ShmRing();
+
+
+		/** \return File descriptor of the memfd.*/
+		int getFd(){return this->fd;}
+
+
+		/** \return Size of the ring in bytes.*/
+		size_t getSize(){return this->size;}
+
+
+		/**
+		 * Reserves a contiguous area of the ring. If there is not enough space till the end of the ring,
+		 * the area will start at the beginning of the ring.
+		 * \param length Number of bytes to reserve.
+		 * \return Offset of the area within the ring.
+		 * \throws Error If length is bigger than the ring.
+		 */
+		size_t reserve(size_t length);
+
+
+		/**
+		 * \param offset Offset returned by reserve().
+		 * \return Pointer to the area within the mapped memory.
+		 */
+		unsigned char* at(size_t offset){return this->memory + offset;}
+
+
+	private:
+		/*! File descriptor of the memfd.*/
+		int fd;
+		/*! Mapped memory of the memfd.*/
+		unsigned char* memory;
+		/*! Size of the ring in bytes.*/
+		size_t size;
+		/*! Offset of the next free byte.*/
+		size_t head;
+};
+
+#endif /* INCLUDE_SHMRING_HPP_ */
@@ -0,0 +1,233 @@
+#ifndef INCLUDE_SIMDEVICE_HPP_
+#define INCLUDE_SIMDEVICE_HPP_
+
+#include <vector>
+
+using namespace std;
+
+
+/**
+ * \class SimDevice
+ * \brief Model of a I²C slave device on a SimulatedBus.
+ * The bus calls start() for every start or repeated start addressed to the device, followed by
+ * writeByte() or readByte() for every transferred byte and stop() for the stop condition.
+ * All functions get the current time of the bus in nanoseconds, so a model can simulate timing
+ * like the write cycle of an EEPROM without depending on the real time.
+ */
+class SimDevice{
+
+	public:
+
+		/**
+		 * Base-constructor.
+		 * \param address 7 bit I²C address of the device.
+		 */
+		SimDevice(int address){this->address = address;};
+
+
+		/**Base-destructor.*/
+		virtual ~SimDevice(){};
+
+
+		/** \return 7 bit I²C address of the device.*/
+		int getAddress(){return this->address;}
+
+
+		/**
+		 * Start or repeated start addressed to this device.
+		 * \param read True if the master wants to read.
+		 * \param now Current time of the bus in nanoseconds.
+		 * \return True for ACK, false for NACK.
+		 */
+		virtual bool start(bool read, unsigned long long now){return true;}
+
+
+		/**
+		 * \param byte Byte written by the master.
+		 * \param now Current time of the bus in nanoseconds.
+		 * \return True for ACK, false for NACK.
+		 */
+		virtual bool writeByte(unsigned char byte, unsigned long long now) = 0;
+
+
+		/**
+		 * \param now Current time of the bus in nanoseconds.
+		 * \return Byte read by the master.
+		 */
+		virtual unsigned char readByte(unsigned long long now) = 0;
+
+
+		/**
+		 * Stop condition after the device was addressed.
+		 * \param now Current time of the bus in nanoseconds.
+		 */
+		virtual void stop(unsigned long long now){};
+
+
+	private:
+		/*! 7 bit I²C address of the device.*/
+		int address;
+};
+
+
+
+/**
+ * \class SimEeprom
+ * \brief Model of a serial EEPROM like 24C02 or 24C256.
+ * The first one or two written bytes set the address pointer, all further bytes are written to the page buffer.
+ * Like the real device, the address pointer wraps around within the page while writing and within the whole memory while reading.
+ * After a stop the EEPROM starts its write cycle and will not acknowledge its address till the write cycle is over.
+ */
+class SimEeprom : public SimDevice{
+
+	public:
+
+		/**
+		 * Base-constructor, the memory is initialized with 0xFF.
+		 * \param address 7 bit I²C address of the device.
+		 * \param size Size of the memory in bytes.
+		 * \param pageSize Size of a page in bytes.
+		 * \param addressBytes Number of bytes for the address pointer (1 or 2).
+		 * \param writeCycleTime Duration of the write cycle in nanoseconds.
+		 */
+		SimEeprom(int address, unsigned int size, unsigned int pageSize, unsigned int addressBytes, unsigned long long writeCycleTime);
+
+
+		/**Base-destructor.*/
+		~SimEeprom(){};
+
+
+		/** \return False (NACK) while the write cycle is running.*/
+		bool start(bool read, unsigned long long now);
+
+
+		bool writeByte(unsigned char byte, unsigned long long now);
+
+
+		unsigned char readByte(unsigned long long now);
+
+
+		/** Starts the write cycle if bytes were written to the page buffer.*/
+		void stop(unsigned long long now);
+
+
+	private:
+		/*! Content of the EEPROM.*/
+		vector<unsigned char> memory;
+		/*! Size of a page in bytes.*/
+		unsigned int pageSize;
+		/*! Number of bytes for the address pointer.*/
+		unsigned int addressBytes;
+		/*! Duration of the write cycle in nanoseconds.*/
+		unsigned long long writeCycleTime;
+		/*! Time till the current write cycle is running.*/
+		unsigned long long busyUntil;
+		/*! Current address pointer.*/
+		unsigned int pointer;
+		/*! Number of bytes written since the last start.*/
+		unsigned int bytesWritten;
+};
+
+
+
+/**
+ * \class SimRegisterFile
+ * \brief Model of a device with up to 256 8 bit registers, like a port expander or a sensor.
+ * The first written byte sets the register pointer, every further read or written byte increments it.
+ * Registers can be marked as read-only, writes to them will be acknowledged but ignored.
+ */
+class SimRegisterFile : public SimDevice{
+
+	public:
+
+		/**
+		 * Base-constructor, all registers are initialized with 0.
+		 * \param address 7 bit I²C address of the device.
+		 * \param numRegisters Number of registers (max. 256).
+		 */
+		SimRegisterFile(int address, unsigned int numRegisters);
+
+
+		/**Base-destructor.*/
+		virtual ~SimRegisterFile(){};
+
+
+		bool start(bool read, unsigned long long now);
+
+
+		bool writeByte(unsigned char byte, unsigned long long now);
+
+
+		unsigned char readByte(unsigned long long now);
+
+
+		/**
+		 * Sets the value of a register, independent of its read-only flag.
+		 * \param reg Number of the register.
+		 * \param value New value of the register.
+		 */
+		void setRegister(unsigned int reg, unsigned char value);
+
+
+		/**
+		 * \param reg Number of the register.
+		 * \param readOnly True if writes of the master should be ignored.
+		 */
+		void setReadOnly(unsigned int reg, bool readOnly);
+
+
+	protected:
+
+		/**
+		 * Called for every register read by the master, can be overwritten to simulate changing values.
+		 * \param reg Number of the register.
+		 * \param now Current time of the bus in nanoseconds.
+		 * \return Value of the register.
+		 */
+		virtual unsigned char readRegister(unsigned int reg, unsigned long long now){return registers[reg];}
+
+
+		/*! Values of all registers.*/
+		vector<unsigned char> registers;
+
+
+	private:
+		/*! Read-only flag of all registers.*/
+		vector<bool> readOnly;
+		/*! Current register pointer.*/
+		unsigned int pointer;
+		/*! True if the next written byte is the register pointer.*/
+		bool pointerExpected;
+};
+
+
+
+/**
+ * \class SimTemperatureSensor
+ * \brief Model of a LM75 like temperature sensor.
+ * Register 0 and 1 contain the temperature as 9 bit two's complement value (0.5 °C per bit, MSB first), register 2
+ * is the configuration register. The temperature changes deterministically as triangle wave between 20 °C and 40 °C with
+ * the time of the bus, so every run of a simulation reads the same values.
+ */
+class SimTemperatureSensor : public SimRegisterFile{
+
+	public:
+
+		/**
+		 * Base-constructor.
+		 * \param address 7 bit I²C address of the device.
+		 */
+		SimTemperatureSensor(int address);
+
+
+		/**Base-destructor.*/
+		~SimTemperatureSensor(){};
+
+
+	protected:
+
+		/** Calculates the temperature registers from the time of the bus.*/
+		unsigned char readRegister(unsigned int reg, unsigned long long now);
+};
+
+#endif /* INCLUDE_SIMDEVICE_HPP_ */
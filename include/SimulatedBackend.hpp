@@ -0,0 +1,210 @@
+#ifndef INCLUDE_SIMULATEDBACKEND_HPP_
+#define INCLUDE_SIMULATEDBACKEND_HPP_
+
+#include <pthread.h>
+#include <list>
+#include <vector>
+
+#include "I2cBackend.hpp"
+#include "SimDevice.hpp"
+
+/*! Number of simulated buses, if I2c-Plugin is build with I2C_SIMULATION.*/
+#ifndef SIM_NUM_BUSES
+#define SIM_NUM_BUSES 2
+#endif
+/*! If 1 every transaction takes as long as on a real bus, otherwise only the time of the bus will advance.*/
+#ifndef SIM_REALTIME
+#define SIM_REALTIME 0
+#endif
+/*! Unique id of the first simulated bus, the following buses get the next ids.*/
+#define SIM_UNIQUE_ID_BASE 4000000000U
+/*! Bitrate of a simulated bus in kilohertz after opening it.*/
+#define SIM_DEFAULT_BITRATE 100
+
+
+/**
+ * \class SimulatedBus
+ * \brief Deterministic simulation of one I²C bus with SimDevice models.
+ * The bus has its own time, which advances by the duration of every transferred bit at the configured bitrate.
+ * Because the simulation does not depend on the real time, every run with the same requests gives the same results.
+ */
+class SimulatedBus{
+
+	public:
+
+		/**Base-constructor.*/
+		SimulatedBus();
+
+
+		/**Base-destructor, deletes all devices of the bus.*/
+		~SimulatedBus();
+
+
+		/**
+		 * Adds a device model to the bus, the bus will delete it.
+		 * \param device The device model.
+		 */
+		void addDevice(SimDevice* device);
+
+
+		/** \param bitrate Bitrate in kilohertz.*/
+		void setBitrate(int bitrate){this->bitrate = bitrate;}
+
+
+		/** \return Bitrate in kilohertz.*/
+		int getBitrate(){return this->bitrate;}
+
+
+		/** \return Current time of the bus in nanoseconds.*/
+		unsigned long long getTime(){return this->now;}
+
+
+		/**
+		 * Writes a stream of bytes to a slave.
+		 * \param slaveAddr 7 bit I²C address of the slave.
+		 * \param data Bytes to write.
+		 * \param length Number of bytes.
+		 * \param stop True if the message ends with a stop, false for a following repeated start.
+		 * \throws Error If the slave does not acknowledge its address or a byte.
+		 */
+		void write(int slaveAddr, const unsigned char* data, unsigned int length, bool stop);
+
+
+		/**
+		 * Reads a stream of bytes from a slave.
+		 * \param slaveAddr 7 bit I²C address of the slave.
+		 * \param data Buffer for the read bytes.
+		 * \param length Number of bytes to read.
+		 * \param stop True if the message ends with a stop, false for a following repeated start.
+		 * \throws Error If the slave does not acknowledge its address.
+		 */
+		void read(int slaveAddr, unsigned char* data, unsigned int length, bool stop);
+
+
+		/** Locks the bus for one transaction.*/
+		void lock(){pthread_mutex_lock(&mutex);}
+
+
+		/** Unlocks the bus after a transaction.*/
+		void unlock(){pthread_mutex_unlock(&mutex);}
+
+
+	private:
+		/*! All device models of the bus.*/
+		list<SimDevice*> devices;
+		/*! Bitrate in kilohertz.*/
+		int bitrate;
+		/*! Time of the bus in nanoseconds.*/
+		unsigned long long now;
+		/*! Serializes transactions on the bus.*/
+		pthread_mutex_t mutex;
+
+
+		/**
+		 * Generates a start condition and the address byte.
+		 * \return The addressed device.
+		 * \throws Error If no device acknowledges the address.
+		 */
+		SimDevice* start(int slaveAddr, bool read);
+
+
+		/** Advances the time of the bus by the duration of a number of bits.*/
+		void clock(unsigned int bits);
+};
+
+
+
+/**
+ * \class SimulatedBackend
+ * \brief I2cBackend for simulated I²C buses, which makes it possible to use I2c-Plugin without any hardware.
+ * Every bus is shown as device "Simulated" with port = number of the bus and is populated with the following models:
+ * 	- 0x50: 24C256 EEPROM (32 KiB, 64 byte pages, 2 address bytes, 5 ms write cycle)
+ * 	- 0x51: 24C02 EEPROM (256 byte, 8 byte pages, 1 address byte, 5 ms write cycle)
+ * 	- 0x48: LM75 like temperature sensor
+ * 	- 0x20: register file with 256 registers
+ * The backend is shared by all I2c instances. Transactions on different buses run in parallel.
+ */
+class SimulatedBackend : public I2cBackend{
+
+	public:
+
+		/**
+		 * Base-constructor.
+		 * \param numBuses Number of simulated buses.
+		 * \param realTime If true, every transaction will take as long as on a real bus.
+		 */
+		SimulatedBackend(int numBuses, bool realTime);
+
+
+		/**Base-destructor, deletes all buses.*/
+		~SimulatedBackend();
+
+
+		const char* getName(){return "Simulated";}
+
+
+		/** Adds a I2cDevice for every simulated bus.*/
+		void findDevices(list<I2cDevice*> &deviceList);
+
+
+		/**
+		 * Opens a bus, like a real adapter a bus can only be opened once at a time.
+		 * \throws Error If the bus does not exist or is already open.
+		 */
+		int open(int port);
+
+
+		/** Does nothing, simulated devices are always powered.*/
+		void targetPower(int handle, int powerMask){};
+
+
+		/** \throws Error If the slave does not acknowledge.*/
+		void write(int handle, int slaveAddr, int flags, const unsigned char* data, unsigned int length);
+
+
+		/** \throws Error If the slave does not acknowledge.*/
+		unsigned int read(int handle, int slaveAddr, int flags, unsigned char* data, unsigned int length);
+
+
+		int configure(int handle, int bitrate);
+
+
+		/** Executes all messages while the bus is locked, so no other transaction can get between them.*/
+		void transfer(int handle, I2cMessage* messages, unsigned int numMessages);
+
+
+		void close(int handle);
+
+
+		/**
+		 * \param port Number of the bus.
+		 * \return The bus, can be used to add further device models.
+		 * \throws Error If the bus does not exist.
+		 */
+		SimulatedBus* getBus(int port);
+
+
+	private:
+		/*! All simulated buses.*/
+		vector<SimulatedBus*> buses;
+		/*! Open flag of every bus.*/
+		vector<bool> opened;
+		/*! If true, every transaction will take as long as on a real bus.*/
+		bool realTime;
+		/*! Protects opened.*/
+		pthread_mutex_t mutex;
+
+
+		/**
+		 * \param handle A handle returned by open().
+		 * \return The bus of the handle.
+		 * \throws Error If the handle is not valid.
+		 */
+		SimulatedBus* getBusByHandle(int handle);
+
+
+		/** Sleeps for the time the bus advanced since start, if realTime is true.*/
+		void waitRealTime(SimulatedBus* bus, unsigned long long start);
+};
+
+#endif /* INCLUDE_SIMULATEDBACKEND_HPP_ */
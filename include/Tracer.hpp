@@ -0,0 +1,152 @@
+#ifndef INCLUDE_TRACER_HPP_
+#define INCLUDE_TRACER_HPP_
+
+#include <pthread.h>
+#include <vector>
+
+using namespace std;
+
+/*! Number of spans which are kept, the oldest spans are overwritten.*/
+#ifndef I2C_TRACE_SPANS
+#define I2C_TRACE_SPANS 4096
+#endif
+
+/*! File which is written by i2c.dumpTrace.*/
+#ifndef I2C_TRACE_FILE
+#define I2C_TRACE_FILE "/tmp/i2c-trace.json"
+#endif
+
+/*! Maximum length of the name and the request id of a span, longer strings are truncated.*/
+#define I2C_TRACE_NAME_LENGTH 48
+
+
+/**
+ * \class Tracer
+ * \brief Plugin-wide, bounded buffer of timed spans, which can be written as Chrome trace (chrome://tracing, Perfetto).
+ * Tracing is disabled by default, a disabled tracer does not record anything.
+ */
+class Tracer{
+
+	public:
+
+		/**Base-constructor, tracing is disabled.*/
+		Tracer();
+
+
+		/**Base-destructor.*/
+		~Tracer();
+
+
+		/** Enables or disables recording of spans, the recorded spans are kept.*/
+		void enable(bool enabled);
+
+
+		/** \return True if spans are recorded.*/
+		bool isEnabled();
+
+
+		/**
+		 * Records a span, replaces the oldest span if the buffer is full.
+		 * \param category Category of the span, like "rpc" or "sub-request", has to be a string literal.
+		 * \param name Name of the span, it is copied.
+		 * \param start Start in microseconds, see now().
+		 * \param end End in microseconds, see now().
+		 * \param requestId Json rpc id of the main-request or NULL, it is copied.
+		 * \param device Unique id of the device or -1.
+		 */
+		void record(const char* category, const char* name, unsigned long long start, unsigned long long end,
+				const char* requestId, long long device);
+
+
+		/**
+		 * Writes all recorded spans as Chrome trace json.
+		 * \param path Path of the file, it is created with mode 0600. A symlink or a file of another user is not written.
+		 * \return Number of written spans.
+		 * \throws Error If the file can not be written.
+		 */
+		unsigned int dump(const char* path);
+
+
+		/** \return Microseconds of CLOCK_MONOTONIC.*/
+		static unsigned long long now();
+
+
+	private:
+
+		/**
+		 * \struct Span
+		 * One recorded span.
+		 */
+		struct Span{
+			/*! Category, points to a string literal.*/
+			const char* category;
+			/*! Name, only contains characters which need no escaping within json.*/
+			char name[I2C_TRACE_NAME_LENGTH];
+			/*! Json rpc id of the main-request, like name.*/
+			char requestId[I2C_TRACE_NAME_LENGTH];
+			/*! Unique id of the device or -1.*/
+			long long device;
+			/*! Start in microseconds.*/
+			unsigned long long start;
+			/*! Duration in microseconds.*/
+			unsigned long long duration;
+			/*! Id of the thread which recorded the span.*/
+			long thread;
+		};
+
+		/*! Recorded spans, used as ring.*/
+		vector<Span> spans;
+		/*! Index of the next span within spans.*/
+		unsigned int next;
+		/*! Number of recorded spans, at most I2C_TRACE_SPANS.*/
+		unsigned int count;
+		/*! True if spans are recorded.*/
+		bool enabled;
+		/*! Protects all members.*/
+		pthread_mutex_t mutex;
+
+
+		/** Copies a string into a span member and replaces characters which would need escaping within json.*/
+		static void copyName(char* target, const char* source);
+};
+
+
+/**
+ * \class TraceSpan
+ * \brief Records a span from its construction to its destruction, also if the scope is left by an exception.
+ */
+class TraceSpan{
+
+	public:
+
+		/**
+		 * Starts the span, nothing is recorded if tracer is NULL or disabled.
+		 * \param tracer The tracer or NULL.
+		 * \param category Category of the span, has to be a string literal.
+		 * \param name Name of the span, has to be valid till the destruction of the span.
+		 * \param requestId Json rpc id of the main-request or NULL, has to be valid till the destruction of the span.
+		 * \param device Unique id of the device or -1.
+		 */
+		TraceSpan(Tracer* tracer, const char* category, const char* name, const char* requestId, long long device);
+
+
+		/**Base-destructor, records the span.*/
+		~TraceSpan();
+
+
+	private:
+		/*! The tracer or NULL if the span is not recorded.*/
+		Tracer* tracer;
+		/*! Category of the span.*/
+		const char* category;
+		/*! Name of the span.*/
+		const char* name;
+		/*! Json rpc id of the main-request or NULL.*/
+		const char* requestId;
+		/*! Unique id of the device or -1.*/
+		long long device;
+		/*! Start in microseconds.*/
+		unsigned long long start;
+};
+
+#endif /* INCLUDE_TRACER_HPP_ */
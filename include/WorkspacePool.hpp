@@ -0,0 +1,99 @@
+#ifndef INCLUDE_WORKSPACEPOOL_HPP_
+#define INCLUDE_WORKSPACEPOOL_HPP_
+
+#include <pthread.h>
+#include <cstddef>
+
+#include "JsonRPC.hpp"
+
+/*! Maximum number of idle workspaces, more released workspaces are deleted.*/
+#ifndef I2C_WORKSPACE_MAX_IDLE
+#define I2C_WORKSPACE_MAX_IDLE 8
+#endif
+
+/*! Released workspaces whose allocators hold more bytes are deleted, so one big request does not keep its memory.*/
+#ifndef I2C_WORKSPACE_MAX_BYTES
+#define I2C_WORKSPACE_MAX_BYTES (256 * 1024)
+#endif
+
+
+/**
+ * \struct Workspace
+ * Parser and DOMs for processing one main-request, borrowed from the WorkspacePool for the time of the request.
+ */
+struct Workspace{
+	/*! Json RPC parser, also generates the responses and sub-requests.*/
+	JsonRPC json;
+	/*! DOM for the main-request.*/
+	Document mainRequestDom;
+	/*! DOM for the sub-responses.*/
+	Document subResponseDom;
+	/*! Allocator for generating the params of sub-requests.*/
+	MemoryPoolAllocator<> subRequestAllocator;
+	/*! Next idle workspace.*/
+	Workspace* next;
+};
+
+
+/**
+ * \class WorkspacePool
+ * \brief Plugin-wide pool of Workspaces, so a connection only holds a parser and DOMs while it processes a request.
+ * Idle connections need no parsing memory and the number of workspaces follows the number of concurrent requests,
+ * not the number of connections.
+ */
+class WorkspacePool{
+
+	public:
+
+		/**Base-constructor.*/
+		WorkspacePool();
+
+
+		/**Base-destructor, deletes the idle workspaces, all workspaces have to be released.*/
+		~WorkspacePool();
+
+
+		/** \return A idle or new workspace.*/
+		Workspace* acquire();
+
+
+		/**
+		 * Returns a workspace into the pool, it is deleted if the pool is full or it holds too much memory.
+		 * The allocators of a kept workspace are cleared.
+		 * \param workspace The workspace of acquire().
+		 */
+		void release(Workspace* workspace);
+
+
+		/**
+		 * \param inUse Gets the number of acquired workspaces.
+		 * \param idle Gets the number of idle workspaces.
+		 * \param idleBytes Gets the bytes which are held by the allocators of the idle workspaces.
+		 */
+		void getUsage(unsigned int &inUse, unsigned int &idle, size_t &idleBytes);
+
+
+	private:
+		/*! Idle workspaces.*/
+		Workspace* idleList;
+		/*! Number of idle workspaces.*/
+		unsigned int idle;
+		/*! Number of acquired workspaces.*/
+		unsigned int inUse;
+		/*! Protects the pool.*/
+		pthread_mutex_t mutex;
+
+
+		/** Frees the memory of all allocators of a workspace, nothing may point into its DOMs anymore.*/
+		static void clear(Workspace* workspace);
+
+
+		/** Sets a DOM to null and frees the memory of its allocator.*/
+		static void clear(Document* dom);
+
+
+		/** \return Bytes which are held by the allocators of a workspace.*/
+		static size_t getBytes(Workspace* workspace);
+};
+
+#endif /* INCLUDE_WORKSPACEPOOL_HPP_ */
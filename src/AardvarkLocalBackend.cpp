@@ -0,0 +1,384 @@
+
+#ifdef AARDVARK_INPROCESS
+
+#include "AardvarkLocalBackend.hpp"
+#include "RemoteAardvark.hpp"
+
+
+AardvarkLocalBackend::AardvarkLocalBackend()
+{
+	finder = new RemoteAardvark(-1);
+	pthread_mutex_init(&mutex, NULL);
+}
+
+
+AardvarkLocalBackend::~AardvarkLocalBackend()
+{
+	map<int, RemoteAardvark*>::iterator aardvark = aardvarks.begin();
+
+	while(aardvark != aardvarks.end())
+	{
+		if(aardvark->second->getHandle() > 0)
+			aardvark->second->close();
+		delete aardvark->second;
+		++aardvark;
+	}
+	delete finder;
+	pthread_mutex_destroy(&mutex);
+}
+
+
+void AardvarkLocalBackend::findDevices(list<I2cDevice*> &deviceList)
+{
+	Value params;
+	Value result;
+	Value* devices = NULL;
+	Value* uniqueIds = NULL;
+
+	pthread_mutex_lock(&mutex);
+	try
+	{
+		params.SetObject();
+		params.AddMember(_aa_find_devices_ext.paramArray[0]._name, 256, paramDom.GetAllocator());
+		finder->aa_find_devices_ext(params, result);
+
+		devices = &result["devices"];
+		uniqueIds = &result["unique_ids"];
+		for(unsigned int i = 0; i < devices->Size(); i++)
+			deviceList.push_back(new I2cDevice(getName(), (*devices)[i].GetInt(), (*uniqueIds)[i].GetUint()));
+	}
+	catch(Error &e)
+	{
+		unlock();
+		throw;
+	}
+	unlock();
+}
+
+
+int AardvarkLocalBackend::open(int port)
+{
+	Value params;
+	Value result;
+	RemoteAardvark* aardvark = NULL;
+	map<int, RemoteAardvark*>::iterator entry;
+	int handle = 0;
+
+	pthread_mutex_lock(&mutex);
+	try
+	{
+		entry = aardvarks.find(port);
+		if(entry == aardvarks.end())
+		{
+			aardvark = new RemoteAardvark(port);
+			aardvarks.insert(pair<int, RemoteAardvark*>(port, aardvark));
+		}
+		else
+			aardvark = entry->second;
+
+		params.SetObject();
+		params.AddMember(_aa_open.paramArray[0]._name, port, paramDom.GetAllocator());
+		aardvark->aa_open(params, result);
+
+		handle = result["Aardvark"].GetInt();
+		if(handle < 0)
+			throw Error("Could not open Aardvark.");
+
+		handles[handle] = aardvark;
+	}
+	catch(Error &e)
+	{
+		unlock();
+		throw;
+	}
+	unlock();
+	return handle;
+}
+
+
+void AardvarkLocalBackend::targetPower(int handle, int powerMask)
+{
+	Value params;
+	Value result;
+
+	pthread_mutex_lock(&mutex);
+	try
+	{
+		params.SetObject();
+		params.AddMember(_aa_target_power.paramArray[0]._name, handle, paramDom.GetAllocator());
+		params.AddMember(_aa_target_power.paramArray[1]._name, powerMask, paramDom.GetAllocator());
+		getAardvark(handle)->aa_target_power(params, result);
+		checkReturnCode(result, "Could not set target power of Aardvark.");
+	}
+	catch(Error &e)
+	{
+		unlock();
+		throw;
+	}
+	unlock();
+}
+
+
+void AardvarkLocalBackend::write(int handle, int slaveAddr, int flags, const unsigned char* data, unsigned int length)
+{
+	Value params;
+	Value result;
+	Value array;
+	MemoryPoolAllocator<> &allocator = paramDom.GetAllocator();
+
+	pthread_mutex_lock(&mutex);
+	try
+	{
+		array.SetArray();
+		for(unsigned int i = 0; i < length; i++)
+			array.PushBack(data[i], allocator);
+
+		params.SetObject();
+		params.AddMember(_aa_i2c_write.paramArray[0]._name, handle, allocator);
+		params.AddMember(_aa_i2c_write.paramArray[1]._name, slaveAddr, allocator);
+		params.AddMember(_aa_i2c_write.paramArray[2]._name, flags, allocator);
+		params.AddMember(_aa_i2c_write.paramArray[3]._name, array, allocator);
+		getAardvark(handle)->aa_i2c_write(params, result);
+		checkReturnCode(result, "Could not write to Aardvark.");
+	}
+	catch(Error &e)
+	{
+		unlock();
+		throw;
+	}
+	unlock();
+}
+
+
+unsigned int AardvarkLocalBackend::read(int handle, int slaveAddr, int flags, unsigned char* data, unsigned int length)
+{
+	Value params;
+	Value result;
+	Value* dataIn = NULL;
+	unsigned int count = 0;
+	MemoryPoolAllocator<> &allocator = paramDom.GetAllocator();
+
+	pthread_mutex_lock(&mutex);
+	try
+	{
+		params.SetObject();
+		params.AddMember(_aa_i2c_read.paramArray[0]._name, handle, allocator);
+		params.AddMember(_aa_i2c_read.paramArray[1]._name, slaveAddr, allocator);
+		params.AddMember(_aa_i2c_read.paramArray[2]._name, flags, allocator);
+		params.AddMember(_aa_i2c_read.paramArray[3]._name, length, allocator);
+		getAardvark(handle)->aa_i2c_read(params, result);
+		checkReturnCode(result, "Could not read from Aardvark.");
+
+		dataIn = &result["data_in"];
+		count = dataIn->Size();
+		if(count > length)
+			count = length;
+		for(unsigned int i = 0; i < count; i++)
+			data[i] = (unsigned char)(*dataIn)[i].GetUint();
+	}
+	catch(Error &e)
+	{
+		unlock();
+		throw;
+	}
+	unlock();
+	return count;
+}
+
+
+int AardvarkLocalBackend::configure(int handle, int bitrate)
+{
+	Value params;
+	Value result;
+	int returnCode = 0;
+
+	pthread_mutex_lock(&mutex);
+	try
+	{
+		params.SetObject();
+		params.AddMember(_aa_i2c_bitrate.paramArray[0]._name, handle, paramDom.GetAllocator());
+		params.AddMember(_aa_i2c_bitrate.paramArray[1]._name, bitrate, paramDom.GetAllocator());
+		getAardvark(handle)->aa_i2c_bitrate(params, result);
+		checkReturnCode(result, "Could not set bitrate of Aardvark.");
+		returnCode = result["returnCode"].GetInt();
+	}
+	catch(Error &e)
+	{
+		unlock();
+		throw;
+	}
+	unlock();
+	return returnCode;
+}
+
+
+void AardvarkLocalBackend::spiConfigure(int handle, int polarity, int phase, int bitorder, int ssPolarity)
+{
+	Value params;
+	Value result;
+	RemoteAardvark* aardvark = NULL;
+	MemoryPoolAllocator<> &allocator = paramDom.GetAllocator();
+
+	pthread_mutex_lock(&mutex);
+	try
+	{
+		aardvark = getAardvark(handle);
+
+		//I²C stays enabled, so the device can still be used by I²C requests
+		params.SetObject();
+		params.AddMember(_aa_configure.paramArray[0]._name, handle, allocator);
+		params.AddMember(_aa_configure.paramArray[1]._name, (int)AA_CONFIG_SPI_I2C, allocator);
+		aardvark->aa_configure(params, result);
+		checkReturnCode(result, "Could not enable SPI of Aardvark.");
+
+		params.SetObject();
+		params.AddMember(_aa_spi_configure.paramArray[0]._name, handle, allocator);
+		params.AddMember(_aa_spi_configure.paramArray[1]._name, polarity, allocator);
+		params.AddMember(_aa_spi_configure.paramArray[2]._name, phase, allocator);
+		params.AddMember(_aa_spi_configure.paramArray[3]._name, bitorder, allocator);
+		aardvark->aa_spi_configure(params, result);
+		checkReturnCode(result, "Could not configure SPI of Aardvark.");
+
+		params.SetObject();
+		params.AddMember(_aa_spi_master_ss_polarity.paramArray[0]._name, handle, allocator);
+		params.AddMember(_aa_spi_master_ss_polarity.paramArray[1]._name, ssPolarity, allocator);
+		aardvark->aa_spi_master_ss_polarity(params, result);
+		checkReturnCode(result, "Could not set SS polarity of Aardvark.");
+	}
+	catch(Error &e)
+	{
+		unlock();
+		throw;
+	}
+	unlock();
+}
+
+
+int AardvarkLocalBackend::spiBitrate(int handle, int bitrate)
+{
+	Value params;
+	Value result;
+	int returnCode = 0;
+
+	pthread_mutex_lock(&mutex);
+	try
+	{
+		params.SetObject();
+		params.AddMember(_aa_spi_bitrate.paramArray[0]._name, handle, paramDom.GetAllocator());
+		params.AddMember(_aa_spi_bitrate.paramArray[1]._name, bitrate, paramDom.GetAllocator());
+		getAardvark(handle)->aa_spi_bitrate(params, result);
+		checkReturnCode(result, "Could not set SPI bitrate of Aardvark.");
+		returnCode = result["returnCode"].GetInt();
+	}
+	catch(Error &e)
+	{
+		unlock();
+		throw;
+	}
+	unlock();
+	return returnCode;
+}
+
+
+unsigned int AardvarkLocalBackend::spiWrite(int handle, const unsigned char* dataOut, unsigned int lengthOut,
+		unsigned char* dataIn, unsigned int lengthIn)
+{
+	Value params;
+	Value result;
+	Value array;
+	Value* data = NULL;
+	unsigned int count = 0;
+	MemoryPoolAllocator<> &allocator = paramDom.GetAllocator();
+
+	pthread_mutex_lock(&mutex);
+	try
+	{
+		array.SetArray();
+		for(unsigned int i = 0; i < lengthOut; i++)
+			array.PushBack(dataOut[i], allocator);
+
+		params.SetObject();
+		params.AddMember(_aa_spi_write.paramArray[0]._name, handle, allocator);
+		params.AddMember(_aa_spi_write.paramArray[1]._name, array, allocator);
+		params.AddMember(_aa_spi_write.paramArray[2]._name, lengthIn, allocator);
+		getAardvark(handle)->aa_spi_write(params, result);
+		checkReturnCode(result, "Could not write to SPI of Aardvark.");
+
+		if(lengthIn > 0)
+		{
+			data = &result["data_in"];
+			count = data->Size();
+			if(count > lengthIn)
+				count = lengthIn;
+			for(unsigned int i = 0; i < count; i++)
+				dataIn[i] = (unsigned char)(*data)[i].GetUint();
+		}
+	}
+	catch(Error &e)
+	{
+		unlock();
+		throw;
+	}
+	unlock();
+	return count;
+}
+
+
+void AardvarkLocalBackend::close(int handle)
+{
+	Value params;
+	Value result;
+
+	pthread_mutex_lock(&mutex);
+	try
+	{
+		params.SetObject();
+		params.AddMember(_aa_close.paramArray[0]._name, handle, paramDom.GetAllocator());
+		getAardvark(handle)->aa_close(params, result);
+		handles.erase(handle);
+		checkReturnCode(result, "Could not close Aardvark.");
+	}
+	catch(Error &e)
+	{
+		unlock();
+		throw;
+	}
+	unlock();
+}
+
+
+void AardvarkLocalBackend::unlock()
+{
+	//the params of every call are allocated from paramDom, without clearing it would grow with every call
+	paramDom.GetAllocator().Clear();
+	pthread_mutex_unlock(&mutex);
+}
+
+
+RemoteAardvark* AardvarkLocalBackend::getAardvark(int handle)
+{
+	map<int, RemoteAardvark*>::iterator entry = handles.find(handle);
+
+	if(entry == handles.end())
+		throw Error("Invalid Aardvark handle.");
+
+	return entry->second;
+}
+
+
+void AardvarkLocalBackend::checkReturnCode(Value &result, const char* errorMsg)
+{
+	int status = 0;
+
+	if(!result.HasMember("returnCode") || result["returnCode"].GetInt() < 0)
+	{
+		//the optional AardvarkI2cStatus of a failed transaction tells I2c if it can be retried
+		if(result.IsObject() && result.HasMember("status") && result["status"].IsInt())
+			status = result["status"].GetInt();
+		if(status > AA_I2C_STATUS_OK && status < I2C_NUMBER_OF_BUS_STATUS)
+			throw Error(I2C_BUS_ERROR_CODE(status), errorMsg);
+		throw Error(errorMsg);
+	}
+}
+
+#endif /* AARDVARK_INPROCESS */
@@ -0,0 +1,470 @@
+
+#include <unistd.h>
+#include <cstring>
+
+#include "AardvarkRsdBackend.hpp"
+#include "I2c.hpp"
+#include "RemoteAardvark.hpp"
+
+
+//Optional function of the Aardvark-Plugin for exchanging payloads through shared memory
+static _param _pid = {"pid", kNumberType};
+static _param _fd = {"fd", kNumberType};
+static _param _size = {"size", kNumberType};
+static _param aa_shm_attach_params[3] = {_pid, _fd, _size};
+static _function _aa_shm_attach = {"Aardvark.aa_shm_attach", NULL, 3, aa_shm_attach_params};
+
+//Optional function of the Aardvark-Plugin for switching the params and results of the connection to MessagePack
+static _param _encoding = {"encoding", kStringType};
+static _param aa_set_encoding_params[1] = {_encoding};
+static _function _aa_set_encoding = {"Aardvark.aa_set_encoding", NULL, 1, aa_set_encoding_params};
+
+
+AardvarkRsdBackend::AardvarkRsdBackend(I2c* i2c)
+{
+	this->i2c = i2c;
+	shm = NULL;
+	shmNegotiated = false;
+	msgPack = false;
+	encodingNegotiated = false;
+	function = NULL;
+	subResult = NULL;
+}
+
+
+AardvarkRsdBackend::~AardvarkRsdBackend()
+{
+	delete shm;
+}
+
+
+void AardvarkRsdBackend::findDevices(list<I2cDevice*> &deviceList)
+{
+	Value method;
+	Value localParams;
+	Value tempParam;
+	Value* subResult = NULL;
+	Value* i2cDeviceValue = NULL;
+	Value* i2cUniqueIdValue = NULL;
+	JsonRPC* json = i2c->getJson();
+	MemoryPoolAllocator<> &allocator = i2c->getSubRequestAllocator();
+	int num_devices = 0;
+
+	method.SetString(_aa_find_devices_ext._name, allocator);
+	localParams.SetObject();
+	tempParam.SetString(_aa_find_devices_ext.paramArray[0]._name, allocator);
+	localParams.AddMember(tempParam, 256, allocator);
+
+	subResult = i2c->sendSubRequest(method, localParams);
+
+	i2cDeviceValue = json->findObjectMember(*subResult, "devices");
+	i2cUniqueIdValue = json->findObjectMember(*subResult, "unique_ids");
+	num_devices = i2cDeviceValue->Size();
+
+	for(int i = 0; i < num_devices; i++)
+		deviceList.push_back(new I2cDevice(getName(), (*i2cDeviceValue)[i].GetInt(), (*i2cUniqueIdValue)[i].GetUint()));
+}
+
+
+int AardvarkRsdBackend::open(int port)
+{
+	long long handle = -1;
+
+	beginParams(_aa_open, false);
+	addParam(0, port);
+	sendParams();
+
+	if(!findResultInt("Aardvark", handle) || handle < 0)
+		throw Error("Could not open Aardvark.");
+
+	return (int)handle;
+}
+
+
+void AardvarkRsdBackend::targetPower(int handle, int powerMask)
+{
+	beginParams(_aa_target_power, false);
+	addParam(0, handle);
+	addParam(1, powerMask);
+	sendParams();
+
+	checkReturnCode("Could not set target power of Aardvark.");
+}
+
+
+void AardvarkRsdBackend::write(int handle, int slaveAddr, int flags, const unsigned char* data, unsigned int length)
+{
+	size_t offset = 0;
+	bool shmPayload = useShm(length);
+
+	beginParams(_aa_i2c_write, shmPayload);
+	addParam(0, handle);
+	addParam(1, slaveAddr);
+	addParam(2, flags);
+	//data, written once into shared memory or as part of the params
+	if(shmPayload)
+	{
+		offset = shm->reserve(length);
+		memcpy(shm->at(offset), data, length);
+		addParam(3, NULL, 0, true);
+		addShmDescriptor(offset, length);
+	}
+	else
+		addParam(3, data, length);
+
+	sendParams();
+
+	checkReturnCode("Could not write to Aardvark.");
+}
+
+
+unsigned int AardvarkRsdBackend::read(int handle, int slaveAddr, int flags, unsigned char* data, unsigned int length)
+{
+	unsigned int count = 0;
+	size_t offset = 0;
+	bool shmPayload = useShm(length);
+
+	beginParams(_aa_i2c_read, shmPayload);
+	addParam(0, handle);
+	addParam(1, slaveAddr);
+	addParam(2, flags);
+	addParam(3, length);
+	//the Aardvark-Plugin will write data_in into shared memory and return the number of read bytes as returnCode
+	if(shmPayload)
+	{
+		offset = shm->reserve(length);
+		addShmDescriptor(offset, length);
+	}
+
+	sendParams();
+	count = checkReturnCode("Could not read from Aardvark.");
+
+	if(shmPayload)
+	{
+		if(count > length)
+			count = length;
+		memcpy(data, shm->at(offset), count);
+		return count;
+	}
+
+	return copyResultBytes("data_in", data, length);
+}
+
+
+int AardvarkRsdBackend::configure(int handle, int bitrate)
+{
+	beginParams(_aa_i2c_bitrate, false);
+	addParam(0, handle);
+	addParam(1, bitrate);
+	sendParams();
+
+	return checkReturnCode("Could not set bitrate of Aardvark.");
+}
+
+
+void AardvarkRsdBackend::spiConfigure(int handle, int polarity, int phase, int bitorder, int ssPolarity)
+{
+	//I²C stays enabled, so the device can still be used by I²C requests
+	beginParams(_aa_configure, false);
+	addParam(0, handle);
+	addParam(1, AA_CONFIG_SPI_I2C);
+	sendParams();
+	checkReturnCode("Could not enable SPI of Aardvark.");
+
+	beginParams(_aa_spi_configure, false);
+	addParam(0, handle);
+	addParam(1, polarity);
+	addParam(2, phase);
+	addParam(3, bitorder);
+	sendParams();
+	checkReturnCode("Could not configure SPI of Aardvark.");
+
+	beginParams(_aa_spi_master_ss_polarity, false);
+	addParam(0, handle);
+	addParam(1, ssPolarity);
+	sendParams();
+	checkReturnCode("Could not set SS polarity of Aardvark.");
+}
+
+
+int AardvarkRsdBackend::spiBitrate(int handle, int bitrate)
+{
+	beginParams(_aa_spi_bitrate, false);
+	addParam(0, handle);
+	addParam(1, bitrate);
+	sendParams();
+
+	return checkReturnCode("Could not set SPI bitrate of Aardvark.");
+}
+
+
+unsigned int AardvarkRsdBackend::spiWrite(int handle, const unsigned char* dataOut, unsigned int lengthOut,
+		unsigned char* dataIn, unsigned int lengthIn)
+{
+	beginParams(_aa_spi_write, false);
+	addParam(0, handle);
+	addParam(1, dataOut, lengthOut);
+	addParam(2, lengthIn);
+	sendParams();
+	checkReturnCode("Could not write to SPI of Aardvark.");
+
+	if(lengthIn == 0)
+		return 0;
+	return copyResultBytes("data_in", dataIn, lengthIn);
+}
+
+
+void AardvarkRsdBackend::close(int handle)
+{
+	beginParams(_aa_close, false);
+	addParam(0, handle);
+	sendParams();
+
+	checkReturnCode("Could not close Aardvark.");
+}
+
+
+bool AardvarkRsdBackend::useShm(unsigned int length)
+{
+	Value method;
+	Value localParams;
+	Value tempParam;
+	MemoryPoolAllocator<> &allocator = i2c->getSubRequestAllocator();
+
+	if(length < SHM_PAYLOAD_THRESHOLD || length > SHM_RING_SIZE)
+		return false;
+
+	if(!shmNegotiated)
+	{
+		shmNegotiated = true;
+		try
+		{
+			shm = new ShmRing(SHM_RING_SIZE);
+
+			localParams.SetObject();
+			tempParam.SetString(_aa_shm_attach.paramArray[0]._name, allocator);
+			localParams.AddMember(tempParam, (int)getpid(), allocator);
+			tempParam.SetString(_aa_shm_attach.paramArray[1]._name, allocator);
+			localParams.AddMember(tempParam, shm->getFd(), allocator);
+			tempParam.SetString(_aa_shm_attach.paramArray[2]._name, allocator);
+			localParams.AddMember(tempParam, (unsigned int)shm->getSize(), allocator);
+			method.SetString(_aa_shm_attach._name, allocator);
+
+			i2c->sendSubRequest(method, localParams);
+		}
+		catch(Error &e)
+		{
+			//Aardvark-Plugin does not support shared memory, use json for the rest of the connection
+			delete shm;
+			shm = NULL;
+		}
+	}
+
+	return shm != NULL;
+}
+
+
+bool AardvarkRsdBackend::useMsgPack()
+{
+	Value method;
+	Value localParams;
+	Value tempParam;
+	Value encoding;
+	MemoryPoolAllocator<> &allocator = i2c->getSubRequestAllocator();
+
+	if(!encodingNegotiated)
+	{
+		encodingNegotiated = true;
+		try
+		{
+			localParams.SetObject();
+			tempParam.SetString(_aa_set_encoding.paramArray[0]._name, allocator);
+			encoding.SetString(AARDVARK_ENCODING_MSGPACK, allocator);
+			localParams.AddMember(tempParam, encoding, allocator);
+			method.SetString(_aa_set_encoding._name, allocator);
+
+			i2c->sendSubRequest(method, localParams);
+			msgPack = true;
+		}
+		catch(Error &e)
+		{
+			//Aardvark-Plugin does not support MessagePack, use json for the rest of the connection
+			msgPack = false;
+		}
+	}
+
+	return msgPack;
+}
+
+
+void AardvarkRsdBackend::beginParams(_function &function, bool withShm)
+{
+	this->function = &function;
+	subResult = NULL;
+	resultBuffer.clear();
+
+	if(useMsgPack())
+	{
+		writer.clear();
+		writer.writeArray(function.paramCount + (withShm ? 1 : 0));
+	}
+	else
+		params.SetObject();
+}
+
+
+void AardvarkRsdBackend::addParam(unsigned int index, int value)
+{
+	Value name;
+	MemoryPoolAllocator<> &allocator = i2c->getSubRequestAllocator();
+
+	if(msgPack)
+		writer.writeInt(value);
+	else
+	{
+		name.SetString(function->paramArray[index]._name, allocator);
+		params.AddMember(name, value, allocator);
+	}
+}
+
+
+void AardvarkRsdBackend::addParam(unsigned int index, const unsigned char* data, unsigned int length, bool inShm)
+{
+	Value name;
+	Value array;
+	MemoryPoolAllocator<> &allocator = i2c->getSubRequestAllocator();
+
+	if(msgPack)
+	{
+		//the position of the payload has to be kept, even if it is exchanged through shared memory
+		if(inShm)
+			writer.writeNil();
+		else
+			writer.writeBin(data, length);
+	}
+	else if(!inShm)
+	{
+		array.SetArray();
+		for(unsigned int i = 0; i < length; i++)
+			array.PushBack(data[i], allocator);
+		name.SetString(function->paramArray[index]._name, allocator);
+		params.AddMember(name, array, allocator);
+	}
+}
+
+
+void AardvarkRsdBackend::addShmDescriptor(size_t offset, unsigned int length)
+{
+	Value descriptor;
+	MemoryPoolAllocator<> &allocator = i2c->getSubRequestAllocator();
+
+	if(msgPack)
+	{
+		writer.writeMap(2);
+		writer.writeString("offset");
+		writer.writeInt(offset);
+		writer.writeString("length");
+		writer.writeInt(length);
+	}
+	else
+	{
+		descriptor.SetObject();
+		descriptor.AddMember("offset", (unsigned int)offset, allocator);
+		descriptor.AddMember("length", length, allocator);
+		params.AddMember("data_shm", descriptor, allocator);
+	}
+}
+
+
+void AardvarkRsdBackend::sendParams()
+{
+	Value method;
+	Value encoded;
+	Value* encodedResult = NULL;
+	string text;
+	MemoryPoolAllocator<> &allocator = i2c->getSubRequestAllocator();
+
+	method.SetString(function->_name, allocator);
+
+	if(!msgPack)
+	{
+		subResult = i2c->sendSubRequest(method, params);
+		return;
+	}
+
+	Base64::encode(&writer.getBuffer()[0], writer.getBuffer().size(), text);
+	params.SetObject();
+	encoded.SetString(text.c_str(), text.size(), allocator);
+	params.AddMember(AARDVARK_MSGPACK_MEMBER, encoded, allocator);
+
+	subResult = i2c->sendSubRequest(method, params);
+	encodedResult = i2c->getJson()->findObjectMember(*subResult, AARDVARK_MSGPACK_MEMBER, kStringType);
+	Base64::decode(encodedResult->GetString(), encodedResult->GetStringLength(), resultBuffer);
+}
+
+
+bool AardvarkRsdBackend::findResultInt(const char* name, long long &value)
+{
+	Value* member = NULL;
+
+	if(msgPack)
+		return MsgPackReader(resultBuffer.empty() ? NULL : &resultBuffer[0], resultBuffer.size()).findInt(name, value);
+
+	if(!subResult->IsObject() || !subResult->HasMember(name))
+		return false;
+
+	member = &(*subResult)[name];
+	if(!member->IsNumber())
+		throw Error("Sub-result member is not a number.");
+
+	value = member->GetInt64();
+	return true;
+}
+
+
+unsigned int AardvarkRsdBackend::copyResultBytes(const char* name, unsigned char* data, unsigned int length)
+{
+	Value* array = NULL;
+	const unsigned char* bytes = NULL;
+	unsigned int count = 0;
+
+	if(msgPack)
+	{
+		if(!MsgPackReader(resultBuffer.empty() ? NULL : &resultBuffer[0], resultBuffer.size()).findBin(name, bytes, count))
+			throw Error("Sub-result does not contain the read bytes.");
+		if(count > length)
+			count = length;
+		memcpy(data, bytes, count);
+		return count;
+	}
+
+	array = i2c->getJson()->findObjectMember(*subResult, name, kArrayType);
+	count = array->Size();
+	if(count > length)
+		count = length;
+
+	for(unsigned int i = 0; i < count; i++)
+		data[i] = (unsigned char)(*array)[i].GetUint();
+
+	return count;
+}
+
+
+int AardvarkRsdBackend::checkReturnCode(const char* errorMsg)
+{
+	long long returnCode = 0;
+	long long status = 0;
+
+	if(!findResultInt("returnCode", returnCode))
+		throw Error("Sub-result does not contain a returnCode.");
+
+	if(returnCode < 0)
+	{
+		//the optional AardvarkI2cStatus of a failed transaction tells I2c if it can be retried
+		if(findResultInt("status", status) && status > AA_I2C_STATUS_OK && status < I2C_NUMBER_OF_BUS_STATUS)
+			throw Error(I2C_BUS_ERROR_CODE((int)status), errorMsg);
+		throw Error(errorMsg);
+	}
+
+	return (int)returnCode;
+}
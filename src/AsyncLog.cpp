@@ -0,0 +1,153 @@
+
+#include <unistd.h>
+#include <syslog.h>
+#include <cstring>
+
+#include "AsyncLog.hpp"
+
+
+AsyncLog::AsyncLog(int facility)
+{
+	this->facility = facility;
+	rings = NULL;
+	stop = false;
+	dropped = 0;
+	pthread_mutex_init(&mutex, NULL);
+	pthread_key_create(&ringKey, releaseRing);
+
+	//without a drain thread, the rings are only written by the destructor
+	draining = pthread_create(&drainThread, NULL, drainLoop, this) == 0;
+}
+
+
+AsyncLog::~AsyncLog()
+{
+	Ring* ring = NULL;
+
+	__atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+	if(draining)
+		pthread_join(drainThread, NULL);
+	drain();
+
+	pthread_key_delete(ringKey);
+	while(rings != NULL)
+	{
+		ring = rings;
+		rings = ring->next;
+		delete ring;
+	}
+	pthread_mutex_destroy(&mutex);
+}
+
+
+void AsyncLog::log(const char* direction, const char* message, unsigned int length)
+{
+	Ring* ring = getRing();
+	Entry* entry = NULL;
+	unsigned int head = ring->head;
+
+	//sampling and the ring are per thread, so only the thread itself changes them
+	if(++ring->messages % I2C_LOG_SAMPLE_RATE != 0)
+		return;
+
+	if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= I2C_LOG_RING_SIZE)
+	{
+		__atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	entry = &ring->entries[head % I2C_LOG_RING_SIZE];
+	entry->direction = direction;
+	entry->length = length;
+	entry->stored = length < I2C_LOG_MAX_PAYLOAD ? length : I2C_LOG_MAX_PAYLOAD;
+	memcpy(entry->text, message, entry->stored);
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+unsigned long long AsyncLog::getDropped()
+{
+	return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+
+AsyncLog::Ring* AsyncLog::getRing()
+{
+	Ring* ring = (Ring*)pthread_getspecific(ringKey);
+
+	if(ring == NULL)
+	{
+		ring = new Ring;
+		ring->head = 0;
+		ring->tail = 0;
+		ring->messages = 0;
+		ring->orphaned = false;
+
+		pthread_mutex_lock(&mutex);
+		ring->next = rings;
+		rings = ring;
+		pthread_mutex_unlock(&mutex);
+
+		pthread_setspecific(ringKey, ring);
+	}
+	return ring;
+}
+
+
+void AsyncLog::drain()
+{
+	Ring** link = NULL;
+	Ring* ring = NULL;
+	Entry* entry = NULL;
+	unsigned int head = 0;
+	bool orphaned = false;
+
+	pthread_mutex_lock(&mutex);
+	link = &rings;
+	while(*link != NULL)
+	{
+		ring = *link;
+		//read orphaned before head, so the last entries of a exited thread are written before its ring is deleted
+		orphaned = __atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		while(ring->tail != head)
+		{
+			entry = &ring->entries[ring->tail % I2C_LOG_RING_SIZE];
+			if(entry->stored < entry->length)
+				syslog(facility | LOG_INFO, "%s: %.*s ... (%u of %u bytes)", entry->direction, (int)entry->stored, entry->text,
+						entry->stored, entry->length);
+			else
+				syslog(facility | LOG_INFO, "%s: %.*s", entry->direction, (int)entry->stored, entry->text);
+			__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+		}
+
+		if(orphaned)
+		{
+			*link = ring->next;
+			delete ring;
+		}
+		else
+			link = &ring->next;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void* AsyncLog::drainLoop(void* arg)
+{
+	AsyncLog* log = (AsyncLog*)arg;
+
+	while(!__atomic_load_n(&log->stop, __ATOMIC_ACQUIRE))
+	{
+		log->drain();
+		usleep(I2C_LOG_DRAIN_INTERVAL * 1000);
+	}
+	return NULL;
+}
+
+
+void AsyncLog::releaseRing(void* ring)
+{
+	__atomic_store_n(&((Ring*)ring)->orphaned, true, __ATOMIC_RELEASE);
+}
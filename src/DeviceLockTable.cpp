@@ -0,0 +1,237 @@
+
+#include <cerrno>
+
+#include "DeviceLockTable.hpp"
+#include "JsonRPC.hpp"
+
+
+DeviceLockTable::DeviceLockTable()
+{
+	pthread_condattr_t attr;
+
+	pthread_mutex_init(&mutex, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&changed, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+
+DeviceLockTable::~DeviceLockTable()
+{
+	pthread_cond_destroy(&changed);
+	pthread_mutex_destroy(&mutex);
+}
+
+
+void DeviceLockTable::lock(unsigned int device, const void* owner, unsigned int lease)
+{
+	struct timespec deadline = now();
+	struct timespec currentTime;
+
+	deadline.tv_sec += I2C_LOCK_WAIT_TIMEOUT;
+
+	pthread_mutex_lock(&mutex);
+	while(true)
+	{
+		Entry &entry = entries[device];
+		currentTime = now();
+		if(!isLockedByOther(entry, owner, currentTime) && !isUsedByOther(entry, owner))
+		{
+			entry.owner = owner;
+			entry.lease = lease;
+			entry.expires = currentTime;
+			entry.expires.tv_sec += lease;
+			break;
+		}
+
+		if(!wait(entry, deadline))
+		{
+			cleanup(device);
+			pthread_mutex_unlock(&mutex);
+			throw Error("Device is locked or used by another client.");
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void DeviceLockTable::unlock(unsigned int device, const void* owner)
+{
+	map<unsigned int, Entry>::iterator entry;
+
+	pthread_mutex_lock(&mutex);
+	entry = entries.find(device);
+	if(entry == entries.end() || entry->second.owner != owner)
+	{
+		pthread_mutex_unlock(&mutex);
+		throw Error("Device is not locked by this client.");
+	}
+
+	entry->second.owner = NULL;
+	cleanup(device);
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void DeviceLockTable::enter(unsigned int device, const void* owner)
+{
+	struct timespec deadline = now();
+	struct timespec currentTime;
+
+	deadline.tv_sec += I2C_LOCK_WAIT_TIMEOUT;
+
+	pthread_mutex_lock(&mutex);
+	while(true)
+	{
+		Entry &entry = entries[device];
+		currentTime = now();
+		if(!isLockedByOther(entry, owner, currentTime))
+		{
+			++entry.users[owner];
+			//using the device renews the lease of the owner
+			if(entry.owner == owner)
+			{
+				entry.expires = currentTime;
+				entry.expires.tv_sec += entry.lease;
+			}
+			break;
+		}
+
+		if(!wait(entry, deadline))
+		{
+			cleanup(device);
+			pthread_mutex_unlock(&mutex);
+			throw Error("Device is locked by another client.");
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void DeviceLockTable::leave(unsigned int device, const void* owner)
+{
+	map<unsigned int, Entry>::iterator entry;
+	map<const void*, unsigned int>::iterator user;
+
+	pthread_mutex_lock(&mutex);
+	entry = entries.find(device);
+	if(entry != entries.end())
+	{
+		user = entry->second.users.find(owner);
+		if(user != entry->second.users.end() && --user->second == 0)
+			entry->second.users.erase(user);
+		cleanup(device);
+		pthread_cond_broadcast(&changed);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+
+bool DeviceLockTable::isOwner(unsigned int device, const void* owner)
+{
+	map<unsigned int, Entry>::iterator entry;
+	struct timespec currentTime = now();
+	bool result = false;
+
+	pthread_mutex_lock(&mutex);
+	entry = entries.find(device);
+	if(entry != entries.end() && entry->second.owner == owner)
+		result = before(currentTime, entry->second.expires);
+	pthread_mutex_unlock(&mutex);
+
+	return result;
+}
+
+
+void DeviceLockTable::releaseAll(const void* owner)
+{
+	map<unsigned int, Entry>::iterator entry;
+
+	pthread_mutex_lock(&mutex);
+	entry = entries.begin();
+	while(entry != entries.end())
+	{
+		if(entry->second.owner == owner)
+			entry->second.owner = NULL;
+		entry->second.users.erase(owner);
+
+		if(entry->second.owner == NULL && entry->second.users.empty())
+			entries.erase(entry++);
+		else
+			++entry;
+	}
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&mutex);
+}
+
+
+bool DeviceLockTable::isLockedByOther(Entry &entry, const void* owner, struct timespec &now)
+{
+	if(entry.owner == NULL || entry.owner == owner)
+		return false;
+
+	//the lease expired, the lock is released
+	if(!before(now, entry.expires))
+	{
+		entry.owner = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+
+bool DeviceLockTable::isUsedByOther(Entry &entry, const void* owner)
+{
+	map<const void*, unsigned int>::iterator user;
+
+	for(user = entry.users.begin(); user != entry.users.end(); ++user)
+	{
+		if(user->first != owner)
+			return true;
+	}
+	return false;
+}
+
+
+bool DeviceLockTable::wait(Entry &entry, struct timespec &deadline)
+{
+	struct timespec until = deadline;
+	int result = 0;
+
+	//wake up at the end of the lease, nobody signals an expired lock
+	if(entry.owner != NULL && before(entry.expires, until))
+		until = entry.expires;
+
+	result = pthread_cond_timedwait(&changed, &mutex, &until);
+	if(result == ETIMEDOUT && !before(now(), deadline))
+		return false;
+
+	return true;
+}
+
+
+void DeviceLockTable::cleanup(unsigned int device)
+{
+	map<unsigned int, Entry>::iterator entry = entries.find(device);
+
+	if(entry != entries.end() && entry->second.owner == NULL && entry->second.users.empty())
+		entries.erase(entry);
+}
+
+
+struct timespec DeviceLockTable::now()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time;
+}
+
+
+bool DeviceLockTable::before(const struct timespec &a, const struct timespec &b)
+{
+	return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
@@ -0,0 +1,267 @@
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "DeviceQueue.hpp"
+#include "JsonRPC.hpp"
+
+
+DeviceQueue::DeviceQueue()
+{
+	pthread_condattr_t attr;
+
+	memset(&counters, 0, sizeof(counters));
+	pthread_mutex_init(&mutex, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&changed, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+
+DeviceQueue::~DeviceQueue()
+{
+	pthread_cond_destroy(&changed);
+	pthread_mutex_destroy(&mutex);
+}
+
+
+void DeviceQueue::enter(unsigned int device, const void* owner, QueuePriority priority, unsigned int cost)
+{
+	struct timespec deadline = now();
+	Waiter waiter = {owner, cost, false};
+	list<Flow>::iterator flow;
+
+	deadline.tv_sec += I2C_QUEUE_WAIT_TIMEOUT / 1000;
+	deadline.tv_nsec += (I2C_QUEUE_WAIT_TIMEOUT % 1000) * 1000000;
+	if(deadline.tv_nsec >= 1000000000)
+	{
+		++deadline.tv_sec;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&mutex);
+	Entry &entry = entries[device];
+	list<Flow> &flows = entry.flows[priority];
+
+	//the client already uses the device, like with a open session
+	if(entry.holder == owner)
+	{
+		++entry.holds;
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+
+	if(entry.holder == NULL && entry.waiting == 0)
+	{
+		entry.holder = owner;
+		entry.holds = 1;
+		entry.since = now();
+		++counters.admitted;
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+
+	if(entry.waiting >= I2C_DEVICE_QUEUE_LIMIT)
+		reject(entry, "Queue of the device is full", counters.rejected);
+	if(counters.waiting >= I2C_QUEUE_LIMIT)
+		reject(entry, "Too many queued requests", counters.rejected);
+
+	//a client which already waits keeps its place and deficit
+	for(flow = flows.begin(); flow != flows.end() && flow->owner != owner; ++flow);
+	if(flow == flows.end())
+	{
+		flow = flows.insert(flows.end(), Flow());
+		flow->owner = owner;
+		flow->deficit = 0;
+	}
+	flow->waiters.push_back(&waiter);
+	++entry.waiting;
+	if(++counters.waiting > counters.maxWaiting)
+		counters.maxWaiting = counters.waiting;
+
+	while(!waiter.granted)
+	{
+		if(pthread_cond_timedwait(&changed, &mutex, &deadline) == ETIMEDOUT && !waiter.granted)
+		{
+			removeWaiter(flows, &waiter);
+			--entry.waiting;
+			--counters.waiting;
+			reject(entry, "Waited too long for the device", counters.timedOut);
+		}
+	}
+
+	++counters.queued;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void DeviceQueue::leave(unsigned int device, const void* owner)
+{
+	map<unsigned int, Entry>::iterator entry;
+
+	pthread_mutex_lock(&mutex);
+	entry = entries.find(device);
+	if(entry != entries.end() && entry->second.holder == owner && --entry->second.holds == 0)
+		finishUse(entry->second);
+	pthread_mutex_unlock(&mutex);
+}
+
+
+bool DeviceQueue::hasWaiters(unsigned int device)
+{
+	map<unsigned int, Entry>::iterator entry;
+	bool result = false;
+
+	pthread_mutex_lock(&mutex);
+	entry = entries.find(device);
+	result = entry != entries.end() && entry->second.waiting > 0;
+	pthread_mutex_unlock(&mutex);
+	return result;
+}
+
+
+void DeviceQueue::releaseAll(const void* owner)
+{
+	map<unsigned int, Entry>::iterator entry;
+
+	pthread_mutex_lock(&mutex);
+	for(entry = entries.begin(); entry != entries.end(); ++entry)
+	{
+		if(entry->second.holder == owner)
+			finishUse(entry->second);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void DeviceQueue::get(Counters &counters)
+{
+	pthread_mutex_lock(&mutex);
+	counters = this->counters;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void DeviceQueue::getDepths(map<unsigned int, unsigned int> &depths)
+{
+	map<unsigned int, Entry>::iterator entry;
+
+	pthread_mutex_lock(&mutex);
+	for(entry = entries.begin(); entry != entries.end(); ++entry)
+	{
+		if(entry->second.waiting > 0)
+			depths[entry->first] = entry->second.waiting;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void DeviceQueue::reject(Entry &entry, const char* reason, unsigned long long &counter)
+{
+	//the message is used by the same thread for the error response, before it rejects the next request
+	static __thread char message[96];
+	unsigned long long retryAfter = (entry.waiting + 1) * entry.averageHold / 1000;
+
+	if(retryAfter == 0)
+		retryAfter = 1;
+	++counter;
+	snprintf(message, sizeof(message), "%s, retry after %llu ms.", reason, retryAfter);
+	pthread_mutex_unlock(&mutex);
+	throw Error(I2C_OVERLOADED_ERROR_CODE, message);
+}
+
+
+void DeviceQueue::finishUse(Entry &entry)
+{
+	//moving average of the last uses, for the retry-after estimate
+	entry.averageHold = (entry.averageHold * 7 + elapsed(entry.since, now())) / 8;
+	entry.holder = NULL;
+	entry.holds = 0;
+	grantNext(entry);
+}
+
+
+void DeviceQueue::grantNext(Entry &entry)
+{
+	list<Flow>* flows = NULL;
+	Waiter* waiter = NULL;
+
+	if(!entry.flows[QUEUE_INTERACTIVE].empty()
+			&& (entry.flows[QUEUE_BULK].empty() || entry.interactiveTurns < I2C_QUEUE_BULK_SHARE))
+	{
+		flows = &entry.flows[QUEUE_INTERACTIVE];
+		++entry.interactiveTurns;
+	}
+	else if(!entry.flows[QUEUE_BULK].empty())
+	{
+		flows = &entry.flows[QUEUE_BULK];
+		entry.interactiveTurns = 0;
+	}
+	else
+		return;
+
+	//deficit round robin: the client at the head gets a quantum per round till its next request fits
+	while(waiter == NULL)
+	{
+		Flow &flow = flows->front();
+
+		if(flow.deficit >= flow.waiters.front()->cost)
+		{
+			waiter = flow.waiters.front();
+			flow.waiters.pop_front();
+			flow.deficit -= waiter->cost;
+			//a client without waiting requests does not keep its deficit
+			if(flow.waiters.empty())
+				flows->pop_front();
+		}
+		else
+		{
+			flow.deficit += I2C_QUEUE_QUANTUM;
+			flows->splice(flows->end(), *flows, flows->begin());
+		}
+	}
+
+	waiter->granted = true;
+	entry.holder = waiter->owner;
+	entry.holds = 1;
+	entry.since = now();
+	--entry.waiting;
+	--counters.waiting;
+	pthread_cond_broadcast(&changed);
+}
+
+
+void DeviceQueue::removeWaiter(list<Flow> &flows, Waiter* waiter)
+{
+	list<Flow>::iterator flow;
+
+	for(flow = flows.begin(); flow != flows.end(); ++flow)
+	{
+		if(flow->owner == waiter->owner)
+		{
+			flow->waiters.remove(waiter);
+			if(flow->waiters.empty())
+				flows.erase(flow);
+			return;
+		}
+	}
+}
+
+
+struct timespec DeviceQueue::now()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time;
+}
+
+
+unsigned long long DeviceQueue::elapsed(const struct timespec &a, const struct timespec &b)
+{
+	long long microseconds = (long long)(b.tv_sec - a.tv_sec) * 1000000 + (b.tv_nsec - a.tv_nsec) / 1000;
+
+	return microseconds > 0 ? (unsigned long long)microseconds : 0;
+}
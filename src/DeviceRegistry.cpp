@@ -0,0 +1,239 @@
+
+#include <unistd.h>
+#include <poll.h>
+#include <syslog.h>
+#include <sys/inotify.h>
+#include <cstring>
+#include <ctime>
+
+#include "DeviceRegistry.hpp"
+#include "JsonRPC.hpp"
+
+
+DeviceRegistry::DeviceRegistry(list<I2cBackend*>* backends)
+{
+	this->backends = backends;
+	lastDiscovery = 0;
+	running = false;
+	stopPipe[0] = -1;
+	stopPipe[1] = -1;
+	pthread_rwlock_init(&devicesLock, NULL);
+	pthread_mutex_init(&discoveryMutex, NULL);
+}
+
+
+DeviceRegistry::~DeviceRegistry()
+{
+	stop();
+	pthread_rwlock_destroy(&devicesLock);
+	pthread_mutex_destroy(&discoveryMutex);
+}
+
+
+void DeviceRegistry::start()
+{
+	if(pipe(stopPipe) != 0)
+		throw Error("Could not create pipe of device discovery.");
+	if(pthread_create(&thread, NULL, discoveryThread, this) != 0)
+	{
+		close(stopPipe[0]);
+		close(stopPipe[1]);
+		throw Error("Could not create thread of device discovery.");
+	}
+	running = true;
+}
+
+
+void DeviceRegistry::stop()
+{
+	char stop = 0;
+
+	if(!running)
+		return;
+	if(::write(stopPipe[1], &stop, 1) == 1)
+		pthread_join(thread, NULL);
+	close(stopPipe[0]);
+	close(stopPipe[1]);
+	running = false;
+}
+
+
+void DeviceRegistry::discover(bool force)
+{
+	list<I2cDevice*> found;
+	list<I2cBackend*>::iterator backend;
+
+	pthread_mutex_lock(&discoveryMutex);
+	//a request which waited for a running discovery uses its result
+	if(!force && lastDiscovery != 0 && now() - lastDiscovery < I2C_DISCOVERY_MIN_INTERVAL)
+	{
+		pthread_mutex_unlock(&discoveryMutex);
+		return;
+	}
+
+	for(backend = backends->begin(); backend != backends->end(); ++backend)
+	{
+		try
+		{
+			(*backend)->findDevices(found);
+		}
+		catch(Error &e)
+		{
+			//a failed discovery keeps the known devices of the backend, the devices found before the error are dropped
+			while(!found.empty())
+			{
+				delete found.front();
+				found.pop_front();
+			}
+			continue;
+		}
+		replace((*backend)->getName(), found);
+	}
+
+	lastDiscovery = now();
+	pthread_mutex_unlock(&discoveryMutex);
+}
+
+
+bool DeviceRegistry::find(unsigned int uniqueId, const char* &name, int &port)
+{
+	map<unsigned int, Device>::iterator device;
+	bool result = false;
+
+	pthread_rwlock_rdlock(&devicesLock);
+	device = devices.find(uniqueId);
+	if(device != devices.end())
+	{
+		name = device->second.name;
+		port = device->second.port;
+		result = true;
+	}
+	pthread_rwlock_unlock(&devicesLock);
+	return result;
+}
+
+
+void DeviceRegistry::replace(const char* name, list<I2cDevice*> &found)
+{
+	map<unsigned int, Device>::iterator device;
+	Device entry;
+	unsigned int uniqueId = 0;
+
+	pthread_rwlock_wrlock(&devicesLock);
+	device = devices.begin();
+	while(device != devices.end())
+	{
+		if(strcmp(device->second.name, name) == 0)
+			devices.erase(device++);
+		else
+			++device;
+	}
+	while(!found.empty())
+	{
+		//the device which was registered first keeps the id, otherwise the next replace() of its backend would remove it
+		uniqueId = found.front()->getIdentification();
+		device = devices.find(uniqueId);
+		if(device != devices.end())
+		{
+			syslog(LOG_LOCAL2 | LOG_WARNING, "Device %u of %s is ignored, the id is already used by %s.", uniqueId, name,
+					device->second.name);
+		}
+		else
+		{
+			entry.name = name;
+			entry.port = found.front()->getPort();
+			devices[uniqueId] = entry;
+		}
+		delete found.front();
+		found.pop_front();
+	}
+	pthread_rwlock_unlock(&devicesLock);
+}
+
+
+void DeviceRegistry::getIds(const char* name, list<unsigned int> &ids)
+{
+	map<unsigned int, Device>::iterator device;
+
+	pthread_rwlock_rdlock(&devicesLock);
+	for(device = devices.begin(); device != devices.end(); ++device)
+	{
+		if(strcmp(device->second.name, name) == 0)
+			ids.push_back(device->first);
+	}
+	pthread_rwlock_unlock(&devicesLock);
+}
+
+
+void* DeviceRegistry::discoveryThread(void* arg)
+{
+	DeviceRegistry* registry = (DeviceRegistry*)arg;
+	struct pollfd fds[2];
+	char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event* event = NULL;
+	bool changed = false;
+	ssize_t length = 0;
+	unsigned long long current = 0;
+	unsigned long long next = now() + I2C_DISCOVERY_INTERVAL;
+	int watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	//without inotify, new devices are only found by the periodic discovery
+	if(watch >= 0 && inotify_add_watch(watch, I2C_DISCOVERY_WATCH_DIR, IN_CREATE | IN_DELETE) < 0)
+	{
+		close(watch);
+		watch = -1;
+	}
+
+	fds[0].fd = registry->stopPipe[0];
+	fds[0].events = POLLIN;
+	fds[1].fd = watch;
+	fds[1].events = POLLIN;
+
+	current = now();
+	registry->discover(true);
+	syslog(LOG_LOCAL2 | LOG_INFO, "Startup: device discovery %llu ms.", now() - current);
+
+	while(true)
+	{
+		current = now();
+		fds[0].revents = 0;
+		fds[1].revents = 0;
+		if(poll(fds, 2, next > current ? (int)(next - current) : 0) < 0)
+			continue;
+		if(fds[0].revents != 0)
+			break;
+
+		//only changes of i2c-dev adapters start an early discovery
+		changed = false;
+		if(fds[1].revents != 0)
+		{
+			while((length = read(watch, events, sizeof(events))) > 0)
+			{
+				for(char* entry = events; entry < events + length; entry += sizeof(struct inotify_event) + event->len)
+				{
+					event = (struct inotify_event*)entry;
+					if(event->len > 0 && strncmp(event->name, "i2c-", 4) == 0)
+						changed = true;
+				}
+			}
+		}
+		if(changed || now() >= next)
+		{
+			registry->discover(true);
+			next = now() + I2C_DISCOVERY_INTERVAL;
+		}
+	}
+
+	if(watch >= 0)
+		close(watch);
+	return NULL;
+}
+
+
+unsigned long long DeviceRegistry::now()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (unsigned long long)time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
@@ -2,15 +2,26 @@
 #include "unistd.h"
 #include "signal.h"
 #include "errno.h"
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
 
 
 #include <I2c.hpp>
 #include "I2cDevice.hpp"
+#include "AardvarkRsdBackend.hpp"
 #include "RemoteAardvark.hpp"
+#include "MsgPack.hpp"
 #include "allocators.h"
 
 
-I2c::I2c() : RPCInterface<I2c*, i2cfptr>(this)
+I2c::I2c(list<I2cBackend*>* sharedBackends, DeviceLockTable* sharedLocks, ReadCoalescer* sharedReads, I2cStats* sharedStats,
+		AsyncLog* sharedLog, Tracer* sharedTracer, Recorder* sharedRecorder, DeviceRegistry* sharedRegistry,
+		WorkspacePool* sharedWorkspaces, DeviceQueue* sharedQueue, SessionSweeper* sharedSweeper)
+		: RPCInterface<I2c*, i2cfptr>(this)
 {
 	i2cfptr fptr;
 
@@ -20,9 +31,73 @@ I2c::I2c() : RPCInterface<I2c*, i2cfptr>(this)
 	subResult = NULL;
 	requestId = NULL;
 	mainResponse = NULL;
-	json = new JsonRPC();
-	mainRequestDom = new Document();
-	subResponseDom = new Document();
+	workspace = NULL;
+	json = NULL;
+	mainRequestDom = NULL;
+	subResponseDom = NULL;
+	rsdBackend = NULL;
+	nextSessionToken = 1;
+	pthread_mutex_init(&sessionMutex, NULL);
+	pthread_mutex_init(&workspaceMutex, NULL);
+
+	//without a shared table, locks only work within this connection
+	ownLocks = NULL;
+	if(sharedLocks == NULL)
+		ownLocks = new DeviceLockTable();
+	locks = sharedLocks != NULL ? sharedLocks : ownLocks;
+
+	//without shared queues, only requests of this connection are queued
+	ownQueue = NULL;
+	if(sharedQueue == NULL)
+		ownQueue = new DeviceQueue();
+	queue = sharedQueue != NULL ? sharedQueue : ownQueue;
+
+	//without a shared coalescer, only reads of this connection are coalesced
+	ownReads = NULL;
+	if(sharedReads == NULL)
+		ownReads = new ReadCoalescer();
+	reads = sharedReads != NULL ? sharedReads : ownReads;
+
+	ownStats = NULL;
+	if(sharedStats == NULL)
+		ownStats = new I2cStats();
+	stats = sharedStats != NULL ? sharedStats : ownStats;
+	asyncLog = sharedLog;
+	tracer = sharedTracer;
+	recorder = sharedRecorder;
+	recordConnection = recorder != NULL ? recorder->nextConnection() : 0;
+	traceRequestId[0] = '\0';
+	traceDevice = -1;
+	retrySeed = (unsigned int)time(NULL) ^ (unsigned int)(size_t)this;
+
+	if(sharedBackends != NULL)
+		backends = *sharedBackends;
+
+	//without a shared registry, devices are only discovered when a client requests them
+	ownRegistry = NULL;
+	if(sharedRegistry == NULL)
+	{
+		registryBackends = backends;
+		ownRegistry = new DeviceRegistry(&registryBackends);
+	}
+	registry = sharedRegistry != NULL ? sharedRegistry : ownRegistry;
+
+	//the parser and DOMs are only borrowed while a request is processed
+	ownWorkspaces = NULL;
+	if(sharedWorkspaces == NULL)
+		ownWorkspaces = new WorkspacePool();
+	workspaces = sharedWorkspaces != NULL ? sharedWorkspaces : ownWorkspaces;
+	stats->countConnection(true);
+
+	//use the Aardvark-Plugin if there is no other backend for Aardvark devices
+	list<I2cBackend*>::iterator backend = backends.begin();
+	while(backend != backends.end() && strcmp((*backend)->getName(), "Aardvark") != 0)
+		++backend;
+	if(backend == backends.end())
+	{
+		rsdBackend = new AardvarkRsdBackend(this);
+		backends.push_front(rsdBackend);
+	}
 
 	//configure signal SIGUSR2 and timeout for receiving subresponses
 	sigemptyset(&set);
@@ -31,23 +106,48 @@ I2c::I2c() : RPCInterface<I2c*, i2cfptr>(this)
 	timeout.tv_nsec = 0;
 
 
-	fptr = &I2c::write;
-	funcMap.insert(pair<const char*, i2cfptr>("i2c.write", fptr));
-	fptr = &I2c::read;
-	funcMap.insert(pair<const char*, i2cfptr>("i2c.read", fptr));
-	fptr = &I2c::getAardvarkDevices;
-	funcMap.insert(pair<const char*, i2cfptr>("i2c.getAardvarkDevices", fptr));
-	fptr= &I2c::getI2cDevices;
-	funcMap.insert(pair<const char*, i2cfptr>("i2c.getI2cDevices", fptr));
+	//register all methods of the schema, funcMap is used for announcing the functions to RSD
+#define I2C_METHOD_REGISTER(id, name, function) \
+	fptr = &I2c::function; \
+	methods[id] = fptr; \
+	funcMap.insert(pair<const char*, i2cfptr>(name, fptr));
+	I2C_METHODS(I2C_METHOD_REGISTER)
+#undef I2C_METHOD_REGISTER
+
+	//the sweeper can call sweepIdleSessions() from now on
+	sweeper = sharedSweeper;
+	if(sweeper != NULL)
+		sweeper->add(this);
 }
 
 
 I2c::~I2c()
 {
-	delete json;
-	delete mainRequestDom;
-	delete subResponseDom;
-	deleteDeviceList();
+	map<unsigned int, Session*>::iterator session;
+
+	//waits for a running sweep of this instance
+	if(sweeper != NULL)
+		sweeper->remove(this);
+
+	//the connection is closed, so sessions of the Aardvark-Plugin are released by the plugin itself
+	for(session = sessions.begin(); session != sessions.end(); ++session)
+	{
+		if(session->second->backend != rsdBackend)
+			closeDeviceQuietly(session->second->device, session->second->backend, session->second->handle);
+		delete session->second;
+	}
+	locks->releaseAll(this);
+	queue->releaseAll(this);
+	delete ownLocks;
+	delete ownQueue;
+	delete ownReads;
+	stats->countConnection(false);
+	delete ownStats;
+	delete ownRegistry;
+	delete rsdBackend;
+	delete ownWorkspaces;
+	pthread_mutex_destroy(&sessionMutex);
+	pthread_mutex_destroy(&workspaceMutex);
 };
 
 
@@ -57,6 +157,24 @@ OutgoingMsg* I2c::process(IncomingMsg* input)
 	Value* params = NULL;
 	OutgoingMsg* output = NULL;
 	Value* requestMethod = NULL;
+	Value nullId;
+	const char* traceName = "process";
+	unsigned long long traceStart = tracer != NULL ? Tracer::now() : 0;
+
+	if(asyncLog != NULL)
+		asyncLog->log("in", input->getContent()->c_str(), input->getContent()->size());
+	if(recorder != NULL)
+		recorder->record(RECORD_MAIN_REQUEST, recordConnection, input->getContent()->c_str(), input->getContent()->size());
+
+	//the sweeper does not touch the sessions while a request is processed
+	pthread_mutex_lock(&sessionMutex);
+	pthread_mutex_lock(&workspaceMutex);
+	workspace = workspaces->acquire();
+	json = &workspace->json;
+	mainRequestDom = &workspace->mainRequestDom;
+	subResponseDom = &workspace->subResponseDom;
+	requestId = NULL;
+	pthread_mutex_unlock(&workspaceMutex);
 
 	try
 	{
@@ -66,8 +184,14 @@ OutgoingMsg* I2c::process(IncomingMsg* input)
 			setBusy(true);
 			requestMethod = json->tryTogetMethod(mainRequestDom);
 			params = json->tryTogetParams(mainRequestDom);
+			pthread_mutex_lock(&workspaceMutex);
 			requestId = json->getId(mainRequestDom);
-			executeFunction(*requestMethod, *params, result);
+			pthread_mutex_unlock(&workspaceMutex);
+			setTraceContext(*requestId, *params);
+			if(requestMethod->IsString())
+				traceName = requestMethod->GetString();
+			closeIdleSessions();
+			dispatch(*requestMethod, *params, result);
 			output = new OutgoingMsg(input->getOrigin(), mainResponse);
 			setBusy(false);
 		}
@@ -78,11 +202,31 @@ OutgoingMsg* I2c::process(IncomingMsg* input)
 	}
 	catch(Error &e)
 	{
-		error = json->generateResponseError(*requestId, e.getErrorCode(), e.get());
+		TraceSpan span(tracer, "rpc", "generateResponseError", traceRequestId, traceDevice);
+		error = json->generateResponseError(requestId != NULL ? *requestId : nullId, e.getErrorCode(), e.get());
 		output = new OutgoingMsg(input->getOrigin(), error);
 		setBusy(false);
 	}
+	//the method name points into the request DOM, which stays valid till the workspace is released
+	if(tracer != NULL)
+		tracer->record("rpc", traceName, traceStart, Tracer::now(), traceRequestId, traceDevice);
 	delete input;
+
+	//the response was copied into output, nothing points into the workspace anymore
+	pthread_mutex_lock(&workspaceMutex);
+	requestId = NULL;
+	json = NULL;
+	mainRequestDom = NULL;
+	subResponseDom = NULL;
+	workspaces->release(workspace);
+	workspace = NULL;
+	pthread_mutex_unlock(&workspaceMutex);
+	pthread_mutex_unlock(&sessionMutex);
+
+	if(asyncLog != NULL && output != NULL)
+		asyncLog->log("out", output->getContent()->c_str(), output->getContent()->size());
+	if(recorder != NULL && output != NULL)
+		recorder->record(RECORD_MAIN_RESPONSE, recordConnection, output->getContent()->c_str(), output->getContent()->size());
 	return output;
 }
 
@@ -92,6 +236,16 @@ bool I2c::isSubResponse(RPCMsg* rpcMsg)
 	bool result = false;
 	Value tempId;
 
+	//process() may finish the request and release the workspace at any time, so it is held till the parse is done
+	pthread_mutex_lock(&workspaceMutex);
+
+	//a response which arrives between two requests can not be a sub-response
+	if(requestId == NULL)
+	{
+		pthread_mutex_unlock(&workspaceMutex);
+		return false;
+	}
+
 	try
 	{
 		json->parse(subResponseDom, rpcMsg->getContent());
@@ -99,7 +253,14 @@ bool I2c::isSubResponse(RPCMsg* rpcMsg)
 		{
 			tempId.CopyFrom(*(json->getId(subResponseDom)), subResponseDom->GetAllocator());
 			if(tempId == *requestId)
+			{
 				result = true;
+				if(asyncLog != NULL)
+					asyncLog->log("sub-in", rpcMsg->getContent()->c_str(), rpcMsg->getContent()->size());
+				if(recorder != NULL)
+					recorder->record(RECORD_SUB_RESPONSE, recordConnection, rpcMsg->getContent()->c_str(),
+							rpcMsg->getContent()->size());
+			}
 			else
 				result = false;
 		}
@@ -108,6 +269,7 @@ bool I2c::isSubResponse(RPCMsg* rpcMsg)
 	{
 		result = false;
 	}
+	pthread_mutex_unlock(&workspaceMutex);
 	return result;
 }
 
@@ -115,11 +277,38 @@ bool I2c::isSubResponse(RPCMsg* rpcMsg)
 
 bool I2c::getI2cDevices(Value &params, Value &result)
 {
+	Value ids;
+	list<I2cBackend*>::iterator backend;
+	list<unsigned int> registryIds;
+	list<unsigned int>::iterator id;
+	rapidjson::MemoryPoolAllocator<> &allocator = json->getResponseDOM()->GetAllocator();
+
+	//a client which asks for the devices gets the current ones, not the ones of the last background discovery
+	registry->discover(true);
+	if(rsdBackend != NULL)
+	{
+		try
+		{
+			discoverRsdDevices();
+		}
+		catch(Error &e)
+		{
+			//skip the Aardvark-Plugin if it is not registered
+		}
+	}
 
-	getAardvarkDevices(params, result);
-	//.. call further methods for getting other devices
 	//generate jsonrpc rsponse like {..... "result" : {Aardvark : [id1, id2, idx] , OtherDevice : [id1, id2, idx]}}
-	mainResponse = json->generateResponse(*requestId, result);
+	result.SetObject();
+	for(backend = backends.begin(); backend != backends.end(); ++backend)
+	{
+		ids.SetArray();
+		registryIds.clear();
+		registry->getIds((*backend)->getName(), registryIds);
+		for(id = registryIds.begin(); id != registryIds.end(); ++id)
+			ids.PushBack(*id, allocator);
+		result.AddMember((*backend)->getName(), ids, allocator);
+	}
+	generateResponse(result);
 
 	return true;
 }
@@ -128,364 +317,1321 @@ bool I2c::getI2cDevices(Value &params, Value &result)
 
 bool I2c::getAardvarkDevices(Value &params, Value &result)
 {
-	//generate json rpc for aa_find_devices ext
-	Value method;
 	Value currentParam;
-	Value* i2cDeviceValue = NULL;
-	Value* i2cUniqueIdValue = NULL;
-	int num_devices = 0;
+	list<unsigned int> registryIds;
+	list<unsigned int>::iterator id;
+	I2cBackend* aardvark = getBackend("Aardvark");
 
-	//get the DOM for generating requests
+	//get the DOM for generating the result
 	Document* requestDom = json->getRequestDOM();
 
-	//Generate subRequest
-	method.SetString(_aa_find_devices_ext._name, requestDom->GetAllocator());
-	params.SetObject();
-	currentParam.SetString(_aa_find_devices_ext.paramArray[0]._name, requestDom->GetAllocator());
-	params.AddMember( currentParam, 256, requestDom->GetAllocator());
+	if(aardvark == rsdBackend)
+		discoverRsdDevices();
+	else
+		registry->discover(true);
 
+	currentParam.SetArray();
+	registry->getIds(aardvark->getName(), registryIds);
+	for(id = registryIds.begin(); id != registryIds.end(); ++id)
+		currentParam.PushBack(*id, requestDom->GetAllocator());
 
-	subRequest = json->generateRequest(method, params, *requestId);
+	result.SetObject();
+	result.AddMember("Aardvark", currentParam, requestDom->GetAllocator());
+	generateResponse(result);
+	return true;
+}
 
-	//Send subRequest and wait for subResponse
-	comPoint->transmit(subRequest, strlen(subRequest));
-    waitForResponse();
 
-	subResult = json->tryTogetResult(subResponseDom);
-	i2cDeviceValue = json->findObjectMember(*subResult, "devices");
-	i2cUniqueIdValue = json->findObjectMember(*subResult, "unique_ids");
-	num_devices = i2cDeviceValue->Size();
 
+bool I2c::write(Value &params, Value &result)
+{
+	I2cWriteParams writeParams;
+	I2cMessage message;
+	I2cBackend* backend = NULL;
+	int handle = -1;
 
-	currentParam.SetArray();
-	for(int i = 0; i < num_devices; i++)
+	try
+	{
+		I2cSchema::parse(params, writeParams);
+		//flags are optional
+		if(!writeParams.has_flags)
+			writeParams.flags = AA_I2C_NO_FLAGS;
+
+		handle = openDevice(writeParams.device, writeParams.has_bitrate, writeParams.bitrate, backend,
+				getPriority(writeParams.has_priority, writeParams.priority), writeParams.dataOut.size());
+
+		message.slaveAddr = writeParams.slaveAddr;
+		message.flags = writeParams.flags;
+		message.read = false;
+		message.data = writeParams.dataOut.empty() ? NULL : &writeParams.dataOut[0];
+		message.length = writeParams.dataOut.size();
+		message.count = 0;
+		transferWithRetry(backend, handle, &message, 1, writeParams.has_retries ? writeParams.retries : I2C_RETRY_DEFAULT_COUNT);
+		reads->invalidate(writeParams.device, writeParams.slaveAddr);
+		closeDevice(writeParams.device, backend, handle);
+
+		//generate mainResponse
+		result.SetObject();
+		result.AddMember("returnCode", "OK", json->getResponseDOM()->GetAllocator());
+		generateResponse(result);
+	}
+	catch(Error &e)
 	{
-		deviceList.push_back(new I2cDevice("Aardvark", (*i2cDeviceValue)[i].GetInt(), (*i2cUniqueIdValue)[i].GetUint()));
-		currentParam.PushBack((*i2cUniqueIdValue)[i].GetUint(), requestDom->GetAllocator());
+		//never leave the device open, a open Aardvark can not be opened by the next request
+		if(handle >= 0)
+		{
+			//a failed write can be partially executed
+			reads->invalidate(writeParams.device, writeParams.slaveAddr);
+			closeDeviceQuietly(writeParams.device, backend, handle);
+		}
+		throw;
 	}
+	return true;
+}
+
 
+bool I2c::read(Value &params, Value &result)
+{
+	I2cReadParams readParams;
+	ReadKey key;
+	ReadCoalescer::Flight* flight = NULL;
+	Value dataIn;
+	vector<unsigned char> data;
+	string encoded;
+	unsigned int count = 0;
+	bool leader = true;
+	rapidjson::MemoryPoolAllocator<> &responseAllocator = json->getResponseDOM()->GetAllocator();
 
 	result.SetObject();
-	result.AddMember("Aardvark", currentParam, requestDom->GetAllocator());
+
+	I2cSchema::parse(params, readParams);
+	data.resize(readParams.numBytes);
+
+	//the owner of a lock reads directly, it must not wait for a flight which waits for its lock
+	if(locks->isOwner(readParams.device, this))
+		count = readRegister(readParams, data);
+	else
+	{
+		key.device = readParams.device;
+		key.slaveAddr = readParams.slaveAddr;
+		key.memAddr = readParams.memAddr;
+		key.length = readParams.numBytes;
+		//a read at another bus speed is another transaction, a slave may answer differently
+		key.bitrate = readParams.has_bitrate ? readParams.bitrate : 0;
+
+		//identical reads of other clients share one bus transaction
+		flight = reads->join(key, readParams.has_maxAge ? readParams.maxAge : 0, leader);
+		if(leader)
+		{
+			try
+			{
+				count = readRegister(readParams, data);
+			}
+			catch(Error &e)
+			{
+				reads->fail(flight, e);
+				throw;
+			}
+			reads->complete(flight, data.empty() ? NULL : &data[0], count);
+		}
+		else
+		{
+			reads->wait(flight, data);
+			count = data.size();
+		}
+	}
+
+	//add the read bytes as member data_in to result of mainresponse, as base64 string if the client asked for it
+	if(readParams.has_encoding && strcmp(readParams.encoding, "base64") == 0)
+	{
+		Base64::encode(data.empty() ? NULL : &data[0], count, encoded);
+		dataIn.SetString(encoded.c_str(), encoded.size(), responseAllocator);
+	}
+	else
+	{
+		dataIn.SetArray();
+		for(unsigned int i = 0; i < count; i++)
+			dataIn.PushBack(data[i], responseAllocator);
+	}
+	result.AddMember("data_in", dataIn, responseAllocator);
+
+	result.AddMember("returnCode", "OK", responseAllocator);
+	generateResponse(result);
 	return true;
 }
 
 
+void I2c::yieldDevice(unsigned int uniqueId, bool hasBitrate, int bitrate, I2cBackend* backend, int &handle,
+		QueuePriority priority, unsigned int cost)
+{
+	I2cBackend* portBackend = NULL;
+	int port = getPortByUniqueId(uniqueId, portBackend);
+	int closedHandle = handle;
 
-bool I2c::write(Value &params, Value &result)
+	handle = -1;
+	try
+	{
+		backend->close(closedHandle);
+	}
+	catch(Error &e)
+	{
+		queue->leave(uniqueId, this);
+		locks->leave(uniqueId, this);
+		throw;
+	}
+	queue->leave(uniqueId, this);
+
+	//only the turn is given up, the lock of the device is still held
+	try
+	{
+		queue->enter(uniqueId, this, priority, cost);
+	}
+	catch(Error &e)
+	{
+		locks->leave(uniqueId, this);
+		throw;
+	}
+
+	try
+	{
+		handle = backend->open(port);
+	}
+	catch(Error &e)
+	{
+		queue->leave(uniqueId, this);
+		locks->leave(uniqueId, this);
+		throw;
+	}
+
+	//the target power stays on, but the bitrate may have been changed by a waiting request
+	if(hasBitrate)
+		backend->configure(handle, bitrate);
+}
+
+
+QueuePriority I2c::getPriority(bool hasPriority, const char* priority)
 {
+	return hasPriority && strcmp(priority, "bulk") == 0 ? QUEUE_BULK : QUEUE_INTERACTIVE;
+}
+
+
+unsigned int I2c::readRegister(I2cReadParams &readParams, vector<unsigned char> &data)
+{
+	I2cBackend* backend = NULL;
+	I2cMessage messages[2];
+	unsigned char memAddr = 0;
+	QueuePriority priority = getPriority(readParams.has_priority, readParams.priority);
+	//a read across register 0xFF depends on the slave, it is only correct as one transaction
+	bool split = priority == QUEUE_BULK && readParams.memAddr + data.size() <= 0x100;
+	unsigned int chunkSize = split ? I2C_BULK_CHUNK_SIZE : data.size();
+	unsigned int offset = 0;
+	unsigned int length = data.size() < chunkSize ? data.size() : chunkSize;
+	int handle = -1;
+
+	//write the register address, repeated start, read
+	messages[0].slaveAddr = readParams.slaveAddr;
+	messages[0].flags = AA_I2C_NO_FLAGS;
+	messages[0].read = false;
+	messages[0].data = &memAddr;
+	messages[0].length = 1;
+
+	messages[1].slaveAddr = readParams.slaveAddr;
+	messages[1].flags = AA_I2C_NO_FLAGS;
+	messages[1].read = true;
 
 	try
 	{
-		rapidjson::MemoryPoolAllocator<> &subRequestAllocator = json->getRequestDOM()->GetAllocator();
+		handle = openDevice(readParams.device, readParams.has_bitrate, readParams.bitrate, backend, priority, length);
 
-		//call subMethods
-		aa_open(params);
-		//param powerMask will be always the same, but is not send by mainRequest.
-		params.AddMember("powerMask", AA_TARGET_POWER_BOTH, subRequestAllocator);
-		aa_target_power(params);
-		aa_write(params);
-		aa_close(params);
+		//one transaction per chunk, a interactive read is one chunk
+		do
+		{
+			length = data.size() - offset < chunkSize ? data.size() - offset : chunkSize;
+
+			//a bulk read gives up the device between two chunks if other requests wait for it
+			if(offset > 0 && queue->hasWaiters(readParams.device))
+				yieldDevice(readParams.device, readParams.has_bitrate, readParams.bitrate, backend, handle, priority, length);
+
+			//every chunk is addressed, another client may have moved the register address of the slave
+			memAddr = readParams.memAddr + offset;
+			messages[0].count = 0;
+			messages[1].data = data.empty() ? NULL : &data[offset];
+			messages[1].length = length;
+			messages[1].count = 0;
+			transferWithRetry(backend, handle, messages, 2, readParams.has_retries ? readParams.retries : I2C_RETRY_DEFAULT_COUNT);
+			offset += messages[1].count;
+		}
+		while(messages[1].count == length && offset < data.size());
 
-		//generate mainResponse
-		result.SetObject();
-		result.AddMember("returnCode", "OK", json->getResponseDOM()->GetAllocator());
-		mainResponse = json->generateResponse(*requestId, result);
+		closeDevice(readParams.device, backend, handle);
 	}
 	catch(Error &e)
 	{
+		//never leave the device open, a open Aardvark can not be opened by the next request
+		if(handle >= 0)
+			closeDeviceQuietly(readParams.device, backend, handle);
 		throw;
 	}
+	return offset;
+}
+
+
+bool I2c::openSession(Value &params, Value &result)
+{
+	I2cOpenParams openParams;
+	I2cBackend* backend = NULL;
+	Session* session = NULL;
+	int handle = -1;
+
+	I2cSchema::parse(params, openParams);
+	handle = openDevice(openParams.device, openParams.has_bitrate, openParams.bitrate, backend);
+
+	session = new Session;
+	session->token = nextSessionToken++;
+	session->device = openParams.device;
+	session->backend = backend;
+	session->handle = handle;
+	session->lastUsed = now();
+	session->released = false;
+	sessions.insert(pair<unsigned int, Session*>(session->token, session));
+
+	result.SetObject();
+	result.AddMember("session", session->token, json->getResponseDOM()->GetAllocator());
+	generateResponse(result);
 	return true;
 }
 
 
-bool I2c::read(Value &params, Value &result)
+bool I2c::transfer(Value &params, Value &result)
 {
+	I2cTransferParams transferParams;
+	vector<I2cTransferOpParams> ops;
+	TransferPlan plan;
+	I2cMessage* message = NULL;
+	Value opResults;
+	Value opResult;
+	Value dataIn;
+	string encoded;
+	Session* session = NULL;
+	unsigned int first = 0;
+	unsigned int count = 0;
+	bool base64 = false;
+	rapidjson::MemoryPoolAllocator<> &responseAllocator = json->getResponseDOM()->GetAllocator();
+
+	//validate everything before the first op is executed
+	I2cSchema::parse(params, transferParams);
+	ops.resize(transferParams.ops->Size());
+	for(unsigned int i = 0; i < ops.size(); i++)
+		I2cSchema::parse((*transferParams.ops)[i], ops[i]);
+	base64 = transferParams.has_encoding && strcmp(transferParams.encoding, "base64") == 0;
+
+	session = getSession(transferParams.session);
+	traceDevice = session->device;
+	planTransfer(ops, plan);
+
 	try
 	{
-		Value data_out;
-		rapidjson::MemoryPoolAllocator<> &subRequestAllocator = json->getRequestDOM()->GetAllocator();
-		result.SetObject();
+		for(unsigned int i = 0; i < plan.messages.size(); i++)
+		{
+			if(plan.ends[i])
+			{
+				transferWithRetry(session->backend, session->handle, &plan.messages[first], i - first + 1,
+						transferParams.has_retries ? transferParams.retries : I2C_RETRY_DEFAULT_COUNT);
+				first = i + 1;
+			}
+		}
+	}
+	catch(Error &e)
+	{
+		invalidateReads(session->device, plan.messages);
+		throw;
+	}
+	invalidateReads(session->device, plan.messages);
+	session->lastUsed = now();
+
+	//one result for every op, even if several ops were merged into one message
+	opResults.SetArray();
+	for(unsigned int i = 0; i < ops.size(); i++)
+	{
+		message = &plan.messages[plan.opMessage[i]];
+		opResult.SetObject();
+		if(message->read)
+		{
+			if(base64)
+			{
+				encoded.clear();
+				Base64::encode(message->data, message->count, encoded);
+				dataIn.SetString(encoded.c_str(), encoded.size(), responseAllocator);
+			}
+			else
+			{
+				dataIn.SetArray();
+				for(unsigned int j = 0; j < message->count; j++)
+					dataIn.PushBack(message->data[j], responseAllocator);
+			}
+			opResult.AddMember("data_in", dataIn, responseAllocator);
+		}
+		else
+		{
+			count = 0;
+			if(message->count > plan.opOffset[i])
+				count = message->count - plan.opOffset[i];
+			if(count > ops[i].dataOut.size())
+				count = ops[i].dataOut.size();
+			opResult.AddMember("count", count, responseAllocator);
+		}
+		opResults.PushBack(opResult, responseAllocator);
+	}
+
+	result.SetObject();
+	result.AddMember("results", opResults, responseAllocator);
+	result.AddMember("returnCode", "OK", responseAllocator);
+	generateResponse(result);
+	return true;
+}
+
+
+void I2c::planTransfer(vector<I2cTransferOpParams> &ops, TransferPlan &plan)
+{
+	I2cMessage message;
+	unsigned int next = 0;
+	unsigned int nextAddr = 0;
+
+	plan.opMessage.resize(ops.size());
+	plan.opOffset.resize(ops.size());
+
+	for(unsigned int i = 0; i < ops.size(); i = next)
+	{
+		message.slaveAddr = ops[i].slaveAddr;
+		message.flags = ops[i].has_flags ? ops[i].flags : AA_I2C_NO_FLAGS;
+		message.read = strcmp(ops[i].op, "read") == 0;
+		message.count = 0;
+
+		plan.buffers.push_back(vector<unsigned char>());
+		vector<unsigned char> &buffer = plan.buffers.back();
+		plan.opMessage[i] = plan.messages.size();
+		next = i + 1;
+
+		if(message.read)
+		{
+			buffer.resize(ops[i].numBytes);
+			plan.opOffset[i] = 0;
+		}
+		else
+		{
+			if(ops[i].has_memAddr)
+				buffer.push_back((unsigned char)ops[i].memAddr);
+			plan.opOffset[i] = buffer.size();
+			buffer.insert(buffer.end(), ops[i].dataOut.begin(), ops[i].dataOut.end());
+
+			//append following writes to the next registers, the slave increments the register address by itself
+			if(isMergeableWrite(ops, i))
+			{
+				nextAddr = ops[i].memAddr + ops[i].dataOut.size();
+				while(next < ops.size() && isMergeableWrite(ops, next) && ops[next].slaveAddr == ops[i].slaveAddr
+						&& ops[next].has_flags == ops[i].has_flags && (!ops[i].has_flags || ops[next].flags == ops[i].flags)
+						&& ops[next].memAddr == nextAddr && isSamePage(ops[i], nextAddr + ops[next].dataOut.size() - 1)
+						&& buffer.size() + ops[next].dataOut.size() <= I2C_MAX_TRANSFER_SIZE + 1)
+				{
+					plan.opMessage[next] = plan.messages.size();
+					plan.opOffset[next] = buffer.size();
+					buffer.insert(buffer.end(), ops[next].dataOut.begin(), ops[next].dataOut.end());
+					nextAddr += ops[next].dataOut.size();
+					++next;
+				}
+			}
+		}
+
+		message.length = buffer.size();
+		plan.messages.push_back(message);
+		plan.ends.push_back(endsTransaction(ops, next - 1));
+	}
+
+	//buffers does not change anymore, so the pointers stay valid
+	for(unsigned int i = 0; i < plan.messages.size(); i++)
+		plan.messages[i].data = plan.buffers[i].empty() ? NULL : &plan.buffers[i][0];
+}
+
+
+bool I2c::isMergeableWrite(vector<I2cTransferOpParams> &ops, unsigned int index)
+{
+	//only a write which is a complete transaction by itself can be merged, without changing repeated starts
+	return strcmp(ops[index].op, "write") == 0 && ops[index].has_memAddr && !ops[index].dataOut.empty()
+			&& (index == 0 || endsTransaction(ops, index - 1)) && endsTransaction(ops, index);
+}
 
-		aa_open(params);
-		params.AddMember("powerMask", AA_TARGET_POWER_BOTH, subRequestAllocator);
-		aa_target_power(params);
 
-		data_out.SetArray();
-		data_out.PushBack(params["mem_addr"], subRequestAllocator);
-		params.AddMember("data_out", data_out, subRequestAllocator);
+bool I2c::endsTransaction(vector<I2cTransferOpParams> &ops, unsigned int index)
+{
+	return index == ops.size() - 1 || (ops[index].has_stop && ops[index].stop);
+}
+
+
+bool I2c::isSamePage(I2cTransferOpParams &first, unsigned int lastAddr)
+{
+	//the register address of the slave has 8 bit and wraps around at the end of a page
+	if(lastAddr > 0xFF)
+		return false;
+
+	if(!first.has_pageSize)
+		return true;
+
+	return first.memAddr / first.pageSize == lastAddr / first.pageSize;
+}
+
 
-		params.AddMember("AardvarkI2cFlags", AA_I2C_NO_STOP, subRequestAllocator);
-		aa_write(params);
+bool I2c::closeSession(Value &params, Value &result)
+{
+	I2cCloseParams closeParams;
+	Session* session = NULL;
 
-		params.EraseMember("AardvarkI2cFlags");
-		aa_read(params, result);
-		aa_close(params);
+	I2cSchema::parse(params, closeParams);
+	session = getSession(closeParams.session);
 
-		result.AddMember("returnCode", "OK", subRequestAllocator);
-		mainResponse = json->generateResponse(*requestId, result);
+	//the session is removed even if close fails, the handle is not usable anymore
+	sessions.erase(session->token);
+	try
+	{
+		closeDevice(session->device, session->backend, session->handle);
 	}
 	catch(Error &e)
 	{
+		delete session;
 		throw;
 	}
+	delete session;
+
+	result.SetObject();
+	result.AddMember("returnCode", "OK", json->getResponseDOM()->GetAllocator());
+	generateResponse(result);
 	return true;
 }
 
 
+bool I2c::lock(Value &params, Value &result)
+{
+	I2cLockParams lockParams;
+
+	I2cBackend* backend = NULL;
+
+	I2cSchema::parse(params, lockParams);
+	getPortByUniqueId(lockParams.device, backend);
+	locks->lock(lockParams.device, this, lockParams.has_lease ? lockParams.lease : I2C_LOCK_DEFAULT_LEASE);
+
+	result.SetObject();
+	result.AddMember("returnCode", "OK", json->getResponseDOM()->GetAllocator());
+	generateResponse(result);
+	return true;
+}
 
 
-void I2c::aa_open(Value &params)
+bool I2c::unlock(Value &params, Value &result)
 {
-	Value method;
-	Value localParams;
-	Value tempParam;
-	Value* subResultValue= NULL;
-	Value* deviceValue = NULL;
-	int device = 0;
+	I2cUnlockParams unlockParams;
 
+	I2cSchema::parse(params, unlockParams);
+	locks->unlock(unlockParams.device, this);
 
-	//Get exact method name
-	method.SetString(_aa_open._name, subRequestAllocator);
-	//Get all needed params
-	localParams.SetObject();
-	tempParam.SetString(_aa_open.paramArray[0]._name , subRequestAllocator);
-	//map "device" -> to "Aardvark"(_aa_open.paramArray[0]._name)
-	deviceValue = json->findObjectMember(params, "device");
-	device = getPortByUniqueId(deviceValue->GetUint());
-	localParams.AddMember(tempParam, device, subRequestAllocator);
-	subRequest = json->generateRequest(method, localParams, *requestId);
+	result.SetObject();
+	result.AddMember("returnCode", "OK", json->getResponseDOM()->GetAllocator());
+	generateResponse(result);
+	return true;
+}
 
-	//send subRequest, wait for subresponse and parse subResponse to localDom (not overwriting dom of I2c)
-	comPoint->transmit(subRequest, strlen(subRequest));
-	waitForResponse();
 
-	if(checkSubResult(subResponseDom))
+bool I2c::getStats(Value &params, Value &result)
+{
+	I2cStats::Counters counters;
+	Value counter;
+	Value busErrors;
+	Value memory;
+	Value queueMetrics;
+	Value depths;
+	Value depth;
+	DeviceQueue::Counters queueCounters;
+	map<unsigned int, unsigned int> queueDepths;
+	map<unsigned int, unsigned int>::iterator queueDepth;
+	unsigned int workspacesInUse = 0;
+	unsigned int idleWorkspaces = 0;
+	size_t idleWorkspaceBytes = 0;
+	rapidjson::MemoryPoolAllocator<> &responseAllocator = json->getResponseDOM()->GetAllocator();
+
+	stats->get(counters);
+	workspaces->getUsage(workspacesInUse, idleWorkspaces, idleWorkspaceBytes);
+	queue->get(queueCounters);
+	queue->getDepths(queueDepths);
+
+	result.SetObject();
+	counter.SetUint64(counters.transactions);
+	result.AddMember("transactions", counter, responseAllocator);
+	counter.SetUint64(counters.retries);
+	result.AddMember("retries", counter, responseAllocator);
+	counter.SetUint64(counters.recovered);
+	result.AddMember("recovered", counter, responseAllocator);
+	counter.SetUint64(counters.exhausted);
+	result.AddMember("exhausted", counter, responseAllocator);
+
+	busErrors.SetObject();
+	for(int status = AA_I2C_STATUS_OK + 1; status < I2C_NUMBER_OF_BUS_STATUS; status++)
 	{
-		subResult = json->tryTogetResult(subResponseDom);
-		subResultValue = json->findObjectMember(*subResult, "Aardvark", kNumberType);
+		counter.SetUint64(counters.busErrors[status]);
+		busErrors.AddMember(I2cStats::getStatusName(status), counter, responseAllocator);
+	}
+	result.AddMember("busErrors", busErrors, responseAllocator);
+
+	//memory of a idle connection, the workspaces are only held while requests are processed
+	memory.SetObject();
+	counter.SetUint64(counters.connections);
+	memory.AddMember("connections", counter, responseAllocator);
+	counter.SetUint64(sizeof(I2c) + sessions.size() * sizeof(Session));
+	memory.AddMember("connectionBytes", counter, responseAllocator);
+	memory.AddMember("workspacesInUse", workspacesInUse, responseAllocator);
+	memory.AddMember("idleWorkspaces", idleWorkspaces, responseAllocator);
+	counter.SetUint64(idleWorkspaceBytes);
+	memory.AddMember("idleWorkspaceBytes", counter, responseAllocator);
+	result.AddMember("memory", memory, responseAllocator);
+
+	queueMetrics.SetObject();
+	queueMetrics.AddMember("waiting", queueCounters.waiting, responseAllocator);
+	queueMetrics.AddMember("maxWaiting", queueCounters.maxWaiting, responseAllocator);
+	counter.SetUint64(queueCounters.admitted);
+	queueMetrics.AddMember("admitted", counter, responseAllocator);
+	counter.SetUint64(queueCounters.queued);
+	queueMetrics.AddMember("queued", counter, responseAllocator);
+	counter.SetUint64(queueCounters.rejected);
+	queueMetrics.AddMember("rejected", counter, responseAllocator);
+	counter.SetUint64(queueCounters.timedOut);
+	queueMetrics.AddMember("timedOut", counter, responseAllocator);
+	depths.SetArray();
+	for(queueDepth = queueDepths.begin(); queueDepth != queueDepths.end(); ++queueDepth)
+	{
+		depth.SetObject();
+		depth.AddMember("device", queueDepth->first, responseAllocator);
+		depth.AddMember("waiting", queueDepth->second, responseAllocator);
+		depths.PushBack(depth, responseAllocator);
+	}
+	queueMetrics.AddMember("devices", depths, responseAllocator);
+	result.AddMember("queue", queueMetrics, responseAllocator);
 
-		if(subResultValue->GetInt() < 0)
-			throw Error(subResponse);
-		else
-			params.AddMember("Aardvark", subResultValue->GetInt(), subRequestAllocator);
+	result.AddMember("returnCode", "OK", responseAllocator);
+	generateResponse(result);
+	return true;
+}
+
+
+bool I2c::scan(Value &params, Value &result)
+{
+	I2cScanParams scanParams;
+	vector<ScanJob> jobs;
+	vector<pair<unsigned int, unsigned int> > openOrder;
+	vector<pthread_t> threads;
+	vector<bool> started;
+	Value devices;
+	Value device;
+	Value addresses;
+	Value errorMsg;
+	rapidjson::MemoryPoolAllocator<> &responseAllocator = json->getResponseDOM()->GetAllocator();
+
+	I2cSchema::parse(params, scanParams);
+
+	if(scanParams.has_devices)
+	{
+		jobs.resize(scanParams.devices->Size());
+		for(unsigned int i = 0; i < jobs.size(); i++)
+			jobs[i].device = (*scanParams.devices)[i].GetUint();
 	}
 	else
 	{
-		throw Error("todo");
+		jobs.resize(1);
+		jobs[0].device = scanParams.device;
+	}
+
+	for(unsigned int i = 0; i < jobs.size(); i++)
+	{
+		//unknown devices fail before the first device is opened
+		getPortByUniqueId(jobs[i].device, jobs[i].backend);
+		jobs[i].backend = NULL;
+		jobs[i].handle = -1;
+		jobs[i].first = scanParams.has_first ? scanParams.first : I2C_SCAN_FIRST_ADDR;
+		jobs[i].last = scanParams.has_last ? scanParams.last : I2C_SCAN_LAST_ADDR;
+		jobs[i].read = scanParams.has_mode && strcmp(scanParams.mode, "read") == 0;
+		jobs[i].failed = false;
+	}
+
+	//all devices are held till every scan is finished, opening them in the order of the unique ids prevents a deadlock
+	//with a concurrent scan of the same devices in another order, the response keeps the order of the request
+	for(unsigned int i = 0; i < jobs.size(); i++)
+		openOrder.push_back(make_pair(jobs[i].device, i));
+	sort(openOrder.begin(), openOrder.end());
+
+	//a device which can not be opened is reported, the other devices are still scanned
+	for(unsigned int j = 0; j < openOrder.size(); j++)
+	{
+		unsigned int i = openOrder[j].second;
+		try
+		{
+			jobs[i].handle = openDevice(jobs[i].device, scanParams.has_bitrate, scanParams.bitrate, jobs[i].backend,
+					getPriority(scanParams.has_priority, scanParams.priority), jobs[i].last - jobs[i].first + 1);
+		}
+		catch(Error &e)
+		{
+			jobs[i].failed = true;
+			jobs[i].error = e.get();
+		}
+	}
+
+	//sub-requests to the Aardvark-Plugin can only be send by this thread, all other backends are thread-safe
+	threads.resize(jobs.size());
+	started.resize(jobs.size(), false);
+	for(unsigned int i = 0; i < jobs.size(); i++)
+	{
+		if(jobs[i].handle >= 0 && jobs[i].backend != rsdBackend)
+			started[i] = pthread_create(&threads[i], NULL, scanThread, &jobs[i]) == 0;
+	}
+	for(unsigned int i = 0; i < jobs.size(); i++)
+	{
+		if(jobs[i].handle >= 0 && !started[i])
+			scanDevice(jobs[i]);
 	}
+	for(unsigned int i = 0; i < jobs.size(); i++)
+	{
+		if(started[i])
+			pthread_join(threads[i], NULL);
+	}
+
+	for(unsigned int i = 0; i < jobs.size(); i++)
+	{
+		if(jobs[i].handle < 0)
+			continue;
+		try
+		{
+			closeDevice(jobs[i].device, jobs[i].backend, jobs[i].handle);
+		}
+		catch(Error &e)
+		{
+			if(!jobs[i].failed)
+			{
+				jobs[i].failed = true;
+				jobs[i].error = e.get();
+			}
+		}
+	}
+
+	devices.SetArray();
+	for(unsigned int i = 0; i < jobs.size(); i++)
+	{
+		device.SetObject();
+		device.AddMember("device", jobs[i].device, responseAllocator);
+		addresses.SetArray();
+		for(unsigned int j = 0; j < jobs[i].addresses.size(); j++)
+			addresses.PushBack(jobs[i].addresses[j], responseAllocator);
+		device.AddMember("addresses", addresses, responseAllocator);
+		if(jobs[i].failed)
+		{
+			errorMsg.SetString(jobs[i].error.c_str(), jobs[i].error.size(), responseAllocator);
+			device.AddMember("error", errorMsg, responseAllocator);
+		}
+		devices.PushBack(device, responseAllocator);
+	}
+
+	result.SetObject();
+	result.AddMember("devices", devices, responseAllocator);
+	result.AddMember("returnCode", "OK", responseAllocator);
+	generateResponse(result);
+	return true;
 }
 
 
-void I2c::aa_target_power(Value &params)
+bool I2c::trace(Value &params, Value &result)
 {
-	Value method;
-	Value localParams;
-	Value tempParam;
-	Value* subResultValue= NULL;
+	I2cTraceParams traceParams;
 
-	localParams.SetObject();
-	Value* valuePtr = json->findObjectMember(params, _aa_target_power.paramArray[0]._name);
+	I2cSchema::parse(params, traceParams);
+	if(tracer == NULL)
+		throw Error("Tracing is not available.");
+	tracer->enable(traceParams.enable);
 
-	//Aardvark handle
-	tempParam.SetString(_aa_target_power.paramArray[0]._name, subRequestAllocator);
-	localParams.AddMember(tempParam, valuePtr->GetInt(), subRequestAllocator);
+	result.SetObject();
+	result.AddMember("returnCode", "OK", json->getResponseDOM()->GetAllocator());
+	generateResponse(result);
+	return true;
+}
 
-	//powerMask
-	valuePtr = json->findObjectMember(params, _aa_target_power.paramArray[1]._name);
-	tempParam.SetString(_aa_target_power.paramArray[1]._name, subRequestAllocator);
-	localParams.AddMember(tempParam, valuePtr->GetInt(), subRequestAllocator);
 
-	//methodname
-	method.SetString(_aa_target_power._name, subRequestAllocator);
+bool I2c::dumpTrace(Value &params, Value &result)
+{
+	unsigned int count = 0;
+	rapidjson::MemoryPoolAllocator<> &responseAllocator = json->getResponseDOM()->GetAllocator();
 
-	subRequest = json->generateRequest(method, localParams, *requestId);
+	if(tracer == NULL)
+		throw Error("Tracing is not available.");
+	count = tracer->dump(I2C_TRACE_FILE);
 
-	comPoint->transmit(subRequest, strlen(subRequest));
-	waitForResponse();
+	result.SetObject();
+	result.AddMember("file", I2C_TRACE_FILE, responseAllocator);
+	result.AddMember("spans", count, responseAllocator);
+	result.AddMember("returnCode", "OK", responseAllocator);
+	generateResponse(result);
+	return true;
+}
 
 
-	subResult = json->tryTogetResult(subResponseDom);
+bool I2c::spiTransfer(Value &params, Value &result)
+{
+	I2cSpiTransferParams transferParams;
+	SpiJob job;
+	Value dataIn;
+	rapidjson::MemoryPoolAllocator<> &responseAllocator = json->getResponseDOM()->GetAllocator();
+
+	I2cSchema::parse(params, transferParams);
+	setSpiSettings(transferParams, job);
 
-	subResultValue = json->findObjectMember(*subResult, "returnCode", kNumberType);
+	job.ops.resize(1);
+	job.ops[0].dataIn.resize(transferParams.has_numBytes ? transferParams.numBytes : transferParams.dataOut.size());
+	job.ops[0].dataOut.swap(transferParams.dataOut);
+	executeSpi(job);
 
-	if(subResultValue->GetInt() < 0)
+	encodeSpiData(job.ops[0], job.base64, dataIn);
+	result.SetObject();
+	result.AddMember("data_in", dataIn, responseAllocator);
+	result.AddMember("returnCode", "OK", responseAllocator);
+	generateResponse(result);
+	return true;
+}
+
+
+bool I2c::spiBatch(Value &params, Value &result)
+{
+	I2cSpiBatchParams batchParams;
+	I2cSpiOpParams opParams;
+	SpiJob job;
+	Value opResults;
+	Value opResult;
+	Value dataIn;
+	rapidjson::MemoryPoolAllocator<> &responseAllocator = json->getResponseDOM()->GetAllocator();
+
+	//validate everything before the device is opened
+	I2cSchema::parse(params, batchParams);
+	setSpiSettings(batchParams, job);
+	job.ops.resize(batchParams.ops->Size());
+	for(unsigned int i = 0; i < job.ops.size(); i++)
 	{
-		throw Error("Could not open Aardvark.");
+		I2cSchema::parse((*batchParams.ops)[i], opParams);
+		job.ops[i].dataIn.resize(opParams.has_numBytes ? opParams.numBytes : opParams.dataOut.size());
+		job.ops[i].dataOut.swap(opParams.dataOut);
 	}
+	executeSpi(job);
+
+	opResults.SetArray();
+	for(unsigned int i = 0; i < job.ops.size(); i++)
+	{
+		encodeSpiData(job.ops[i], job.base64, dataIn);
+		opResult.SetObject();
+		opResult.AddMember("data_in", dataIn, responseAllocator);
+		opResults.PushBack(opResult, responseAllocator);
+	}
+
+	result.SetObject();
+	result.AddMember("results", opResults, responseAllocator);
+	result.AddMember("returnCode", "OK", responseAllocator);
+	generateResponse(result);
+	return true;
+}
+
+
+template<class SpiParams> void I2c::setSpiSettings(SpiParams &params, SpiJob &job)
+{
+	job.device = params.device;
+	job.hasBitrate = params.has_bitrate;
+	job.bitrate = params.bitrate;
+	job.polarity = params.has_polarity ? params.polarity : AA_SPI_POL_RISING_FALLING;
+	job.phase = params.has_phase ? params.phase : AA_SPI_PHASE_SAMPLE_SETUP;
+	job.bitorder = params.has_bitorder ? params.bitorder : AA_SPI_BITORDER_MSB;
+	job.ssPolarity = params.has_ssPolarity ? params.ssPolarity : AA_SPI_SS_ACTIVE_LOW;
+	job.priority = getPriority(params.has_priority, params.priority);
+	job.base64 = params.has_encoding && strcmp(params.encoding, "base64") == 0;
 }
 
 
-void I2c::aa_write(Value &params)
+void I2c::executeSpi(SpiJob &job)
 {
-	Value method;
-	Value localParams;
-	Value tempParam;
-	Value array;
-	Value* valuePtr = NULL;
-	Value* subResultValue= NULL;
+	I2cBackend* backend = NULL;
+	unsigned int cost = 0;
+	int handle = -1;
+
+	//a SPI transfer shifts the longer of both directions
+	for(unsigned int i = 0; i < job.ops.size(); i++)
+		cost += job.ops[i].dataOut.size() > job.ops[i].dataIn.size() ? job.ops[i].dataOut.size() : job.ops[i].dataIn.size();
+
+	try
+	{
+		//the I²C bitrate is not touched, the device may be shared with I²C requests
+		handle = openDevice(job.device, false, 0, backend, job.priority, cost);
+		backend->spiConfigure(handle, job.polarity, job.phase, job.bitorder, job.ssPolarity);
+		if(job.hasBitrate)
+			backend->spiBitrate(handle, job.bitrate);
 
+		for(unsigned int i = 0; i < job.ops.size(); i++)
+		{
+			SpiOp &op = job.ops[i];
+			op.count = backend->spiWrite(handle, &op.dataOut[0], op.dataOut.size(), op.dataIn.empty() ? NULL : &op.dataIn[0],
+					op.dataIn.size());
+		}
+		closeDevice(job.device, backend, handle);
+	}
+	catch(Error &e)
+	{
+		//never leave the device open, a open Aardvark can not be opened by the next request
+		if(handle >= 0)
+			closeDeviceQuietly(job.device, backend, handle);
+		throw;
+	}
+}
 
-	localParams.SetObject();
-	//get Aardvark handle
-	valuePtr = json->findObjectMember(params, _aa_i2c_write.paramArray[0]._name);
-	tempParam.SetString(_aa_i2c_write.paramArray[0]._name, subRequestAllocator);
-	localParams.AddMember(tempParam, valuePtr->GetInt(), subRequestAllocator);
 
-	//get slave addr
-	valuePtr = json->findObjectMember(params, _aa_i2c_write.paramArray[1]._name);
-	tempParam.SetString(_aa_i2c_write.paramArray[1]._name, subRequestAllocator);
-	localParams.AddMember(tempParam, valuePtr->GetInt(), subRequestAllocator);
+void I2c::encodeSpiData(SpiOp &op, bool base64, Value &dataIn)
+{
+	string encoded;
+	rapidjson::MemoryPoolAllocator<> &responseAllocator = json->getResponseDOM()->GetAllocator();
 
-	//get flags, flags are optional
-	tempParam.SetString(_aa_i2c_write.paramArray[2]._name, subRequestAllocator);
-	if(params.HasMember(_aa_i2c_write.paramArray[2]._name))
+	if(base64)
 	{
-		valuePtr = json->findObjectMember(params, _aa_i2c_write.paramArray[2]._name);
-		localParams.AddMember(tempParam, valuePtr->GetInt(), subRequestAllocator);
+		Base64::encode(op.dataIn.empty() ? NULL : &op.dataIn[0], op.count, encoded);
+		dataIn.SetString(encoded.c_str(), encoded.size(), responseAllocator);
 	}
 	else
-		localParams.AddMember(tempParam, AA_I2C_NO_FLAGS, subRequestAllocator);
+	{
+		dataIn.SetArray();
+		for(unsigned int i = 0; i < op.count; i++)
+			dataIn.PushBack(op.dataIn[i], responseAllocator);
+	}
+}
 
-	//get data
-	valuePtr = json->findObjectMember(params, _aa_i2c_write.paramArray[3]._name);
-	tempParam.SetString(_aa_i2c_write.paramArray[3]._name, subRequestAllocator);
-	localParams.AddMember(tempParam, *valuePtr, subRequestAllocator);
 
-	method.SetString(_aa_i2c_write._name, subRequestAllocator);
-	subRequest = json->generateRequest(method, localParams, *requestId);
+int I2c::openDevice(unsigned int uniqueId, bool hasBitrate, int bitrate, I2cBackend* &backend, QueuePriority priority,
+		unsigned int cost)
+{
+	int port = 0;
+	int handle = 0;
 
-	comPoint->transmit(subRequest, strlen(subRequest));
-	waitForResponse();
+	port = getPortByUniqueId(uniqueId, backend);
 
+	//waits while another client has locked the device
+	locks->enter(uniqueId, this);
+	try
+	{
+		//waits for the turn, or fails at once if too many requests wait for the device
+		queue->enter(uniqueId, this, priority, cost);
+	}
+	catch(Error &e)
+	{
+		locks->leave(uniqueId, this);
+		throw;
+	}
 
-	subResult = json->tryTogetResult(subResponseDom);
-	subResultValue = json->findObjectMember(*subResult, "returnCode", kNumberType);
+	try
+	{
+		handle = backend->open(port);
+	}
+	catch(Error &e)
+	{
+		queue->leave(uniqueId, this);
+		locks->leave(uniqueId, this);
+		throw;
+	}
 
-	if(subResultValue->GetInt() < 0)
-		throw Error("Could not open Aardvark.");
+	try
+	{
+		//param powerMask will be always the same, but is not send by mainRequest.
+		backend->targetPower(handle, AA_TARGET_POWER_BOTH);
 
+		if(hasBitrate)
+			backend->configure(handle, bitrate);
+	}
+	catch(Error &e)
+	{
+		closeDeviceQuietly(uniqueId, backend, handle);
+		throw;
+	}
+
+	return handle;
+}
+
+
+void I2c::closeDevice(unsigned int uniqueId, I2cBackend* backend, int &handle)
+{
+	int closedHandle = handle;
+
+	//the handle is invalid after the first try, even if close fails
+	handle = -1;
+	try
+	{
+		backend->close(closedHandle);
+	}
+	catch(Error &e)
+	{
+		queue->leave(uniqueId, this);
+		locks->leave(uniqueId, this);
+		throw;
+	}
+	queue->leave(uniqueId, this);
+	locks->leave(uniqueId, this);
 }
 
 
-void I2c::aa_read(Value &params, Value &result)
+void I2c::closeDeviceQuietly(unsigned int uniqueId, I2cBackend* backend, int handle)
 {
-	Value method;
-	Value localParams;
-	Value tempParam;
-	Value array;
-	Value* valuePtr = NULL;
-	Value* subResultValue= NULL;
+	try
+	{
+		backend->close(handle);
+	}
+	catch(Error &e)
+	{
+		//the original error is more important for the client
+	}
+	queue->leave(uniqueId, this);
+	locks->leave(uniqueId, this);
+}
 
-	rapidjson::MemoryPoolAllocator<> &subRequestAllocator = json->getRequestDOM()->GetAllocator();
 
+void I2c::dispatch(Value &method, Value &params, Value &result)
+{
+	I2cMethod id = I2cSchema::findMethod(method);
 
-	localParams.SetObject();
-	//get Aardvark handle
-	valuePtr = json->findObjectMember(params, _aa_i2c_read.paramArray[0]._name);
-	tempParam.SetString(_aa_i2c_read.paramArray[0]._name, subRequestAllocator);
-	localParams.AddMember(tempParam, valuePtr->GetInt(), subRequestAllocator);
+	if(id == I2C_NUMBER_OF_METHODS)
+		throw Error("Method not found.");
 
-	//get slave addr
-	valuePtr = json->findObjectMember(params, _aa_i2c_read.paramArray[1]._name);
-	tempParam.SetString(_aa_i2c_read.paramArray[1]._name, subRequestAllocator);
-	localParams.AddMember(tempParam, valuePtr->GetInt(), subRequestAllocator);
+	(this->*methods[id])(params, result);
+}
 
 
-	//get flags, flags are optional
-	tempParam.SetString(_aa_i2c_write.paramArray[2]._name, subRequestAllocator);
-	if(params.HasMember(_aa_i2c_write.paramArray[2]._name))
+void I2c::invalidateReads(unsigned int device, vector<I2cMessage> &messages)
+{
+	for(unsigned int i = 0; i < messages.size(); i++)
 	{
-		valuePtr = json->findObjectMember(params, _aa_i2c_write.paramArray[2]._name);
-		localParams.AddMember(tempParam, valuePtr->GetInt(), subRequestAllocator);
+		if(!messages[i].read)
+			reads->invalidate(device, messages[i].slaveAddr);
 	}
-	else
-		localParams.AddMember(tempParam, AA_I2C_NO_FLAGS, subRequestAllocator);
+}
 
 
-	//num_bytes
-	valuePtr = json->findObjectMember(params, _aa_i2c_read.paramArray[3]._name);
-	tempParam.SetString(_aa_i2c_read.paramArray[3]._name, subRequestAllocator);
-	localParams.AddMember(tempParam, valuePtr->GetInt(), subRequestAllocator);
+void I2c::transferWithRetry(I2cBackend* backend, int handle, I2cMessage* messages, unsigned int numMessages, unsigned int retries)
+{
+	unsigned int attempt = 0;
+	unsigned int backoff = 0;
+	int status = AA_I2C_STATUS_OK;
+
+	while(true)
+	{
+		stats->countTransaction();
+		try
+		{
+			backend->transfer(handle, messages, numMessages);
+			if(attempt > 0)
+				stats->countRecovered();
+			return;
+		}
+		catch(Error &e)
+		{
+			status = getBusStatus(e);
+			if(status == AA_I2C_STATUS_OK)
+				throw;
+			if((I2C_RETRY_STATUS_MASK & (1 << status)) == 0)
+			{
+				stats->countBusError(status, false);
+				throw;
+			}
+			if(attempt >= retries)
+			{
+				stats->countBusError(status, false);
+				if(attempt > 0)
+					stats->countExhausted();
+				throw;
+			}
+			stats->countBusError(status, true);
+		}
 
-	method.SetString(_aa_i2c_read._name, subRequestAllocator);
-	subRequest = json->generateRequest(method, localParams, *requestId);
+		//the device stays open, only the failed transaction is repeated
+		backoff = I2C_RETRY_BACKOFF_MAX;
+		if(attempt < 16 && (I2C_RETRY_BACKOFF_BASE << attempt) < I2C_RETRY_BACKOFF_MAX)
+			backoff = I2C_RETRY_BACKOFF_BASE << attempt;
+		usleep(backoff / 2 + rand_r(&retrySeed) % (backoff / 2 + 1));
+		++attempt;
+	}
+}
 
-	comPoint->transmit(subRequest, strlen(subRequest));
-	waitForResponse();
 
+int I2c::getBusStatus(Error &error)
+{
+	int status = I2C_BUS_ERROR_BASE - error.getErrorCode();
 
-	subResult = json->tryTogetResult(subResponseDom);
-	subResultValue = json->findObjectMember(*subResult, "returnCode", kNumberType);
+	if(status <= AA_I2C_STATUS_OK || status >= I2C_NUMBER_OF_BUS_STATUS)
+		return AA_I2C_STATUS_OK;
 
-	if(subResultValue->GetInt() < 0)
-		throw Error("Could not open Aardvark.");
+	return status;
+}
 
-	//add member data_in from subresponse to result of mainresponse
-	subResultValue = json->findObjectMember(*subResult, "data_in", kArrayType);
-	result.AddMember("data_in", *subResultValue, subRequestAllocator);
 
+void I2c::scanDevice(ScanJob &job)
+{
+	I2cMessage message;
+	unsigned char byte = 0;
+	int status = AA_I2C_STATUS_OK;
+
+	message.flags = AA_I2C_NO_FLAGS;
+	message.read = job.read;
+	message.data = job.read ? &byte : NULL;
+	message.length = job.read ? 1 : 0;
+
+	for(int slaveAddr = job.first; slaveAddr <= job.last; slaveAddr++)
+	{
+		message.slaveAddr = slaveAddr;
+		message.count = 0;
+		try
+		{
+			job.backend->transfer(job.handle, &message, 1);
+			//a read of a missing slave can also return without error, but without the byte
+			if(!job.read || message.count > 0)
+				job.addresses.push_back(slaveAddr);
+		}
+		catch(Error &e)
+		{
+			//a NACK only means that there is no slave with this address
+			status = getBusStatus(e);
+			if(status != AA_I2C_STATUS_SLA_NACK && status != AA_I2C_STATUS_DATA_NACK)
+			{
+				job.failed = true;
+				job.error = e.get();
+				return;
+			}
+		}
+	}
 }
 
 
+void* I2c::scanThread(void* arg)
+{
+	scanDevice(*(ScanJob*)arg);
+	return NULL;
+}
 
 
-void I2c::aa_close(Value &params)
+void I2c::generateResponse(Value &result)
 {
-	Value method;
-	Value localParams;
-	Value* subResultValue= NULL;
+	TraceSpan span(tracer, "rpc", "generateResponse", traceRequestId, traceDevice);
 
-	Value* deviceValue = NULL;
-	Value tempParam;
+	mainResponse = json->generateResponse(*requestId, result);
+}
 
-	//Get exact method name
-	method.SetString(_aa_close._name, subRequestAllocator);
-	//Get all needed params
-	localParams.SetObject();
-	tempParam.SetString(_aa_close.paramArray[0]._name , subRequestAllocator);
 
-	deviceValue = json->findObjectMember(params, _aa_close.paramArray[0]._name);
-	localParams.AddMember(tempParam, *deviceValue, subRequestAllocator);
+void I2c::setTraceContext(Value &id, Value &params)
+{
+	traceRequestId[0] = '\0';
+	traceDevice = -1;
+	if(tracer == NULL || !tracer->isEnabled())
+		return;
+
+	if(id.IsString())
+		snprintf(traceRequestId, sizeof(traceRequestId), "%s", id.GetString());
+	else if(id.IsInt64())
+		snprintf(traceRequestId, sizeof(traceRequestId), "%lld", id.GetInt64());
+	else if(id.IsUint64())
+		snprintf(traceRequestId, sizeof(traceRequestId), "%llu", id.GetUint64());
+
+	if(params.IsObject() && params.HasMember("device") && params["device"].IsUint())
+		traceDevice = params["device"].GetUint();
+}
 
-	subRequest = json->generateRequest(method, localParams, *requestId);
 
-	//send subRequest, wait for subresponse and parse subResponse to localDom (not overwriting dom of I2c)
-	comPoint->transmit(subRequest, strlen(subRequest));
-	waitForResponse();
+I2c::Session* I2c::getSession(unsigned int token)
+{
+	map<unsigned int, Session*>::iterator session = sessions.find(token);
 
+	if(session == sessions.end())
+		throw Error("Unknown session, use i2c.open to get a session.");
 
-	json->tryTogetResult(subResponseDom);
+	session->second->lastUsed = now();
+	return session->second;
+}
 
-	subResultValue = json->findObjectMember(*subResult, "returnCode", kNumberType);
 
+void I2c::closeIdleSessions()
+{
+	map<unsigned int, Session*>::iterator session = sessions.begin();
+	time_t currentTime = now();
 
-	if(subResultValue->GetInt() < 0)
+	while(session != sessions.end())
 	{
-		throw Error("Could not close Aardvark.");
+		if(currentTime - session->second->lastUsed >= I2C_SESSION_IDLE_TIMEOUT)
+		{
+			if(session->second->released)
+			{
+				//the sweeper already released the device within the lock table and the queue
+				try
+				{
+					session->second->backend->close(session->second->handle);
+				}
+				catch(Error &e)
+				{
+				}
+			}
+			else
+				closeDeviceQuietly(session->second->device, session->second->backend, session->second->handle);
+			delete session->second;
+			sessions.erase(session++);
+		}
+		else
+			++session;
 	}
-	else
-		params.AddMember("returnCode", subResultValue->GetInt(), subRequestAllocator);
 }
 
 
-int I2c::getPortByUniqueId(unsigned int uniqueId)
+void I2c::sweepIdleSessions()
 {
-	list<I2cDevice*>::iterator device = deviceList.begin();
-	unsigned int result = -1;
+	map<unsigned int, Session*>::iterator session;
+	time_t currentTime = now();
 
-	while( device != deviceList.end())
+	//a request is processed, process() sweeps the sessions itself
+	if(pthread_mutex_trylock(&sessionMutex) != 0)
+		return;
+
+	session = sessions.begin();
+	while(session != sessions.end())
 	{
-		result = (*device)->getIdentification();
-		if(uniqueId == result)
+		if(currentTime - session->second->lastUsed < I2C_SESSION_IDLE_TIMEOUT || session->second->released)
+			++session;
+		else if(session->second->backend == rsdBackend)
+		{
+			//sub-requests can only be send while processing a request, the handle is closed at the next request
+			queue->leave(session->second->device, this);
+			locks->leave(session->second->device, this);
+			session->second->released = true;
+			++session;
+		}
+		else
 		{
-			return (*device)->getPort();
+			closeDeviceQuietly(session->second->device, session->second->backend, session->second->handle);
+			delete session->second;
+			sessions.erase(session++);
 		}
-		++device;
 	}
+	pthread_mutex_unlock(&sessionMutex);
+}
 
-	return result;
+
+time_t I2c::now()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec;
+}
+
+
+Value* I2c::sendSubRequest(Value &method, Value &params)
+{
+	TraceSpan span(tracer, "sub-request", method.GetString(), traceRequestId, traceDevice);
+
+	{
+		TraceSpan sendSpan(tracer, "sub-request.send", method.GetString(), traceRequestId, traceDevice);
+		subRequest = json->generateRequest(method, params, *requestId);
+		if(asyncLog != NULL)
+			asyncLog->log("sub-out", subRequest, strlen(subRequest));
+		if(recorder != NULL)
+			recorder->record(RECORD_SUB_REQUEST, recordConnection, subRequest, strlen(subRequest));
+
+		//send subRequest, wait for subresponse, the subresponse is parsed to subResponseDom by isSubResponse
+		comPoint->transmit(subRequest, strlen(subRequest));
+	}
+
+	{
+		//contains the time of RSD and the other plugin
+		TraceSpan waitSpan(tracer, "sub-request.wait", method.GetString(), traceRequestId, traceDevice);
+		waitForResponse();
+	}
+
+	TraceSpan parseSpan(tracer, "sub-request.parse", method.GetString(), traceRequestId, traceDevice);
+	if(!checkSubResult(subResponseDom))
+		throw Error("Received json rpc error response from Aardvark-Plugin.");
+
+	subResult = json->tryTogetResult(subResponseDom);
+	return subResult;
+}
+
+
+int I2c::getPortByUniqueId(unsigned int uniqueId, I2cBackend* &backend)
+{
+	int port = -1;
+
+	if(findDevice(uniqueId, backend, port))
+		return port;
+
+	//the device may be plugged in after the last discovery
+	registry->discover(false);
+	if(rsdBackend != NULL)
+	{
+		try
+		{
+			discoverRsdDevices();
+		}
+		catch(Error &e)
+		{
+			//skip the Aardvark-Plugin if it is not registered
+		}
+	}
+	if(findDevice(uniqueId, backend, port))
+		return port;
+
+	throw Error("Unknown device.");
+}
+
+
+bool I2c::findDevice(unsigned int uniqueId, I2cBackend* &backend, int &port)
+{
+	const char* name = NULL;
+
+	if(!registry->find(uniqueId, name, port))
+		return false;
+
+	//devices of the Aardvark-Plugin are used through the backend of this connection
+	backend = getBackend(name);
+	return true;
+}
+
+
+void I2c::discoverRsdDevices()
+{
+	list<I2cDevice*> found;
+
+	try
+	{
+		rsdBackend->findDevices(found);
+	}
+	catch(Error &e)
+	{
+		while(!found.empty())
+		{
+			delete found.front();
+			found.pop_front();
+		}
+		throw;
+	}
+	registry->replace(rsdBackend->getName(), found);
+}
+
+
+I2cBackend* I2c::getBackend(const char* name)
+{
+	list<I2cBackend*>::iterator backend = backends.begin();
+
+	while(backend != backends.end())
+	{
+		if(strcmp((*backend)->getName(), name) == 0)
+			return *backend;
+		++backend;
+	}
+
+	throw Error("No backend for device.");
 }
 
 
@@ -521,13 +1667,4 @@ void I2c::waitForResponse()
 	}
 }
 
-void I2c::deleteDeviceList()
-{
-	list<I2cDevice*>::iterator device = deviceList.begin();
-	while( device != deviceList.end())
-	{
-		delete *device;
-		device = deviceList.erase(device);
-	}
-}
 
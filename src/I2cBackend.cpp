@@ -0,0 +1,67 @@
+
+#include "I2cBackend.hpp"
+#include "RemoteAardvark.hpp"
+
+
+void I2cBackend::transfer(int handle, I2cMessage* messages, unsigned int numMessages)
+{
+	int flags = 0;
+
+	for(unsigned int i = 0; i < numMessages; i++)
+	{
+		flags = messages[i].flags;
+		if(i < numMessages - 1)
+			flags |= AA_I2C_NO_STOP;
+
+		if(messages[i].read)
+			messages[i].count = read(handle, messages[i].slaveAddr, flags, messages[i].data, messages[i].length);
+		else
+		{
+			write(handle, messages[i].slaveAddr, flags, messages[i].data, messages[i].length);
+			messages[i].count = messages[i].length;
+		}
+	}
+}
+
+
+unsigned int I2cBackend::combined(int handle, int slaveAddr, const unsigned char* dataOut, unsigned int lengthOut,
+		unsigned char* dataIn, unsigned int lengthIn)
+{
+	I2cMessage messages[2];
+
+	messages[0].slaveAddr = slaveAddr;
+	messages[0].flags = AA_I2C_NO_FLAGS;
+	messages[0].read = false;
+	messages[0].data = (unsigned char*)dataOut;
+	messages[0].length = lengthOut;
+	messages[0].count = 0;
+
+	messages[1].slaveAddr = slaveAddr;
+	messages[1].flags = AA_I2C_NO_FLAGS;
+	messages[1].read = true;
+	messages[1].data = dataIn;
+	messages[1].length = lengthIn;
+	messages[1].count = 0;
+
+	transfer(handle, messages, 2);
+	return messages[1].count;
+}
+
+
+void I2cBackend::spiConfigure(int handle, int polarity, int phase, int bitorder, int ssPolarity)
+{
+	throw Error("SPI is not supported by this device.");
+}
+
+
+int I2cBackend::spiBitrate(int handle, int bitrate)
+{
+	throw Error("SPI is not supported by this device.");
+}
+
+
+unsigned int I2cBackend::spiWrite(int handle, const unsigned char* dataOut, unsigned int lengthOut, unsigned char* dataIn,
+		unsigned int lengthIn)
+{
+	throw Error("SPI is not supported by this device.");
+}
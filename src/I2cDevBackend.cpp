@@ -0,0 +1,365 @@
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/ioctl.h>
+
+#include "I2cDevBackend.hpp"
+#include "RemoteAardvark.hpp"
+
+
+I2cDevBackend::I2cDevBackend(const char* sysfsPath, const char* devicePath)
+{
+	this->sysfsPath = sysfsPath;
+	this->devicePath = devicePath;
+	pthread_mutex_init(&mutex, NULL);
+}
+
+
+I2cDevBackend::~I2cDevBackend()
+{
+	map<int, Adapter*>::iterator adapter = adapters.begin();
+
+	while(adapter != adapters.end())
+	{
+		closeAdapter(adapter->second->fd);
+		pthread_mutex_destroy(&(adapter->second->mutex));
+		delete adapter->second;
+		++adapter;
+	}
+	pthread_mutex_destroy(&mutex);
+}
+
+
+void I2cDevBackend::findDevices(list<I2cDevice*> &deviceList)
+{
+	DIR* directory = opendir(sysfsPath.c_str());
+	struct dirent* entry = NULL;
+	map<long, string> entries;
+	map<long, string>::iterator adapter;
+	set<unsigned int> used;
+	char* end = NULL;
+	long number = 0;
+
+	if(directory == NULL)
+		return;
+
+	while((entry = readdir(directory)) != NULL)
+	{
+		if(strncmp(entry->d_name, "i2c-", 4) != 0)
+			continue;
+
+		number = strtol(entry->d_name + 4, &end, 10);
+		if(*end == '\0' && end != entry->d_name + 4)
+			entries[number] = entry->d_name;
+	}
+	closedir(directory);
+
+	//sorted by number, so adapters with the same place and name get their ids always in the same order
+	for(adapter = entries.begin(); adapter != entries.end(); ++adapter)
+		deviceList.push_back(new I2cDevice(getName(), (int)adapter->first, getUniqueId(adapter->second.c_str(), used)));
+}
+
+
+unsigned int I2cDevBackend::getUniqueId(const char* entry, set<unsigned int> &used)
+{
+	string adapterPath = sysfsPath + "/" + entry;
+	string place;
+	char name[128];
+	char* parent = NULL;
+	FILE* file = NULL;
+	unsigned int id = 0;
+	unsigned int duplicate = 0;
+
+	//the parent of the adapter device is the controller or USB interface, its path does not contain the adapter number
+	parent = realpath((adapterPath + "/device/..").c_str(), NULL);
+	if(parent != NULL)
+	{
+		place = parent;
+		free(parent);
+	}
+	else
+		place = entry;
+
+	name[0] = '\0';
+	file = fopen((adapterPath + "/name").c_str(), "r");
+	if(file != NULL)
+	{
+		if(fgets(name, sizeof(name), file) == NULL)
+			name[0] = '\0';
+		fclose(file);
+	}
+	place += "/";
+	place += name;
+
+	id = I2CDEV_UNIQUE_ID_BASE + hash(place);
+	while(!used.insert(id).second)
+	{
+		snprintf(name, sizeof(name), "#%u", ++duplicate);
+		id = I2CDEV_UNIQUE_ID_BASE + hash(place + name);
+	}
+	return id;
+}
+
+
+unsigned int I2cDevBackend::hash(const string &text)
+{
+	unsigned int value = 2166136261U;
+
+	for(unsigned int i = 0; i < text.size(); i++)
+	{
+		value ^= (unsigned char)text[i];
+		value *= 16777619U;
+	}
+	return value & 0x0FFFFFFF;
+}
+
+
+int I2cDevBackend::open(int port)
+{
+	Adapter* adapter = NULL;
+	map<int, Adapter*>::iterator entry;
+	char path[64];
+	int fd = 0;
+
+	pthread_mutex_lock(&mutex);
+	entry = adapters.find(port);
+	if(entry == adapters.end())
+	{
+		snprintf(path, sizeof(path), "%s%d", devicePath.c_str(), port);
+		fd = openAdapter(path);
+		if(fd < 0)
+		{
+			pthread_mutex_unlock(&mutex);
+			throw Error("Could not open i2c-dev adapter.");
+		}
+
+		adapter = new Adapter();
+		adapter->fd = fd;
+		adapter->opened = false;
+		adapter->hasPending = false;
+		pthread_mutex_init(&(adapter->mutex), NULL);
+		adapters.insert(pair<int, Adapter*>(port, adapter));
+	}
+	else
+		adapter = entry->second;
+
+	if(adapter->opened)
+	{
+		pthread_mutex_unlock(&mutex);
+		throw Error("i2c-dev adapter is already open.");
+	}
+	adapter->opened = true;
+	pthread_mutex_unlock(&mutex);
+
+	//handle 0 is not valid, like for an Aardvark
+	return port + 1;
+}
+
+
+void I2cDevBackend::write(int handle, int slaveAddr, int flags, const unsigned char* data, unsigned int length)
+{
+	I2cMessage message;
+
+	message.slaveAddr = slaveAddr;
+	message.flags = flags;
+	message.read = false;
+	message.data = (unsigned char*)data;
+	message.length = length;
+	message.count = 0;
+	transfer(handle, &message, 1);
+}
+
+
+unsigned int I2cDevBackend::read(int handle, int slaveAddr, int flags, unsigned char* data, unsigned int length)
+{
+	I2cMessage message;
+
+	message.slaveAddr = slaveAddr;
+	message.flags = flags;
+	message.read = true;
+	message.data = data;
+	message.length = length;
+	message.count = 0;
+	transfer(handle, &message, 1);
+	return message.count;
+}
+
+
+int I2cDevBackend::configure(int handle, int bitrate)
+{
+	throw Error("Bitrate of a i2c-dev adapter can not be configured.");
+}
+
+
+void I2cDevBackend::transfer(int handle, I2cMessage* messages, unsigned int numMessages)
+{
+	Adapter* adapter = getAdapter(handle);
+
+	pthread_mutex_lock(&(adapter->mutex));
+	try
+	{
+		submit(adapter, messages, numMessages);
+	}
+	catch(Error &e)
+	{
+		pthread_mutex_unlock(&(adapter->mutex));
+		throw;
+	}
+	pthread_mutex_unlock(&(adapter->mutex));
+}
+
+
+void I2cDevBackend::close(int handle)
+{
+	Adapter* adapter = getAdapter(handle);
+	I2cMessage pending;
+	bool failed = false;
+
+	//a kept back message has to be executed before the adapter is released
+	pthread_mutex_lock(&(adapter->mutex));
+	if(adapter->hasPending)
+	{
+		pending = adapter->pending;
+		pending.flags &= ~AA_I2C_NO_STOP;
+		adapter->hasPending = false;
+		try
+		{
+			submit(adapter, &pending, 1);
+		}
+		catch(Error &e)
+		{
+			//the adapter has to be released anyway, but the client has to know that its write was not executed
+			failed = true;
+		}
+	}
+	pthread_mutex_unlock(&(adapter->mutex));
+
+	pthread_mutex_lock(&mutex);
+	adapter->opened = false;
+	pthread_mutex_unlock(&mutex);
+
+	if(failed)
+		throw Error("Kept back write of i2c-dev adapter failed at close.");
+}
+
+
+int I2cDevBackend::openAdapter(const char* path)
+{
+	return ::open(path, O_RDWR);
+}
+
+
+int I2cDevBackend::ioctlRdwr(int fd, struct i2c_rdwr_ioctl_data* data)
+{
+	return ioctl(fd, I2C_RDWR, data);
+}
+
+
+void I2cDevBackend::closeAdapter(int fd)
+{
+	::close(fd);
+}
+
+
+I2cDevBackend::Adapter* I2cDevBackend::getAdapter(int handle)
+{
+	map<int, Adapter*>::iterator entry;
+	Adapter* adapter = NULL;
+
+	pthread_mutex_lock(&mutex);
+	entry = adapters.find(handle - 1);
+	if(entry != adapters.end() && entry->second->opened)
+		adapter = entry->second;
+	pthread_mutex_unlock(&mutex);
+
+	if(adapter == NULL)
+		throw Error("Invalid handle of i2c-dev adapter.");
+
+	return adapter;
+}
+
+
+void I2cDevBackend::submit(Adapter* adapter, I2cMessage* messages, unsigned int numMessages)
+{
+	vector<struct i2c_msg> msgs;
+	struct i2c_msg msg;
+	struct i2c_rdwr_ioctl_data data;
+	unsigned int first = 0;
+	int error = 0;
+	bool keepBack = false;
+
+	if(numMessages == 0)
+		return;
+
+	//a write without stop is kept back till the next message, a read has to be executed to get its data
+	if((messages[numMessages - 1].flags & AA_I2C_NO_STOP) && !messages[numMessages - 1].read && !adapter->hasPending)
+	{
+		keepBack = true;
+		--numMessages;
+	}
+
+	if(adapter->hasPending)
+	{
+		msg.addr = adapter->pending.slaveAddr;
+		msg.flags = (adapter->pending.flags & AA_I2C_10_BIT_ADDR) ? I2C_M_TEN : 0;
+		msg.len = adapter->pendingData.size();
+		msg.buf = adapter->pendingData.empty() ? NULL : &(adapter->pendingData[0]);
+		msgs.push_back(msg);
+		first = 1;
+	}
+
+	for(unsigned int i = 0; i < numMessages; i++)
+	{
+		msg.addr = messages[i].slaveAddr;
+		msg.flags = messages[i].read ? I2C_M_RD : 0;
+		if(messages[i].flags & AA_I2C_10_BIT_ADDR)
+			msg.flags |= I2C_M_TEN;
+		msg.len = messages[i].length;
+		msg.buf = messages[i].data;
+		msgs.push_back(msg);
+	}
+
+	if(msgs.size() > I2C_RDWR_IOCTL_MAX_MSGS)
+		throw Error("Too many messages for one i2c-dev transaction.");
+
+	if(!msgs.empty())
+	{
+		data.msgs = &msgs[0];
+		data.nmsgs = msgs.size();
+		if(ioctlRdwr(adapter->fd, &data) < 0)
+		{
+			error = errno;
+			adapter->hasPending = false;
+			if(error == ENXIO || error == EREMOTEIO)
+				throw Error(I2C_BUS_ERROR_CODE(AA_I2C_STATUS_SLA_NACK), "i2c-dev slave did not acknowledge.");
+			else if(error == EAGAIN)
+				throw Error(I2C_BUS_ERROR_CODE(AA_I2C_STATUS_ARB_LOST), "i2c-dev arbitration lost.");
+			else if(error == ETIMEDOUT)
+				throw Error(I2C_BUS_ERROR_CODE(AA_I2C_STATUS_BUS_LOCKED), "i2c-dev bus timeout.");
+			else if(error == EIO)
+				throw Error(I2C_BUS_ERROR_CODE(AA_I2C_STATUS_BUS_ERROR), "i2c-dev bus error.");
+			else
+				throw Error("i2c-dev transaction failed.");
+		}
+	}
+	adapter->hasPending = false;
+
+	for(unsigned int i = 0; i < numMessages; i++)
+		messages[i].count = msgs[i + first].len;
+
+	//keep back the last message, its data will be copied because the buffer belongs to the caller
+	if(keepBack)
+	{
+		adapter->pending = messages[numMessages];
+		adapter->pendingData.assign(messages[numMessages].data, messages[numMessages].data + messages[numMessages].length);
+		adapter->pending.data = NULL;
+		adapter->hasPending = true;
+		//nothing was written yet, a failure of the next transaction or of close() is reported there
+		messages[numMessages].count = 0;
+	}
+}
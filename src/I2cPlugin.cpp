@@ -1,26 +1,73 @@
+#include <syslog.h>
+
 #include <I2cPlugin.hpp>
 #include "I2c.hpp"
+#include "I2cSchema.hpp"
+#include "AardvarkLocalBackend.hpp"
+#include "SimulatedBackend.hpp"
+#include "I2cDevBackend.hpp"
 
 
-I2cPlugin::I2cPlugin(PluginInfo* pluginInfo) : PluginInterface(pluginInfo)
+I2cPlugin::I2cPlugin(PluginInfo* pluginInfo) : PluginInterface(pluginInfo), registry(&sharedBackends)
 {
-	I2c* tempDriver = new I2c();
-	list<string*>* functionList = tempDriver->getAllFunctionNames();
-	delete tempDriver;
+	list<string*>* functionList = I2cSchema::getMethodNames();
+	unsigned long long start = Tracer::now();
+	unsigned long long backendsUp = 0;
+	unsigned long long listenerUp = 0;
+
+	//I2c logs into rings which are written to syslog by a background thread, instead of ComPointB logging synchronously
+	asyncLog = NULL;
+#ifdef I2C_ASYNC_LOG
+	asyncLog = new AsyncLog(LOG_LOCAL2);
+#endif
+	//every message of every connection is appended to I2C_RECORD_FILE, tools/I2cReplay can replay it
+	recorder = NULL;
+#ifdef I2C_RECORD
+	recorder = new Recorder(I2C_RECORD_FILE);
+#endif
+
+#ifdef AARDVARK_INPROCESS
+	sharedBackends.push_back(new AardvarkLocalBackend());
+#endif
+#ifndef NO_I2C_DEV
+	sharedBackends.push_back(new I2cDevBackend());
+#endif
+#ifdef I2C_SIMULATION
+	sharedBackends.push_back(new SimulatedBackend(SIM_NUM_BUSES, SIM_REALTIME));
+#endif
+	backendsUp = Tracer::now();
+
+	//the first discovery runs in the background while the listener starts and the plugin registers to RSD
+	registry.start();
+	sweeper.start();
 
 	StartAcceptThread();
 	if(wait_for_accepter_up() != 0)
 		throw Error("Creation of Listener/worker threads failed.");
+	listenerUp = Tracer::now();
 
 	pluginActive = true;
 
 	regClient = new RegClient(pluginInfo, functionList, REG_PATH);
+	syslog(LOG_LOCAL2 | LOG_INFO, "Startup: backends %llu us, listener %llu us, registration %llu us.",
+			backendsUp - start, listenerUp - backendsUp, Tracer::now() - listenerUp);
 }
 
 
 I2cPlugin::~I2cPlugin()
 {
+	list<I2cBackend*>::iterator backend = sharedBackends.begin();
+
 	delete regClient;
+	registry.stop();
+	sweeper.stop();
+	delete asyncLog;
+	delete recorder;
+	while(backend != sharedBackends.end())
+	{
+		delete *backend;
+		backend = sharedBackends.erase(backend);
+	}
 }
 
 
@@ -37,10 +84,11 @@ void I2cPlugin::thread_accept()
 		new_socket = accept(connection_socket, (struct sockaddr*)&address, &addrlen);
 		if(new_socket > 0)
 		{
-			i2c = new I2c();
+			i2c = new I2c(&sharedBackends, &locks, &reads, &stats, asyncLog, &tracer, recorder, &registry, &workspaces, &queue,
+					&sweeper);
 			comPoint = new ComPointB(new_socket, i2c, pluginNumber, false);
 			comPoint->configureLogInfo(&infoIn, &infoOut, &info);
-			comPoint->setLogMethod(SYSLOG_LOG);
+			comPoint->setLogMethod(asyncLog != NULL ? NO_LOG : SYSLOG_LOG);
 			comPoint->setSyslogFacility(LOG_LOCAL2);
 			comPoint->startWorking();
 			pushComPointList(comPoint);
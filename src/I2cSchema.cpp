@@ -0,0 +1,389 @@
+
+#include <cstring>
+
+#include "I2cSchema.hpp"
+#include "NameIndex.hpp"
+#include "MsgPack.hpp"
+#include "JsonRPC.hpp"
+#include "RemoteAardvark.hpp"
+#include "ReadCoalescer.hpp"
+
+
+#define I2C_METHOD_NAME(id, name, function) name,
+#define I2C_PARAM_NAME(member, name, type, required) name,
+#define I2C_PARAM_INDEX(member, name, type, required) member##Index,
+#define I2C_PARAM_RESET(member, name, type, required) result.has_##member = false;
+#define I2C_PARAM_CASE(member, name, type, required) \
+	case member##Index: \
+		readParam(param->value, "Param " name " has the wrong type.", result.member); \
+		result.has_##member = true; \
+		break;
+#define I2C_PARAM_REQUIRE(member, name, type, required) \
+	if(required && !result.has_##member) \
+		throw Error("Missing param " name ".");
+
+/*! Generates the parser of a param struct, its NameIndex is build at program start and not by the first request.*/
+#define I2C_DEFINE_PARAMS_PARSER(structName, list) \
+	static const char* const structName##Names[] = { list(I2C_PARAM_NAME) }; \
+	static const NameIndex structName##Index(structName##Names, sizeof(structName##Names) / sizeof(structName##Names[0])); \
+	\
+	void I2cSchema::parse(Value &params, structName &result) \
+	{ \
+		enum { list(I2C_PARAM_INDEX) numberOfParams }; \
+		const NameIndex &index = structName##Index; \
+		\
+		list(I2C_PARAM_RESET) \
+		if(!params.IsObject()) \
+			throw Error("Params have to be an object."); \
+		\
+		for(Value::MemberIterator param = params.MemberBegin(); param != params.MemberEnd(); ++param) \
+		{ \
+			switch(index.find(param->name.GetString(), param->name.GetStringLength())) \
+			{ \
+				list(I2C_PARAM_CASE) \
+				default: \
+					break; \
+			} \
+		} \
+		list(I2C_PARAM_REQUIRE) \
+		validate(result); \
+	}
+
+
+static const char* const methodNames[] = { I2C_METHODS(I2C_METHOD_NAME) };
+static const NameIndex methodIndex(methodNames, I2C_NUMBER_OF_METHODS);
+
+
+static void readParam(Value &value, const char* errorMsg, int &result)
+{
+	if(!value.IsInt())
+		throw Error(errorMsg);
+	result = value.GetInt();
+}
+
+
+static void readParam(Value &value, const char* errorMsg, unsigned int &result)
+{
+	if(!value.IsUint())
+		throw Error(errorMsg);
+	result = value.GetUint();
+}
+
+
+static void readParam(Value &value, const char* errorMsg, const char* &result)
+{
+	if(!value.IsString())
+		throw Error(errorMsg);
+	result = value.GetString();
+}
+
+
+static void readParam(Value &value, const char* errorMsg, bool &result)
+{
+	if(!value.IsBool())
+		throw Error(errorMsg);
+	result = value.GetBool();
+}
+
+
+static void readParam(Value &value, const char* errorMsg, Value* &result)
+{
+	if(!value.IsArray())
+		throw Error(errorMsg);
+	result = &value;
+}
+
+
+static void readParam(Value &value, const char* errorMsg, vector<unsigned char> &result)
+{
+	result.clear();
+
+	if(value.IsString())
+	{
+		Base64::decode(value.GetString(), value.GetStringLength(), result);
+		return;
+	}
+
+	if(!value.IsArray())
+		throw Error(errorMsg);
+
+	result.reserve(value.Size());
+	for(unsigned int i = 0; i < value.Size(); i++)
+	{
+		if(!value[i].IsUint() || value[i].GetUint() > 0xFF)
+			throw Error(errorMsg);
+		result.push_back((unsigned char)value[i].GetUint());
+	}
+}
+
+
+static void validateSlaveAddr(int slaveAddr, int flags)
+{
+	int maxAddr = (flags & AA_I2C_10_BIT_ADDR) ? 0x3FF : 0x7F;
+
+	if(slaveAddr < 0 || slaveAddr > maxAddr)
+		throw Error("Param slave_addr is out of range.");
+}
+
+
+static void validatePriority(bool hasPriority, const char* priority)
+{
+	if(hasPriority && strcmp(priority, "interactive") != 0 && strcmp(priority, "bulk") != 0)
+		throw Error("Param priority has to be \"interactive\" or \"bulk\".");
+}
+
+
+static void validate(I2cWriteParams &params)
+{
+	validateSlaveAddr(params.slaveAddr, params.has_flags ? params.flags : 0);
+
+	if(params.dataOut.size() > I2C_MAX_TRANSFER_SIZE)
+		throw Error("Param data_out is too long.");
+
+	if(params.has_bitrate && params.bitrate <= 0)
+		throw Error("Param bitrate has to be positive.");
+
+	if(params.has_retries && params.retries > I2C_RETRY_MAX_COUNT)
+		throw Error("Param retries is too big.");
+
+	validatePriority(params.has_priority, params.priority);
+}
+
+
+static void validate(I2cReadParams &params)
+{
+	validateSlaveAddr(params.slaveAddr, 0);
+
+	if(params.memAddr > 0xFF)
+		throw Error("Param mem_addr is out of range.");
+
+	if(params.has_maxAge && params.maxAge > I2C_READ_CACHE_MAX_AGE)
+		throw Error("Param max_age is too big.");
+
+	if(params.numBytes > I2C_MAX_TRANSFER_SIZE)
+		throw Error("Param num_bytes is too big.");
+
+	if(params.has_bitrate && params.bitrate <= 0)
+		throw Error("Param bitrate has to be positive.");
+
+	if(params.has_encoding && strcmp(params.encoding, "base64") != 0 && strcmp(params.encoding, "array") != 0)
+		throw Error("Param encoding has to be \"base64\" or \"array\".");
+
+	if(params.has_retries && params.retries > I2C_RETRY_MAX_COUNT)
+		throw Error("Param retries is too big.");
+
+	validatePriority(params.has_priority, params.priority);
+}
+
+
+static void validate(I2cOpenParams &params)
+{
+	if(params.has_bitrate && params.bitrate <= 0)
+		throw Error("Param bitrate has to be positive.");
+}
+
+
+static void validate(I2cTransferParams &params)
+{
+	if(params.ops->Size() == 0 || params.ops->Size() > I2C_MAX_TRANSFER_OPS)
+		throw Error("Param ops is empty or contains too many ops.");
+
+	if(params.has_encoding && strcmp(params.encoding, "base64") != 0 && strcmp(params.encoding, "array") != 0)
+		throw Error("Param encoding has to be \"base64\" or \"array\".");
+
+	if(params.has_retries && params.retries > I2C_RETRY_MAX_COUNT)
+		throw Error("Param retries is too big.");
+}
+
+
+static void validate(I2cTransferOpParams &params)
+{
+	validateSlaveAddr(params.slaveAddr, params.has_flags ? params.flags : 0);
+
+	if(strcmp(params.op, "write") == 0)
+	{
+		if(!params.has_dataOut)
+			throw Error("Missing param data_out of write op.");
+		if(params.dataOut.size() > I2C_MAX_TRANSFER_SIZE)
+			throw Error("Param data_out is too long.");
+		if(params.has_memAddr && params.memAddr > 0xFF)
+			throw Error("Param mem_addr is out of range.");
+		if(params.has_pageSize && params.pageSize == 0)
+			throw Error("Param page_size has to be positive.");
+	}
+	else if(strcmp(params.op, "read") == 0)
+	{
+		if(params.has_memAddr || params.has_pageSize)
+			throw Error("Params mem_addr and page_size are only allowed for write ops.");
+		if(!params.has_numBytes)
+			throw Error("Missing param num_bytes of read op.");
+		if(params.numBytes > I2C_MAX_TRANSFER_SIZE)
+			throw Error("Param num_bytes is too big.");
+	}
+	else
+		throw Error("Param op has to be \"write\" or \"read\".");
+}
+
+
+static void validate(I2cCloseParams &params)
+{
+}
+
+
+static void validate(I2cLockParams &params)
+{
+	if(params.has_lease && params.lease == 0)
+		throw Error("Param lease has to be positive.");
+}
+
+
+static void validate(I2cUnlockParams &params)
+{
+}
+
+
+static void validate(I2cTraceParams &params)
+{
+}
+
+
+static void validate(I2cScanParams &params)
+{
+	int first = params.has_first ? params.first : I2C_SCAN_FIRST_ADDR;
+	int last = params.has_last ? params.last : I2C_SCAN_LAST_ADDR;
+
+	if(params.has_device == params.has_devices)
+		throw Error("Either param device or param devices is required.");
+
+	if(params.has_devices)
+	{
+		if(params.devices->Size() == 0 || params.devices->Size() > I2C_SCAN_MAX_DEVICES)
+			throw Error("Param devices is empty or contains too many devices.");
+
+		for(unsigned int i = 0; i < params.devices->Size(); i++)
+		{
+			if(!(*params.devices)[i].IsUint())
+				throw Error("Param devices has the wrong type.");
+			for(unsigned int j = 0; j < i; j++)
+			{
+				if((*params.devices)[j].GetUint() == (*params.devices)[i].GetUint())
+					throw Error("Param devices contains a device twice.");
+			}
+		}
+	}
+
+	if(first < 0 || last > 0x7F || first > last)
+		throw Error("Params first and last have to be a range of 7 bit addresses.");
+
+	if(params.has_mode && strcmp(params.mode, "quick") != 0 && strcmp(params.mode, "read") != 0)
+		throw Error("Param mode has to be \"quick\" or \"read\".");
+
+	if(params.has_bitrate && params.bitrate <= 0)
+		throw Error("Param bitrate has to be positive.");
+
+	validatePriority(params.has_priority, params.priority);
+}
+
+
+static void validateSpiSetting(bool hasSetting, int setting, const char* message)
+{
+	if(hasSetting && setting != 0 && setting != 1)
+		throw Error(message);
+}
+
+
+static void validateSpiData(vector<unsigned char> &dataOut, bool hasNumBytes, unsigned int numBytes)
+{
+	if(dataOut.empty() || dataOut.size() > I2C_MAX_TRANSFER_SIZE)
+		throw Error("Param data_out is empty or too long.");
+
+	if(hasNumBytes && numBytes > I2C_MAX_TRANSFER_SIZE)
+		throw Error("Param num_bytes is too big.");
+}
+
+
+static void validate(I2cSpiTransferParams &params)
+{
+	validateSpiData(params.dataOut, params.has_numBytes, params.numBytes);
+
+	if(params.has_bitrate && params.bitrate <= 0)
+		throw Error("Param bitrate has to be positive.");
+
+	validateSpiSetting(params.has_polarity, params.polarity, "Param polarity has to be 0 or 1.");
+	validateSpiSetting(params.has_phase, params.phase, "Param phase has to be 0 or 1.");
+	validateSpiSetting(params.has_bitorder, params.bitorder, "Param bitorder has to be 0 or 1.");
+	validateSpiSetting(params.has_ssPolarity, params.ssPolarity, "Param ss_polarity has to be 0 or 1.");
+
+	if(params.has_encoding && strcmp(params.encoding, "base64") != 0 && strcmp(params.encoding, "array") != 0)
+		throw Error("Param encoding has to be \"base64\" or \"array\".");
+
+	validatePriority(params.has_priority, params.priority);
+}
+
+
+static void validate(I2cSpiBatchParams &params)
+{
+	if(params.ops->Size() == 0 || params.ops->Size() > I2C_MAX_TRANSFER_OPS)
+		throw Error("Param ops is empty or contains too many ops.");
+
+	if(params.has_bitrate && params.bitrate <= 0)
+		throw Error("Param bitrate has to be positive.");
+
+	validateSpiSetting(params.has_polarity, params.polarity, "Param polarity has to be 0 or 1.");
+	validateSpiSetting(params.has_phase, params.phase, "Param phase has to be 0 or 1.");
+	validateSpiSetting(params.has_bitorder, params.bitorder, "Param bitorder has to be 0 or 1.");
+	validateSpiSetting(params.has_ssPolarity, params.ssPolarity, "Param ss_polarity has to be 0 or 1.");
+
+	if(params.has_encoding && strcmp(params.encoding, "base64") != 0 && strcmp(params.encoding, "array") != 0)
+		throw Error("Param encoding has to be \"base64\" or \"array\".");
+
+	validatePriority(params.has_priority, params.priority);
+}
+
+
+static void validate(I2cSpiOpParams &params)
+{
+	validateSpiData(params.dataOut, params.has_numBytes, params.numBytes);
+}
+
+
+I2cMethod I2cSchema::findMethod(Value &method)
+{
+	int index = -1;
+
+	if(method.IsString())
+		index = methodIndex.find(method.GetString(), method.GetStringLength());
+
+	return index < 0 ? I2C_NUMBER_OF_METHODS : (I2cMethod)index;
+}
+
+
+const char* I2cSchema::getMethodName(I2cMethod method)
+{
+	return methodNames[method];
+}
+
+
+list<string*>* I2cSchema::getMethodNames()
+{
+	list<string*>* names = new list<string*>();
+
+	for(int method = 0; method < I2C_NUMBER_OF_METHODS; method++)
+		names->push_back(new string(methodNames[method]));
+	return names;
+}
+
+
+I2C_DEFINE_PARAMS_PARSER(I2cWriteParams, I2C_WRITE_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cReadParams, I2C_READ_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cOpenParams, I2C_OPEN_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cTransferParams, I2C_TRANSFER_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cTransferOpParams, I2C_TRANSFER_OP_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cCloseParams, I2C_CLOSE_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cLockParams, I2C_LOCK_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cUnlockParams, I2C_UNLOCK_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cScanParams, I2C_SCAN_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cTraceParams, I2C_TRACE_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cSpiTransferParams, I2C_SPI_TRANSFER_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cSpiBatchParams, I2C_SPI_BATCH_PARAMS)
+I2C_DEFINE_PARAMS_PARSER(I2cSpiOpParams, I2C_SPI_OP_PARAMS)
@@ -0,0 +1,85 @@
+
+#include <cstring>
+
+#include "I2cStats.hpp"
+
+
+/*! Names of the AardvarkI2cStatus values, indexed by the status.*/
+static const char* statusNames[I2C_NUMBER_OF_BUS_STATUS] = {"OK", "BUS_ERROR", "SLA_ACK", "SLA_NACK", "DATA_NACK",
+		"ARB_LOST", "BUS_LOCKED", "LAST_DATA_ACK"};
+
+
+I2cStats::I2cStats()
+{
+	memset(&counters, 0, sizeof(counters));
+	pthread_mutex_init(&mutex, NULL);
+}
+
+
+I2cStats::~I2cStats()
+{
+	pthread_mutex_destroy(&mutex);
+}
+
+
+void I2cStats::countTransaction()
+{
+	pthread_mutex_lock(&mutex);
+	++counters.transactions;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void I2cStats::countBusError(int status, bool retried)
+{
+	pthread_mutex_lock(&mutex);
+	if(status >= 0 && status < I2C_NUMBER_OF_BUS_STATUS)
+		++counters.busErrors[status];
+	if(retried)
+		++counters.retries;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void I2cStats::countRecovered()
+{
+	pthread_mutex_lock(&mutex);
+	++counters.recovered;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void I2cStats::countExhausted()
+{
+	pthread_mutex_lock(&mutex);
+	++counters.exhausted;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void I2cStats::countConnection(bool opened)
+{
+	pthread_mutex_lock(&mutex);
+	if(opened)
+		++counters.connections;
+	else
+		--counters.connections;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void I2cStats::get(Counters &counters)
+{
+	pthread_mutex_lock(&mutex);
+	counters = this->counters;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+const char* I2cStats::getStatusName(int status)
+{
+	if(status < 0 || status >= I2C_NUMBER_OF_BUS_STATUS)
+		return "UNKNOWN";
+
+	return statusNames[status];
+}
@@ -0,0 +1,328 @@
+
+#include <cstring>
+
+#include "MsgPack.hpp"
+#include "JsonRPC.hpp"
+
+
+static const char base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+
+void MsgPackWriter::writeArray(unsigned int size)
+{
+	if(size < 16)
+		buffer.push_back(0x90 | size);
+	else if(size < 0x10000)
+	{
+		buffer.push_back(0xdc);
+		writeBigEndian(size, 2);
+	}
+	else
+	{
+		buffer.push_back(0xdd);
+		writeBigEndian(size, 4);
+	}
+}
+
+
+void MsgPackWriter::writeMap(unsigned int size)
+{
+	if(size < 16)
+		buffer.push_back(0x80 | size);
+	else if(size < 0x10000)
+	{
+		buffer.push_back(0xde);
+		writeBigEndian(size, 2);
+	}
+	else
+	{
+		buffer.push_back(0xdf);
+		writeBigEndian(size, 4);
+	}
+}
+
+
+void MsgPackWriter::writeInt(long long value)
+{
+	if(value >= 0 && value < 128)
+		buffer.push_back((unsigned char)value);
+	else if(value < 0 && value >= -32)
+		buffer.push_back((unsigned char)(0xe0 | (value + 32)));
+	else if(value >= 0 && value <= 0xFFFFFFFFLL)
+	{
+		buffer.push_back(0xce);
+		writeBigEndian(value, 4);
+	}
+	else
+	{
+		buffer.push_back(0xd3);
+		writeBigEndian(value, 8);
+	}
+}
+
+
+void MsgPackWriter::writeBin(const unsigned char* data, unsigned int length)
+{
+	if(length < 0x100)
+	{
+		buffer.push_back(0xc4);
+		writeBigEndian(length, 1);
+	}
+	else if(length < 0x10000)
+	{
+		buffer.push_back(0xc5);
+		writeBigEndian(length, 2);
+	}
+	else
+	{
+		buffer.push_back(0xc6);
+		writeBigEndian(length, 4);
+	}
+	buffer.insert(buffer.end(), data, data + length);
+}
+
+
+void MsgPackWriter::writeString(const char* value)
+{
+	unsigned int length = strlen(value);
+
+	if(length < 32)
+		buffer.push_back(0xa0 | length);
+	else if(length < 0x100)
+	{
+		buffer.push_back(0xd9);
+		writeBigEndian(length, 1);
+	}
+	else
+	{
+		buffer.push_back(0xda);
+		writeBigEndian(length, 2);
+	}
+	buffer.insert(buffer.end(), value, value + length);
+}
+
+
+void MsgPackWriter::writeBigEndian(unsigned long long value, unsigned int bytes)
+{
+	for(int i = bytes - 1; i >= 0; i--)
+		buffer.push_back((unsigned char)(value >> (8 * i)));
+}
+
+
+
+MsgPackReader::MsgPackReader(const unsigned char* data, unsigned int length)
+{
+	this->data = data;
+	this->length = length;
+	position = 0;
+}
+
+
+bool MsgPackReader::findInt(const char* key, long long &value)
+{
+	unsigned char header = 0;
+
+	if(!findKey(key))
+		return false;
+
+	need(1);
+	header = data[position++];
+	if(header < 0x80)
+		value = header;
+	else if(header >= 0xe0)
+		value = (signed char)header;
+	else if(header == 0xcc || header == 0xcd || header == 0xce || header == 0xcf)
+		value = (long long)readBigEndian(1 << (header - 0xcc));
+	else if(header == 0xd0)
+		value = (signed char)readBigEndian(1);
+	else if(header == 0xd1)
+		value = (short)readBigEndian(2);
+	else if(header == 0xd2)
+		value = (int)readBigEndian(4);
+	else if(header == 0xd3)
+		value = (long long)readBigEndian(8);
+	else
+		throw Error("MessagePack member is not an integer.");
+
+	return true;
+}
+
+
+bool MsgPackReader::findBin(const char* key, const unsigned char* &data, unsigned int &length)
+{
+	unsigned char header = 0;
+
+	if(!findKey(key))
+		return false;
+
+	need(1);
+	header = this->data[position++];
+	if(header < 0xc4 || header > 0xc6)
+		throw Error("MessagePack member is not a byte array.");
+
+	length = (unsigned int)readBigEndian(1 << (header - 0xc4));
+	need(length);
+	data = this->data + position;
+	return true;
+}
+
+
+bool MsgPackReader::findKey(const char* key)
+{
+	unsigned int members = 0;
+	unsigned int keyLength = 0;
+	unsigned char header = 0;
+
+	position = 0;
+	need(1);
+	header = data[position++];
+	members = readLength(header, 0xf0, 0x80, 0xde);
+
+	for(unsigned int i = 0; i < members; i++)
+	{
+		need(1);
+		header = data[position++];
+		keyLength = readLength(header, 0xe0, 0xa0, 0xd9);
+		need(keyLength);
+		if(keyLength == strlen(key) && memcmp(data + position, key, keyLength) == 0)
+		{
+			position += keyLength;
+			return true;
+		}
+		position += keyLength;
+		skip();
+	}
+	return false;
+}
+
+
+void MsgPackReader::skip()
+{
+	unsigned char header = 0;
+	unsigned int count = 0;
+
+	need(1);
+	header = data[position++];
+
+	if(header < 0x80 || header >= 0xe0 || header == 0xc0 || header == 0xc2 || header == 0xc3)
+		return;
+	else if(header >= 0xcc && header <= 0xd3)
+		position += 1 << ((header - 0xcc) & 0x03);
+	else if(header == 0xca)
+		position += 4;
+	else if(header == 0xcb)
+		position += 8;
+	else if(header >= 0xc4 && header <= 0xc6)
+		position += (unsigned int)readBigEndian(1 << (header - 0xc4));
+	else if((header & 0xe0) == 0xa0 || (header >= 0xd9 && header <= 0xdb))
+		position += readLength(header, 0xe0, 0xa0, 0xd9);
+	else if((header & 0xf0) == 0x90 || header == 0xdc || header == 0xdd)
+	{
+		count = readLength(header, 0xf0, 0x90, 0xdc);
+		for(unsigned int i = 0; i < count; i++)
+			skip();
+	}
+	else if((header & 0xf0) == 0x80 || header == 0xde || header == 0xdf)
+	{
+		count = readLength(header, 0xf0, 0x80, 0xde);
+		for(unsigned int i = 0; i < 2 * count; i++)
+			skip();
+	}
+	else
+		throw Error("Unsupported MessagePack type.");
+
+	if(position > length)
+		throw Error("MessagePack data is truncated.");
+}
+
+
+unsigned long long MsgPackReader::readBigEndian(unsigned int bytes)
+{
+	unsigned long long value = 0;
+
+	need(bytes);
+	for(unsigned int i = 0; i < bytes; i++)
+		value = (value << 8) | data[position++];
+
+	return value;
+}
+
+
+unsigned int MsgPackReader::readLength(unsigned char header, unsigned char fixMask, unsigned char fixBase, unsigned char base)
+{
+	//fix format contains the length within the header
+	if((header & fixMask) == fixBase)
+		return header & ~fixMask;
+	//8 bit length only exists for str
+	else if(base == 0xd9 && header == 0xd9)
+		return (unsigned int)readBigEndian(1);
+	else if(header == base + (base == 0xd9 ? 1 : 0))
+		return (unsigned int)readBigEndian(2);
+	else if(header == base + (base == 0xd9 ? 2 : 1))
+		return (unsigned int)readBigEndian(4);
+
+	throw Error("Unexpected MessagePack type.");
+}
+
+
+void MsgPackReader::need(unsigned int bytes)
+{
+	if(position + bytes > length)
+		throw Error("MessagePack data is truncated.");
+}
+
+
+
+void Base64::encode(const unsigned char* data, unsigned int length, string &text)
+{
+	unsigned int value = 0;
+	unsigned int i = 0;
+
+	text.reserve(text.size() + ((length + 2) / 3) * 4);
+	for(i = 0; i + 2 < length; i += 3)
+	{
+		value = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+		text.push_back(base64Chars[(value >> 18) & 0x3F]);
+		text.push_back(base64Chars[(value >> 12) & 0x3F]);
+		text.push_back(base64Chars[(value >> 6) & 0x3F]);
+		text.push_back(base64Chars[value & 0x3F]);
+	}
+
+	if(i < length)
+	{
+		value = data[i] << 16;
+		if(i + 1 < length)
+			value |= data[i + 1] << 8;
+		text.push_back(base64Chars[(value >> 18) & 0x3F]);
+		text.push_back(base64Chars[(value >> 12) & 0x3F]);
+		text.push_back(i + 1 < length ? base64Chars[(value >> 6) & 0x3F] : '=');
+		text.push_back('=');
+	}
+}
+
+
+void Base64::decode(const char* text, unsigned int length, vector<unsigned char> &data)
+{
+	unsigned int value = 0;
+	unsigned int bits = 0;
+	const char* position = NULL;
+
+	data.reserve(data.size() + (length / 4) * 3);
+	for(unsigned int i = 0; i < length; i++)
+	{
+		if(text[i] == '=')
+			break;
+
+		position = strchr(base64Chars, text[i]);
+		if(position == NULL || text[i] == '\0')
+			throw Error("Invalid base64 character.");
+
+		value = (value << 6) | (position - base64Chars);
+		bits += 6;
+		if(bits >= 8)
+		{
+			bits -= 8;
+			data.push_back((unsigned char)(value >> bits));
+		}
+	}
+}
@@ -0,0 +1,65 @@
+
+#include <cstring>
+
+#include "NameIndex.hpp"
+
+
+NameIndex::NameIndex(const char* const* names, unsigned int count)
+{
+	unsigned int size = 1;
+	unsigned int slot = 0;
+	bool collision = true;
+
+	this->names = names;
+	for(unsigned int i = 0; i < count; i++)
+		lengths.push_back(strlen(names[i]));
+
+	while(size < 2 * count)
+		size *= 2;
+
+	//try seeds till every name has its own slot, use a bigger table if no seed is found
+	seed = 0;
+	while(collision)
+	{
+		mask = size - 1;
+		slots.assign(size, -1);
+		collision = false;
+
+		for(unsigned int i = 0; i < count && !collision; i++)
+		{
+			slot = hash(names[i], lengths[i], seed) & mask;
+			if(slots[slot] != -1)
+				collision = true;
+			else
+				slots[slot] = i;
+		}
+
+		if(collision && ++seed % 64 == 0)
+			size *= 2;
+	}
+}
+
+
+int NameIndex::find(const char* name, unsigned int length) const
+{
+	int index = slots[hash(name, length, seed) & mask];
+
+	if(index < 0 || lengths[index] != length || memcmp(names[index], name, length) != 0)
+		return -1;
+
+	return index;
+}
+
+
+unsigned int NameIndex::hash(const char* name, unsigned int length, unsigned int seed)
+{
+	unsigned int value = 2166136261U ^ seed;
+
+	for(unsigned int i = 0; i < length; i++)
+	{
+		value ^= (unsigned char)name[i];
+		value *= 16777619U;
+	}
+
+	return value;
+}
@@ -0,0 +1,180 @@
+
+#include <ctime>
+
+#include "ReadCoalescer.hpp"
+
+
+ReadCoalescer::ReadCoalescer()
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&done, NULL);
+}
+
+
+ReadCoalescer::~ReadCoalescer()
+{
+	map<ReadKey, Flight*>::iterator flight;
+
+	for(flight = flights.begin(); flight != flights.end(); ++flight)
+		release(flight->second);
+
+	pthread_cond_destroy(&done);
+	pthread_mutex_destroy(&mutex);
+}
+
+
+ReadCoalescer::Flight* ReadCoalescer::join(const ReadKey &key, unsigned int maxAge, bool &leader)
+{
+	map<ReadKey, Flight*>::iterator entry;
+	Flight* flight = NULL;
+	unsigned long long currentTime = now();
+
+	pthread_mutex_lock(&mutex);
+	removeExpired(currentTime);
+
+	entry = flights.find(key);
+	if(entry != flights.end())
+	{
+		flight = entry->second;
+		//a flight in progress or a result which is young enough for the caller, without max_age a result is never reused
+		if(!flight->done || (maxAge > 0 && currentTime - flight->doneTime <= maxAge))
+		{
+			++flight->references;
+			leader = false;
+			pthread_mutex_unlock(&mutex);
+			return flight;
+		}
+		flights.erase(entry);
+		release(flight);
+	}
+
+	flight = new Flight;
+	flight->done = false;
+	flight->error = NULL;
+	flight->doneTime = 0;
+	//one for the table, one for the leader
+	flight->references = 2;
+	flights.insert(pair<ReadKey, Flight*>(key, flight));
+	leader = true;
+
+	pthread_mutex_unlock(&mutex);
+	return flight;
+}
+
+
+void ReadCoalescer::complete(Flight* flight, const unsigned char* data, unsigned int count)
+{
+	pthread_mutex_lock(&mutex);
+	flight->data.assign(data, data + count);
+	flight->doneTime = now();
+	flight->done = true;
+	release(flight);
+	pthread_cond_broadcast(&done);
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void ReadCoalescer::fail(Flight* flight, Error &error)
+{
+	map<ReadKey, Flight*>::iterator entry;
+
+	pthread_mutex_lock(&mutex);
+	flight->error = new Error(error);
+	flight->doneTime = now();
+	flight->done = true;
+
+	//a error is never cached
+	for(entry = flights.begin(); entry != flights.end(); ++entry)
+	{
+		if(entry->second == flight)
+		{
+			flights.erase(entry);
+			release(flight);
+			break;
+		}
+	}
+	release(flight);
+	pthread_cond_broadcast(&done);
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void ReadCoalescer::wait(Flight* flight, vector<unsigned char> &data)
+{
+	Error* error = NULL;
+
+	pthread_mutex_lock(&mutex);
+	while(!flight->done)
+		pthread_cond_wait(&done, &mutex);
+
+	if(flight->error != NULL)
+		error = new Error(*flight->error);
+	else
+		data = flight->data;
+	release(flight);
+	pthread_mutex_unlock(&mutex);
+
+	if(error != NULL)
+	{
+		Error copy(*error);
+		delete error;
+		throw copy;
+	}
+}
+
+
+void ReadCoalescer::invalidate(unsigned int device, int slaveAddr)
+{
+	map<ReadKey, Flight*>::iterator entry;
+
+	pthread_mutex_lock(&mutex);
+	entry = flights.begin();
+	while(entry != flights.end())
+	{
+		if(entry->first.device == device && entry->first.slaveAddr == slaveAddr)
+		{
+			//participants of a flight in progress keep their references
+			release(entry->second);
+			flights.erase(entry++);
+		}
+		else
+			++entry;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void ReadCoalescer::release(Flight* flight)
+{
+	if(--flight->references == 0)
+	{
+		delete flight->error;
+		delete flight;
+	}
+}
+
+
+void ReadCoalescer::removeExpired(unsigned long long now)
+{
+	map<ReadKey, Flight*>::iterator entry = flights.begin();
+
+	while(entry != flights.end())
+	{
+		if(entry->second->done && now - entry->second->doneTime > I2C_READ_CACHE_MAX_AGE)
+		{
+			release(entry->second);
+			flights.erase(entry++);
+		}
+		else
+			++entry;
+	}
+}
+
+
+unsigned long long ReadCoalescer::now()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (unsigned long long)time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
@@ -0,0 +1,103 @@
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <cstring>
+#include <ctime>
+
+#include "Recorder.hpp"
+#include "JsonRPC.hpp"
+
+
+Recorder::Recorder(const char* path)
+{
+	end = I2C_RECORD_HEADER_SIZE;
+	connections = 0;
+	dropped = 0;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+		throw Error("Could not create recording.");
+
+	//the file is filled with zeros, so every record which is not complete has the length 0
+	if(ftruncate(fd, I2C_RECORD_FILE_SIZE) != 0)
+	{
+		close(fd);
+		throw Error("Could not resize recording.");
+	}
+
+	mapping = (char*)mmap(NULL, I2C_RECORD_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(mapping == MAP_FAILED)
+	{
+		close(fd);
+		throw Error("Could not map recording.");
+	}
+	memcpy(mapping, I2C_RECORD_MAGIC, I2C_RECORD_HEADER_SIZE);
+}
+
+
+Recorder::~Recorder()
+{
+	size_t size = __atomic_load_n(&end, __ATOMIC_ACQUIRE);
+
+	if(size > I2C_RECORD_FILE_SIZE)
+		size = I2C_RECORD_FILE_SIZE;
+
+	msync(mapping, I2C_RECORD_FILE_SIZE, MS_SYNC);
+	munmap(mapping, I2C_RECORD_FILE_SIZE);
+	//keep the terminating length 0, if there is space for it
+	if(size + sizeof(unsigned int) <= I2C_RECORD_FILE_SIZE)
+		size += sizeof(unsigned int);
+	if(ftruncate(fd, size) != 0)
+	{
+		//the recording is still valid with its full size
+	}
+	close(fd);
+}
+
+
+unsigned int Recorder::nextConnection()
+{
+	return __atomic_add_fetch(&connections, 1, __ATOMIC_RELAXED);
+}
+
+
+void Recorder::record(RecordType type, unsigned int connection, const char* message, unsigned int length)
+{
+	RecordHeader header;
+	size_t size = (I2C_RECORD_ENTRY_HEADER_SIZE + length + 7) & ~(size_t)7;
+	size_t offset = __atomic_fetch_add(&end, size, __ATOMIC_RELAXED);
+
+	//the space after a dropped record stays zero, so a reader stops there
+	if(offset + size > I2C_RECORD_FILE_SIZE)
+	{
+		__atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.type = (unsigned char)type;
+	header.connection = connection;
+	header.time = now();
+
+	memcpy(mapping + offset + sizeof(header.length), (char*)&header + sizeof(header.length),
+			I2C_RECORD_ENTRY_HEADER_SIZE - sizeof(header.length));
+	memcpy(mapping + offset + I2C_RECORD_ENTRY_HEADER_SIZE, message, length);
+	//the length completes the record
+	__atomic_store_n((unsigned int*)(mapping + offset), length, __ATOMIC_RELEASE);
+}
+
+
+unsigned long long Recorder::getDropped()
+{
+	return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+
+unsigned long long Recorder::now()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (unsigned long long)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
@@ -0,0 +1,93 @@
+#include <unistd.h>
+#include <poll.h>
+
+#include "SessionSweeper.hpp"
+#include "I2c.hpp"
+
+
+SessionSweeper::SessionSweeper()
+{
+	running = false;
+	stopPipe[0] = -1;
+	stopPipe[1] = -1;
+	pthread_mutex_init(&mutex, NULL);
+}
+
+
+SessionSweeper::~SessionSweeper()
+{
+	stop();
+	pthread_mutex_destroy(&mutex);
+}
+
+
+void SessionSweeper::start()
+{
+	if(pipe(stopPipe) != 0)
+		throw Error("Could not create pipe of session sweeper.");
+	if(pthread_create(&thread, NULL, sweepThread, this) != 0)
+	{
+		close(stopPipe[0]);
+		close(stopPipe[1]);
+		throw Error("Could not create thread of session sweeper.");
+	}
+	running = true;
+}
+
+
+void SessionSweeper::stop()
+{
+	char stop = 0;
+
+	if(!running)
+		return;
+	if(::write(stopPipe[1], &stop, 1) == 1)
+		pthread_join(thread, NULL);
+	close(stopPipe[0]);
+	close(stopPipe[1]);
+	running = false;
+}
+
+
+void SessionSweeper::add(I2c* i2c)
+{
+	pthread_mutex_lock(&mutex);
+	instances.push_back(i2c);
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void SessionSweeper::remove(I2c* i2c)
+{
+	pthread_mutex_lock(&mutex);
+	instances.remove(i2c);
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void* SessionSweeper::sweepThread(void* arg)
+{
+	SessionSweeper* sweeper = (SessionSweeper*)arg;
+	struct pollfd fds[1];
+	list<I2c*>::iterator i2c;
+
+	fds[0].fd = sweeper->stopPipe[0];
+	fds[0].events = POLLIN;
+
+	while(true)
+	{
+		fds[0].revents = 0;
+		if(poll(fds, 1, I2C_SESSION_SWEEP_INTERVAL) < 0)
+			continue;
+		if(fds[0].revents != 0)
+			break;
+
+		//the mutex keeps remove() and so the deletion of a instance waiting till its sweep is finished
+		pthread_mutex_lock(&sweeper->mutex);
+		for(i2c = sweeper->instances.begin(); i2c != sweeper->instances.end(); ++i2c)
+			(*i2c)->sweepIdleSessions();
+		pthread_mutex_unlock(&sweeper->mutex);
+	}
+
+	return NULL;
+}
@@ -0,0 +1,54 @@
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ShmRing.hpp"
+#include "JsonRPC.hpp"
+
+
+ShmRing::ShmRing(size_t size)
+{
+	this->size = size;
+	head = 0;
+	memory = NULL;
+
+	fd = memfd_create("i2c-payload", MFD_CLOEXEC);
+	if(fd < 0)
+		throw Error("Could not create shared memory for payloads.");
+
+	if(ftruncate(fd, size) < 0)
+	{
+		close(fd);
+		throw Error("Could not resize shared memory for payloads.");
+	}
+
+	memory = (unsigned char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(memory == MAP_FAILED)
+	{
+		close(fd);
+		throw Error("Could not map shared memory for payloads.");
+	}
+}
+
+
+ShmRing::~ShmRing()
+{
+	munmap(memory, size);
+	close(fd);
+}
+
+
+size_t ShmRing::reserve(size_t length)
+{
+	size_t offset = 0;
+
+	if(length > size)
+		throw Error("Payload is bigger than shared memory.");
+
+	if(head + length > size)
+		head = 0;
+
+	offset = head;
+	head += length;
+	return offset;
+}
@@ -0,0 +1,154 @@
+
+#include "SimDevice.hpp"
+
+/*! Period of the simulated temperature in nanoseconds.*/
+#define SIM_TEMPERATURE_PERIOD 1000000000ULL
+
+
+SimEeprom::SimEeprom(int address, unsigned int size, unsigned int pageSize, unsigned int addressBytes, unsigned long long writeCycleTime)
+	: SimDevice(address), memory(size, 0xFF)
+{
+	this->pageSize = pageSize;
+	this->addressBytes = addressBytes;
+	this->writeCycleTime = writeCycleTime;
+	busyUntil = 0;
+	pointer = 0;
+	bytesWritten = 0;
+}
+
+
+bool SimEeprom::start(bool read, unsigned long long now)
+{
+	if(now < busyUntil)
+		return false;
+
+	bytesWritten = 0;
+	return true;
+}
+
+
+bool SimEeprom::writeByte(unsigned char byte, unsigned long long now)
+{
+	unsigned int pageStart = 0;
+
+	if(bytesWritten < addressBytes)
+	{
+		if(bytesWritten == 0)
+			pointer = byte;
+		else
+			pointer = (pointer << 8) | byte;
+		pointer = pointer % memory.size();
+	}
+	else
+	{
+		//address pointer wraps around within the page
+		pageStart = pointer - (pointer % pageSize);
+		memory[pointer] = byte;
+		pointer = pageStart + ((pointer + 1) % pageSize);
+	}
+	++bytesWritten;
+	return true;
+}
+
+
+unsigned char SimEeprom::readByte(unsigned long long now)
+{
+	unsigned char byte = memory[pointer];
+
+	pointer = (pointer + 1) % memory.size();
+	return byte;
+}
+
+
+void SimEeprom::stop(unsigned long long now)
+{
+	if(bytesWritten > addressBytes)
+		busyUntil = now + writeCycleTime;
+
+	bytesWritten = 0;
+}
+
+
+
+SimRegisterFile::SimRegisterFile(int address, unsigned int numRegisters)
+	: SimDevice(address), registers(numRegisters, 0), readOnly(numRegisters, false)
+{
+	pointer = 0;
+	pointerExpected = true;
+}
+
+
+bool SimRegisterFile::start(bool read, unsigned long long now)
+{
+	if(!read)
+		pointerExpected = true;
+
+	return true;
+}
+
+
+bool SimRegisterFile::writeByte(unsigned char byte, unsigned long long now)
+{
+	if(pointerExpected)
+	{
+		pointer = byte % registers.size();
+		pointerExpected = false;
+	}
+	else
+	{
+		if(!readOnly[pointer])
+			registers[pointer] = byte;
+		pointer = (pointer + 1) % registers.size();
+	}
+	return true;
+}
+
+
+unsigned char SimRegisterFile::readByte(unsigned long long now)
+{
+	unsigned char byte = readRegister(pointer, now);
+
+	pointer = (pointer + 1) % registers.size();
+	return byte;
+}
+
+
+void SimRegisterFile::setRegister(unsigned int reg, unsigned char value)
+{
+	registers[reg % registers.size()] = value;
+}
+
+
+void SimRegisterFile::setReadOnly(unsigned int reg, bool readOnly)
+{
+	this->readOnly[reg % registers.size()] = readOnly;
+}
+
+
+
+SimTemperatureSensor::SimTemperatureSensor(int address) : SimRegisterFile(address, 3)
+{
+	setReadOnly(0, true);
+	setReadOnly(1, true);
+}
+
+
+unsigned char SimTemperatureSensor::readRegister(unsigned int reg, unsigned long long now)
+{
+	unsigned long long phase = now % SIM_TEMPERATURE_PERIOD;
+	unsigned int halfDegrees = 0;
+
+	if(reg > 1)
+		return registers[reg];
+
+	//triangle wave between 20 °C (40 half degrees) and 40 °C (80 half degrees)
+	if(phase < SIM_TEMPERATURE_PERIOD / 2)
+		halfDegrees = 40 + (unsigned int)(phase * 80 / SIM_TEMPERATURE_PERIOD);
+	else
+		halfDegrees = 120 - (unsigned int)(phase * 80 / SIM_TEMPERATURE_PERIOD);
+
+	if(reg == 0)
+		return (unsigned char)(halfDegrees >> 1);
+	else
+		return (unsigned char)((halfDegrees & 0x01) << 7);
+}
@@ -0,0 +1,282 @@
+
+#include <ctime>
+
+#include "SimulatedBackend.hpp"
+#include "RemoteAardvark.hpp"
+
+
+SimulatedBus::SimulatedBus()
+{
+	bitrate = SIM_DEFAULT_BITRATE;
+	now = 0;
+	pthread_mutex_init(&mutex, NULL);
+}
+
+
+SimulatedBus::~SimulatedBus()
+{
+	list<SimDevice*>::iterator device = devices.begin();
+
+	while(device != devices.end())
+	{
+		delete *device;
+		device = devices.erase(device);
+	}
+	pthread_mutex_destroy(&mutex);
+}
+
+
+void SimulatedBus::addDevice(SimDevice* device)
+{
+	devices.push_back(device);
+}
+
+
+void SimulatedBus::write(int slaveAddr, const unsigned char* data, unsigned int length, bool stop)
+{
+	SimDevice* device = start(slaveAddr, false);
+
+	for(unsigned int i = 0; i < length; i++)
+	{
+		clock(9);
+		if(!device->writeByte(data[i], now))
+		{
+			device->stop(now);
+			throw Error(I2C_BUS_ERROR_CODE(AA_I2C_STATUS_DATA_NACK), "Simulated slave did not acknowledge data.");
+		}
+	}
+
+	if(stop)
+	{
+		clock(1);
+		device->stop(now);
+	}
+}
+
+
+void SimulatedBus::read(int slaveAddr, unsigned char* data, unsigned int length, bool stop)
+{
+	SimDevice* device = start(slaveAddr, true);
+
+	for(unsigned int i = 0; i < length; i++)
+	{
+		clock(9);
+		data[i] = device->readByte(now);
+	}
+
+	if(stop)
+	{
+		clock(1);
+		device->stop(now);
+	}
+}
+
+
+SimDevice* SimulatedBus::start(int slaveAddr, bool read)
+{
+	list<SimDevice*>::iterator device = devices.begin();
+
+	//start + address byte + ack
+	clock(10);
+	while(device != devices.end())
+	{
+		if((*device)->getAddress() == slaveAddr)
+		{
+			if((*device)->start(read, now))
+				return *device;
+			break;
+		}
+		++device;
+	}
+
+	clock(1);
+	throw Error(I2C_BUS_ERROR_CODE(AA_I2C_STATUS_SLA_NACK), "Simulated slave did not acknowledge its address.");
+}
+
+
+void SimulatedBus::clock(unsigned int bits)
+{
+	//bitrate is in kilohertz, so one bit takes 1000000 / bitrate nanoseconds
+	now += (unsigned long long)bits * 1000000ULL / bitrate;
+}
+
+
+
+SimulatedBackend::SimulatedBackend(int numBuses, bool realTime)
+{
+	SimulatedBus* bus = NULL;
+
+	this->realTime = realTime;
+	pthread_mutex_init(&mutex, NULL);
+
+	for(int i = 0; i < numBuses; i++)
+	{
+		bus = new SimulatedBus();
+		bus->addDevice(new SimEeprom(0x50, 32768, 64, 2, 5000000ULL));
+		bus->addDevice(new SimEeprom(0x51, 256, 8, 1, 5000000ULL));
+		bus->addDevice(new SimTemperatureSensor(0x48));
+		bus->addDevice(new SimRegisterFile(0x20, 256));
+		buses.push_back(bus);
+		opened.push_back(false);
+	}
+}
+
+
+SimulatedBackend::~SimulatedBackend()
+{
+	for(unsigned int i = 0; i < buses.size(); i++)
+		delete buses[i];
+
+	pthread_mutex_destroy(&mutex);
+}
+
+
+void SimulatedBackend::findDevices(list<I2cDevice*> &deviceList)
+{
+	for(unsigned int i = 0; i < buses.size(); i++)
+		deviceList.push_back(new I2cDevice(getName(), i, SIM_UNIQUE_ID_BASE + i));
+}
+
+
+int SimulatedBackend::open(int port)
+{
+	getBus(port);
+
+	pthread_mutex_lock(&mutex);
+	if(opened[port])
+	{
+		pthread_mutex_unlock(&mutex);
+		throw Error("Simulated bus is already open.");
+	}
+	opened[port] = true;
+	pthread_mutex_unlock(&mutex);
+
+	//handle 0 is not valid, like for an Aardvark
+	return port + 1;
+}
+
+
+void SimulatedBackend::write(int handle, int slaveAddr, int flags, const unsigned char* data, unsigned int length)
+{
+	I2cMessage message;
+
+	message.slaveAddr = slaveAddr;
+	message.flags = flags;
+	message.read = false;
+	message.data = (unsigned char*)data;
+	message.length = length;
+	message.count = 0;
+	transfer(handle, &message, 1);
+}
+
+
+unsigned int SimulatedBackend::read(int handle, int slaveAddr, int flags, unsigned char* data, unsigned int length)
+{
+	I2cMessage message;
+
+	message.slaveAddr = slaveAddr;
+	message.flags = flags;
+	message.read = true;
+	message.data = data;
+	message.length = length;
+	message.count = 0;
+	transfer(handle, &message, 1);
+	return message.count;
+}
+
+
+int SimulatedBackend::configure(int handle, int bitrate)
+{
+	SimulatedBus* bus = getBusByHandle(handle);
+
+	if(bitrate <= 0)
+		throw Error("Bitrate has to be greater than 0.");
+
+	bus->lock();
+	bus->setBitrate(bitrate);
+	bus->unlock();
+	return bitrate;
+}
+
+
+void SimulatedBackend::transfer(int handle, I2cMessage* messages, unsigned int numMessages)
+{
+	SimulatedBus* bus = getBusByHandle(handle);
+	unsigned long long start = 0;
+	bool stop = false;
+
+	bus->lock();
+	start = bus->getTime();
+	try
+	{
+		for(unsigned int i = 0; i < numMessages; i++)
+		{
+			stop = (i == numMessages - 1) && !(messages[i].flags & AA_I2C_NO_STOP);
+			if(messages[i].read)
+				bus->read(messages[i].slaveAddr, messages[i].data, messages[i].length, stop);
+			else
+				bus->write(messages[i].slaveAddr, messages[i].data, messages[i].length, stop);
+			messages[i].count = messages[i].length;
+		}
+	}
+	catch(Error &e)
+	{
+		waitRealTime(bus, start);
+		bus->unlock();
+		throw;
+	}
+	waitRealTime(bus, start);
+	bus->unlock();
+}
+
+
+void SimulatedBackend::close(int handle)
+{
+	getBusByHandle(handle);
+
+	pthread_mutex_lock(&mutex);
+	opened[handle - 1] = false;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+SimulatedBus* SimulatedBackend::getBus(int port)
+{
+	if(port < 0 || port >= (int)buses.size())
+		throw Error("Simulated bus does not exist.");
+
+	return buses[port];
+}
+
+
+SimulatedBus* SimulatedBackend::getBusByHandle(int handle)
+{
+	bool isOpen = false;
+
+	if(handle < 1 || handle > (int)buses.size())
+		throw Error("Invalid handle of simulated bus.");
+
+	pthread_mutex_lock(&mutex);
+	isOpen = opened[handle - 1];
+	pthread_mutex_unlock(&mutex);
+
+	if(!isOpen)
+		throw Error("Simulated bus is not open.");
+
+	return buses[handle - 1];
+}
+
+
+void SimulatedBackend::waitRealTime(SimulatedBus* bus, unsigned long long start)
+{
+	struct timespec duration;
+	unsigned long long elapsed = 0;
+
+	if(!realTime)
+		return;
+
+	elapsed = bus->getTime() - start;
+	duration.tv_sec = elapsed / 1000000000ULL;
+	duration.tv_nsec = elapsed % 1000000000ULL;
+	nanosleep(&duration, NULL);
+}
@@ -0,0 +1,172 @@
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <cstdio>
+#include <ctime>
+
+#include "Tracer.hpp"
+#include "JsonRPC.hpp"
+
+
+Tracer::Tracer()
+{
+	next = 0;
+	count = 0;
+	enabled = false;
+	pthread_mutex_init(&mutex, NULL);
+}
+
+
+Tracer::~Tracer()
+{
+	pthread_mutex_destroy(&mutex);
+}
+
+
+void Tracer::enable(bool enabled)
+{
+	pthread_mutex_lock(&mutex);
+	//the buffer is only allocated if tracing is used
+	if(enabled && spans.empty())
+		spans.resize(I2C_TRACE_SPANS);
+	this->enabled = enabled;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+bool Tracer::isEnabled()
+{
+	bool result = false;
+
+	pthread_mutex_lock(&mutex);
+	result = enabled;
+	pthread_mutex_unlock(&mutex);
+	return result;
+}
+
+
+void Tracer::record(const char* category, const char* name, unsigned long long start, unsigned long long end,
+		const char* requestId, long long device)
+{
+	Span* span = NULL;
+
+	pthread_mutex_lock(&mutex);
+	if(enabled)
+	{
+		span = &spans[next];
+		span->category = category;
+		copyName(span->name, name);
+		copyName(span->requestId, requestId != NULL ? requestId : "");
+		span->device = device;
+		span->start = start;
+		span->duration = end - start;
+		span->thread = syscall(SYS_gettid);
+
+		next = (next + 1) % I2C_TRACE_SPANS;
+		if(count < I2C_TRACE_SPANS)
+			++count;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+
+unsigned int Tracer::dump(const char* path)
+{
+	vector<Span> copy;
+	FILE* file = NULL;
+	struct stat status;
+	int fd = -1;
+	unsigned int first = 0;
+	Span* span = NULL;
+
+	//copy the spans, so recording does not wait for the file
+	pthread_mutex_lock(&mutex);
+	copy.reserve(count);
+	first = (next + I2C_TRACE_SPANS - count) % I2C_TRACE_SPANS;
+	for(unsigned int i = 0; i < count; i++)
+		copy.push_back(spans[(first + i) % I2C_TRACE_SPANS]);
+	pthread_mutex_unlock(&mutex);
+
+	//any client can trigger the dump and the file is in a world-writable directory, so a symlink or a file of another
+	//user which was created there before is not followed
+	fd = open(path, O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if(fd < 0)
+		throw Error("Could not open trace file.");
+	if(fstat(fd, &status) != 0 || !S_ISREG(status.st_mode) || status.st_uid != geteuid())
+	{
+		close(fd);
+		throw Error("Trace file is not a regular file of the plugin.");
+	}
+	//truncated only after the check, a file of another user stays untouched
+	if(ftruncate(fd, 0) != 0)
+	{
+		close(fd);
+		throw Error("Could not write trace file.");
+	}
+
+	file = fdopen(fd, "w");
+	if(file == NULL)
+	{
+		close(fd);
+		throw Error("Could not open trace file.");
+	}
+
+	fprintf(file, "{\"traceEvents\":[");
+	for(unsigned int i = 0; i < copy.size(); i++)
+	{
+		span = &copy[i];
+		fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%ld,"
+				"\"args\":{\"request\":\"%s\",\"device\":%lld}}", i > 0 ? "," : "", span->name, span->category, span->start,
+				span->duration, (int)getpid(), span->thread, span->requestId, span->device);
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	if(fclose(file) != 0)
+		throw Error("Could not write trace file.");
+
+	return copy.size();
+}
+
+
+unsigned long long Tracer::now()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (unsigned long long)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+
+void Tracer::copyName(char* target, const char* source)
+{
+	unsigned int i = 0;
+
+	for(i = 0; i < I2C_TRACE_NAME_LENGTH - 1 && source[i] != '\0'; i++)
+	{
+		if(source[i] == '"' || source[i] == '\\' || (unsigned char)source[i] < 0x20)
+			target[i] = '_';
+		else
+			target[i] = source[i];
+	}
+	target[i] = '\0';
+}
+
+
+TraceSpan::TraceSpan(Tracer* tracer, const char* category, const char* name, const char* requestId, long long device)
+{
+	this->tracer = (tracer != NULL && tracer->isEnabled()) ? tracer : NULL;
+	this->category = category;
+	this->name = name;
+	this->requestId = requestId;
+	this->device = device;
+	start = this->tracer != NULL ? Tracer::now() : 0;
+}
+
+
+TraceSpan::~TraceSpan()
+{
+	if(tracer != NULL)
+		tracer->record(category, name, start, Tracer::now(), requestId, device);
+}
@@ -0,0 +1,113 @@
+
+#include "WorkspacePool.hpp"
+
+
+WorkspacePool::WorkspacePool()
+{
+	idleList = NULL;
+	idle = 0;
+	inUse = 0;
+	pthread_mutex_init(&mutex, NULL);
+}
+
+
+WorkspacePool::~WorkspacePool()
+{
+	Workspace* workspace = NULL;
+
+	while(idleList != NULL)
+	{
+		workspace = idleList;
+		idleList = workspace->next;
+		delete workspace;
+	}
+	pthread_mutex_destroy(&mutex);
+}
+
+
+Workspace* WorkspacePool::acquire()
+{
+	Workspace* workspace = NULL;
+
+	pthread_mutex_lock(&mutex);
+	if(idleList != NULL)
+	{
+		workspace = idleList;
+		idleList = workspace->next;
+		--idle;
+	}
+	++inUse;
+	pthread_mutex_unlock(&mutex);
+
+	//a new workspace is created without holding the pool
+	if(workspace == NULL)
+		workspace = new Workspace();
+	workspace->next = NULL;
+	return workspace;
+}
+
+
+void WorkspacePool::release(Workspace* workspace)
+{
+	bool keep = getBytes(workspace) <= I2C_WORKSPACE_MAX_BYTES;
+
+	//the allocators only grow till they are cleared, a kept workspace starts the next request empty
+	if(keep)
+		clear(workspace);
+
+	pthread_mutex_lock(&mutex);
+	--inUse;
+	if(keep && idle < I2C_WORKSPACE_MAX_IDLE)
+	{
+		workspace->next = idleList;
+		idleList = workspace;
+		++idle;
+		workspace = NULL;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	delete workspace;
+}
+
+
+void WorkspacePool::getUsage(unsigned int &inUse, unsigned int &idle, size_t &idleBytes)
+{
+	Workspace* workspace = NULL;
+
+	pthread_mutex_lock(&mutex);
+	inUse = this->inUse;
+	idle = this->idle;
+	idleBytes = 0;
+	for(workspace = idleList; workspace != NULL; workspace = workspace->next)
+		idleBytes += getBytes(workspace);
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void WorkspacePool::clear(Workspace* workspace)
+{
+	clear(&workspace->mainRequestDom);
+	clear(&workspace->subResponseDom);
+	clear(workspace->json.getRequestDOM());
+	clear(workspace->json.getResponseDOM());
+	clear(workspace->json.getErrorDOM());
+	workspace->subRequestAllocator.Clear();
+}
+
+
+void WorkspacePool::clear(Document* dom)
+{
+	//the root value must not point into the freed memory
+	dom->SetNull();
+	dom->GetAllocator().Clear();
+}
+
+
+size_t WorkspacePool::getBytes(Workspace* workspace)
+{
+	return sizeof(Workspace) + workspace->mainRequestDom.GetAllocator().Capacity()
+			+ workspace->subResponseDom.GetAllocator().Capacity() + workspace->subRequestAllocator.Capacity()
+			+ workspace->json.getRequestDOM()->GetAllocator().Capacity()
+			+ workspace->json.getResponseDOM()->GetAllocator().Capacity()
+			+ workspace->json.getErrorDOM()->GetAllocator().Capacity();
+}
@@ -0,0 +1,254 @@
+/**
+ * Checks of ReadCoalescer (identical concurrent reads of i2c.read): all participants of a flight get the bytes or the
+ * error of the leader, which reads from the register file of a simulated bus.
+ */
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "ReadCoalescer.hpp"
+#include "SimulatedBackend.hpp"
+#include "RemoteAardvark.hpp"
+#include "Test.hpp"
+
+using namespace std;
+
+/*! The first simulated bus.*/
+#define DEVICE SIM_UNIQUE_ID_BASE
+/*! Address of the register file of the simulated bus.*/
+#define REGISTER_FILE 0x20
+/*! Address without a slave on the simulated bus.*/
+#define MISSING_SLAVE 0x70
+/*! Number of participants besides the leader.*/
+#define WAITERS 4
+
+
+/**
+ * \struct Waiter
+ * Participant of a flight which waits for the result in its own thread.
+ */
+struct Waiter{
+	/*! Shared coalescer.*/
+	ReadCoalescer* reads;
+	/*! Flight returned by join().*/
+	ReadCoalescer::Flight* flight;
+	/*! Bytes of the flight.*/
+	vector<unsigned char> data;
+	/*! True if the flight failed.*/
+	bool failed;
+	/*! Message of the error of the flight.*/
+	string error;
+};
+
+
+/** \return Key of a read of the register file.*/
+static ReadKey makeKey(int slaveAddr, unsigned int memAddr, unsigned int length, int bitrate)
+{
+	ReadKey key;
+
+	key.device = DEVICE;
+	key.slaveAddr = slaveAddr;
+	key.memAddr = memAddr;
+	key.length = length;
+	key.bitrate = bitrate;
+	return key;
+}
+
+
+/** Reads registers with a repeated start, like I2c::readRegister.*/
+static void readRegisters(SimulatedBackend &sim, int slaveAddr, unsigned char memAddr, vector<unsigned char> &data)
+{
+	I2cMessage messages[2];
+	int handle = sim.open(0);
+
+	messages[0].slaveAddr = slaveAddr;
+	messages[0].flags = AA_I2C_NO_FLAGS;
+	messages[0].read = false;
+	messages[0].data = &memAddr;
+	messages[0].length = 1;
+	messages[0].count = 0;
+	messages[1].slaveAddr = slaveAddr;
+	messages[1].flags = AA_I2C_NO_FLAGS;
+	messages[1].read = true;
+	messages[1].data = &data[0];
+	messages[1].length = data.size();
+	messages[1].count = 0;
+
+	try
+	{
+		sim.transfer(handle, messages, 2);
+	}
+	catch(Error &e)
+	{
+		sim.close(handle);
+		throw;
+	}
+	sim.close(handle);
+}
+
+
+/** Thread function of a Waiter.*/
+static void* waitForFlight(void* arg)
+{
+	Waiter* waiter = (Waiter*)arg;
+
+	try
+	{
+		waiter->reads->wait(waiter->flight, waiter->data);
+	}
+	catch(Error &e)
+	{
+		waiter->failed = true;
+		waiter->error = e.get();
+	}
+	return NULL;
+}
+
+
+/** Joins WAITERS participants to the flight of key and starts their threads.*/
+static void startWaiters(ReadCoalescer &reads, const ReadKey &key, Waiter* waiters, pthread_t* threads)
+{
+	bool leader = true;
+
+	for(unsigned int i = 0; i < WAITERS; i++)
+	{
+		waiters[i].reads = &reads;
+		waiters[i].flight = reads.join(key, 0, leader);
+		waiters[i].failed = false;
+		CHECK(!leader);
+		pthread_create(&threads[i], NULL, waitForFlight, &waiters[i]);
+	}
+}
+
+
+/** All participants get the bytes of the leader, without max_age a finished flight is not reused.*/
+static void testSharedResult()
+{
+	ReadCoalescer reads;
+	SimulatedBackend sim(1, false);
+	ReadKey key = makeKey(REGISTER_FILE, 0x10, 4, 0);
+	ReadCoalescer::Flight* flight = NULL;
+	Waiter waiters[WAITERS];
+	pthread_t threads[WAITERS];
+	vector<unsigned char> data(4);
+	unsigned char values[5] = {0x10, 0xA1, 0xB2, 0xC3, 0xD4};
+	int handle = sim.open(0);
+	bool leader = false;
+
+	sim.write(handle, REGISTER_FILE, AA_I2C_NO_FLAGS, values, 5);
+	sim.close(handle);
+
+	flight = reads.join(key, 0, leader);
+	CHECK(leader);
+	startWaiters(reads, key, waiters, threads);
+
+	readRegisters(sim, REGISTER_FILE, 0x10, data);
+	reads.complete(flight, &data[0], data.size());
+
+	for(unsigned int i = 0; i < WAITERS; i++)
+	{
+		pthread_join(threads[i], NULL);
+		CHECK(!waiters[i].failed);
+		CHECK(waiters[i].data == data);
+	}
+	CHECK(data[0] == 0xA1 && data[3] == 0xD4);
+
+	//a read without max_age always reads the bus, even right after a finished flight
+	for(unsigned int i = 0; i < 100; i++)
+	{
+		flight = reads.join(key, 0, leader);
+		CHECK(leader);
+		if(leader)
+			reads.complete(flight, &data[0], data.size());
+		else
+			reads.wait(flight, waiters[0].data);
+	}
+
+	//a cached result is only returned to a read with max_age
+	flight = reads.join(key, 60000, leader);
+	CHECK(!leader);
+	if(!leader)
+	{
+		waiters[0].data.clear();
+		reads.wait(flight, waiters[0].data);
+		CHECK(waiters[0].data == data);
+	}
+}
+
+
+/** All participants get the error of the leader, a error is not cached.*/
+static void testSharedError()
+{
+	ReadCoalescer reads;
+	SimulatedBackend sim(1, false);
+	ReadKey key = makeKey(MISSING_SLAVE, 0, 2, 0);
+	ReadCoalescer::Flight* flight = NULL;
+	Waiter waiters[WAITERS];
+	pthread_t threads[WAITERS];
+	vector<unsigned char> data(2);
+	string error;
+	bool leader = false;
+
+	flight = reads.join(key, 0, leader);
+	CHECK(leader);
+	startWaiters(reads, key, waiters, threads);
+
+	try
+	{
+		readRegisters(sim, MISSING_SLAVE, 0, data);
+		CHECK(false);
+		reads.complete(flight, &data[0], data.size());
+	}
+	catch(Error &e)
+	{
+		error = e.get();
+		reads.fail(flight, e);
+	}
+
+	for(unsigned int i = 0; i < WAITERS; i++)
+	{
+		pthread_join(threads[i], NULL);
+		CHECK(waiters[i].failed);
+		CHECK(waiters[i].error == error);
+	}
+
+	flight = reads.join(key, 60000, leader);
+	CHECK(leader);
+	reads.complete(flight, &data[0], data.size());
+}
+
+
+/** Reads with other register, length or bitrate and reads after a write to the slave start their own flight.*/
+static void testKeys()
+{
+	ReadCoalescer reads;
+	ReadCoalescer::Flight* flights[5];
+	unsigned char data[4] = {1, 2, 3, 4};
+	bool leader = false;
+
+	flights[0] = reads.join(makeKey(REGISTER_FILE, 0x10, 4, 0), 0, leader);
+	CHECK(leader);
+	flights[1] = reads.join(makeKey(REGISTER_FILE, 0x11, 4, 0), 0, leader);
+	CHECK(leader);
+	flights[2] = reads.join(makeKey(REGISTER_FILE, 0x10, 2, 0), 0, leader);
+	CHECK(leader);
+	flights[3] = reads.join(makeKey(REGISTER_FILE, 0x10, 4, 400), 0, leader);
+	CHECK(leader);
+	for(unsigned int i = 0; i < 4; i++)
+		reads.complete(flights[i], data, 4);
+
+	reads.invalidate(DEVICE, REGISTER_FILE);
+	flights[4] = reads.join(makeKey(REGISTER_FILE, 0x10, 4, 0), 60000, leader);
+	CHECK(leader);
+	reads.complete(flights[4], data, 4);
+}
+
+
+int main(int argc, char** argv)
+{
+	testSharedResult();
+	testSharedError();
+	testKeys();
+	return testResult("CoalesceTest");
+}
@@ -0,0 +1,241 @@
+/**
+ * Checks of the order in which DeviceQueue grants a device: interactive requests go first, but a waiting bulk request
+ * gets its turn after at most I2C_QUEUE_BULK_SHARE interactive ones, and clients of the same class share the device
+ * by bytes (deficit round robin), not by requests. Every request logs its client into the register file of a simulated
+ * bus during its turn, so the registers show the order of the turns.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "DeviceQueue.hpp"
+#include "SimulatedBackend.hpp"
+#include "RemoteAardvark.hpp"
+#include "Test.hpp"
+
+using namespace std;
+
+/*! The first simulated bus.*/
+#define DEVICE SIM_UNIQUE_ID_BASE
+/*! Address of the register file of the simulated bus.*/
+#define REGISTER_FILE 0x20
+/*! First register of the log of the turns.*/
+#define LOG_REGISTER 0x80
+
+
+/**
+ * \struct Client
+ * Client with a number of requests of the same class and size.
+ */
+struct Client{
+	/*! Character of the client within the log.*/
+	char tag;
+	/*! Class of the requests.*/
+	QueuePriority priority;
+	/*! Bytes of every request.*/
+	unsigned int cost;
+	/*! Number of requests.*/
+	unsigned int requests;
+};
+
+
+/**
+ * \struct Shared
+ * Device which is shared by the requests.
+ */
+struct Shared{
+	/*! Queue of the device.*/
+	DeviceQueue queue;
+	/*! Backend of the device.*/
+	SimulatedBackend* sim;
+	/*! Number of turns so far, only changed by the request which has the device.*/
+	unsigned int turns;
+};
+
+
+/**
+ * \struct Request
+ * Request of a client which waits for its turn in its own thread.
+ */
+struct Request{
+	/*! The device.*/
+	Shared* shared;
+	/*! Client of the request, also the owner within the queue.*/
+	const Client* client;
+	/*! True if the request was rejected or the bus was used by another request at the same time.*/
+	bool failed;
+};
+
+
+/** Thread function of a Request, logs its client during its turn.*/
+static void* useDevice(void* arg)
+{
+	Request* request = (Request*)arg;
+	Shared* shared = request->shared;
+	unsigned char data[2] = {0, (unsigned char)request->client->tag};
+	int handle = -1;
+
+	try
+	{
+		shared->queue.enter(DEVICE, request->client, request->client->priority, request->client->cost);
+	}
+	catch(Error &e)
+	{
+		request->failed = true;
+		return NULL;
+	}
+
+	try
+	{
+		data[0] = LOG_REGISTER + shared->turns++;
+		handle = shared->sim->open(0);
+		shared->sim->write(handle, REGISTER_FILE, AA_I2C_NO_FLAGS, data, 2);
+		shared->sim->close(handle);
+	}
+	catch(Error &e)
+	{
+		request->failed = true;
+	}
+	shared->queue.leave(DEVICE, request->client);
+	return NULL;
+}
+
+
+/** Waits till a number of requests wait for the device, at most 5 s.*/
+static void waitForWaiting(DeviceQueue &queue, unsigned int waiting)
+{
+	DeviceQueue::Counters counters;
+
+	for(unsigned int i = 0; i < 500; i++)
+	{
+		queue.get(counters);
+		if(counters.waiting >= waiting)
+			return;
+		usleep(10000);
+	}
+}
+
+
+/**
+ * Queues all requests of the clients while the device is in use, in the order of the clients, and releases the device.
+ * \param clients The clients.
+ * \param numClients Number of clients.
+ * \return The tags of the clients in the order of their turns.
+ */
+static string runTurns(const Client* clients, unsigned int numClients)
+{
+	SimulatedBackend sim(1, false);
+	Shared shared;
+	vector<Request> requests;
+	vector<pthread_t> threads;
+	vector<unsigned char> log;
+	unsigned char reg = LOG_REGISTER;
+	int holder = 0;
+	int handle = -1;
+
+	shared.sim = &sim;
+	shared.turns = 0;
+	for(unsigned int i = 0; i < numClients; i++)
+	{
+		Request request = {&shared, &clients[i], false};
+		requests.insert(requests.end(), clients[i].requests, request);
+	}
+	threads.resize(requests.size());
+
+	shared.queue.enter(DEVICE, &holder);
+	for(unsigned int i = 0; i < requests.size(); i++)
+	{
+		pthread_create(&threads[i], NULL, useDevice, &requests[i]);
+		waitForWaiting(shared.queue, i + 1);
+	}
+	shared.queue.leave(DEVICE, &holder);
+
+	for(unsigned int i = 0; i < threads.size(); i++)
+	{
+		pthread_join(threads[i], NULL);
+		CHECK(!requests[i].failed);
+	}
+	CHECK(shared.turns == requests.size());
+
+	log.resize(requests.size());
+	handle = sim.open(0);
+	sim.write(handle, REGISTER_FILE, AA_I2C_NO_STOP, &reg, 1);
+	sim.read(handle, REGISTER_FILE, AA_I2C_NO_FLAGS, &log[0], log.size());
+	sim.close(handle);
+	return string(log.begin(), log.end());
+}
+
+
+/** Interactive requests go first, a waiting bulk request gets every I2C_QUEUE_BULK_SHARE + 1st turn.*/
+static void testBulkShare()
+{
+	const Client clients[2] = {{'B', QUEUE_BULK, 1, 3}, {'i', QUEUE_INTERACTIVE, 1, 10}};
+	string turns = runTurns(clients, 2);
+	unsigned int interactive = 0;
+	unsigned int bulk = 0;
+
+	CHECK(turns.size() == 13);
+	CHECK(turns[0] == 'i');
+	for(unsigned int i = 0; i < turns.size(); i++)
+	{
+		if(turns[i] == 'B')
+		{
+			//the bulk request only waits for a full share, unless there are no more interactive requests
+			CHECK(interactive == I2C_QUEUE_BULK_SHARE || turns.find('i', i) == string::npos);
+			interactive = 0;
+			++bulk;
+		}
+		else
+		{
+			++interactive;
+			CHECK(interactive <= I2C_QUEUE_BULK_SHARE || bulk == clients[0].requests);
+		}
+	}
+}
+
+
+/** A client with many requests does not starve a client with few requests of the same class.*/
+static void testRoundRobin()
+{
+	const Client clients[2] = {{'a', QUEUE_INTERACTIVE, I2C_QUEUE_QUANTUM, 8}, {'b', QUEUE_INTERACTIVE, I2C_QUEUE_QUANTUM, 2}};
+	string turns = runTurns(clients, 2);
+
+	CHECK(turns.size() == 10);
+	CHECK(turns.substr(0, 4) == "abab");
+}
+
+
+/** Clients with bigger requests get fewer turns, the bytes of the clients stay within one big request of each other.*/
+static void testDeficit()
+{
+	const Client clients[2] = {{'c', QUEUE_BULK, 2 * I2C_QUEUE_QUANTUM, 3}, {'d', QUEUE_BULK, I2C_QUEUE_QUANTUM, 6}};
+	string turns = runTurns(clients, 2);
+	unsigned int bytes[2] = {0, 0};
+	unsigned int done[2] = {0, 0};
+	unsigned int difference = 0;
+
+	CHECK(turns.size() == 9);
+	for(unsigned int i = 0; i < turns.size(); i++)
+	{
+		unsigned int index = turns[i] == 'c' ? 0 : 1;
+
+		bytes[index] += clients[index].cost;
+		++done[index];
+		if(done[0] == clients[0].requests || done[1] == clients[1].requests)
+			break;
+		difference = bytes[0] > bytes[1] ? bytes[0] - bytes[1] : bytes[1] - bytes[0];
+		//round robin by requests would already be 768 bytes apart after the third turn
+		CHECK(difference <= 2 * I2C_QUEUE_QUANTUM);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	testBulkShare();
+	testRoundRobin();
+	testDeficit();
+	return testResult("FairnessTest");
+}
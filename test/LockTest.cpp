@@ -0,0 +1,194 @@
+/**
+ * Checks of DeviceLockTable (i2c.lock, i2c.unlock): a locked device can only be used by its owner, the others wait till
+ * it is unlocked or the lease expired. The clients use the register file of a simulated bus, so the order of their
+ * writes shows who had the device.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "DeviceLockTable.hpp"
+#include "SimulatedBackend.hpp"
+#include "RemoteAardvark.hpp"
+#include "Test.hpp"
+
+/*! The first simulated bus.*/
+#define DEVICE SIM_UNIQUE_ID_BASE
+/*! Address of the register file of the simulated bus.*/
+#define REGISTER_FILE 0x20
+/*! Register which the clients write.*/
+#define REGISTER 0x10
+
+
+/**
+ * \struct Client
+ * Client which uses the device in its own thread.
+ */
+struct Client{
+	/*! Shared lock table.*/
+	DeviceLockTable* locks;
+	/*! Backend of the device.*/
+	SimulatedBackend* sim;
+	/*! Value which the client writes into REGISTER.*/
+	unsigned char value;
+	/*! Time when enter() returned, 0 before.*/
+	unsigned long long entered;
+	/*! True if enter() failed.*/
+	bool failed;
+};
+
+
+/** Writes a register of the register file.*/
+static void writeRegister(SimulatedBackend &sim, unsigned char reg, unsigned char value)
+{
+	unsigned char data[2] = {reg, value};
+	int handle = sim.open(0);
+
+	sim.write(handle, REGISTER_FILE, AA_I2C_NO_FLAGS, data, 2);
+	sim.close(handle);
+}
+
+
+/** \return Value of a register of the register file.*/
+static unsigned char readRegister(SimulatedBackend &sim, unsigned char reg)
+{
+	unsigned char value = 0;
+	int handle = sim.open(0);
+
+	sim.write(handle, REGISTER_FILE, AA_I2C_NO_STOP, &reg, 1);
+	sim.read(handle, REGISTER_FILE, AA_I2C_NO_FLAGS, &value, 1);
+	sim.close(handle);
+	return value;
+}
+
+
+/** Thread function of a Client, enters the device once and writes its value.*/
+static void* useDevice(void* arg)
+{
+	Client* client = (Client*)arg;
+
+	try
+	{
+		client->locks->enter(DEVICE, client);
+	}
+	catch(Error &e)
+	{
+		client->failed = true;
+		return NULL;
+	}
+	client->entered = testNow();
+	writeRegister(*client->sim, REGISTER, client->value);
+	client->locks->leave(DEVICE, client);
+	return NULL;
+}
+
+
+/** Starts a Client in its own thread.*/
+static void startClient(Client &client, DeviceLockTable &locks, SimulatedBackend &sim, unsigned char value, pthread_t &thread)
+{
+	client.locks = &locks;
+	client.sim = &sim;
+	client.value = value;
+	client.entered = 0;
+	client.failed = false;
+	pthread_create(&thread, NULL, useDevice, &client);
+}
+
+
+/** Other clients wait while the device is locked, the owner can still use it.*/
+static void testExclusion()
+{
+	DeviceLockTable locks;
+	SimulatedBackend sim(1, false);
+	Client client;
+	pthread_t thread;
+	unsigned long long unlocked = 0;
+	int owner = 0;
+
+	locks.lock(DEVICE, &owner, 5);
+	CHECK(locks.isOwner(DEVICE, &owner));
+	startClient(client, locks, sim, 2, thread);
+
+	usleep(300000);
+	CHECK(client.entered == 0);
+
+	locks.enter(DEVICE, &owner);
+	writeRegister(sim, REGISTER, 1);
+	locks.leave(DEVICE, &owner);
+	CHECK(readRegister(sim, REGISTER) == 1);
+
+	//only the owner can unlock
+	try
+	{
+		locks.unlock(DEVICE, &client);
+		CHECK(false);
+	}
+	catch(Error &e)
+	{
+	}
+
+	unlocked = testNow();
+	locks.unlock(DEVICE, &owner);
+	pthread_join(thread, NULL);
+
+	CHECK(!client.failed);
+	CHECK(client.entered >= unlocked);
+	CHECK(readRegister(sim, REGISTER) == 2);
+}
+
+
+/** A lock whose owner does not use the device expires after the lease.*/
+static void testLeaseExpiry()
+{
+	DeviceLockTable locks;
+	SimulatedBackend sim(1, false);
+	Client client;
+	pthread_t thread;
+	unsigned long long start = testNow();
+	int owner = 0;
+
+	locks.lock(DEVICE, &owner, 1);
+	startClient(client, locks, sim, 3, thread);
+	pthread_join(thread, NULL);
+
+	CHECK(!client.failed);
+	CHECK(client.entered - start >= 900);
+	CHECK(client.entered - start < I2C_LOCK_WAIT_TIMEOUT * 1000);
+	CHECK(!locks.isOwner(DEVICE, &owner));
+	CHECK(readRegister(sim, REGISTER) == 3);
+}
+
+
+/** Every use of the owner starts the lease again.*/
+static void testLeaseRenewal()
+{
+	DeviceLockTable locks;
+	SimulatedBackend sim(1, false);
+	Client client;
+	pthread_t thread;
+	unsigned long long start = testNow();
+	int owner = 0;
+
+	locks.lock(DEVICE, &owner, 1);
+	startClient(client, locks, sim, 4, thread);
+
+	usleep(600000);
+	locks.enter(DEVICE, &owner);
+	writeRegister(sim, REGISTER, 5);
+	locks.leave(DEVICE, &owner);
+	pthread_join(thread, NULL);
+
+	CHECK(!client.failed);
+	CHECK(client.entered - start >= 1500);
+	CHECK(readRegister(sim, REGISTER) == 4);
+	locks.releaseAll(&owner);
+}
+
+
+int main(int argc, char** argv)
+{
+	testExclusion();
+	testLeaseExpiry();
+	testLeaseRenewal();
+	return testResult("LockTest");
+}
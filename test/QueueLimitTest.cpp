@@ -0,0 +1,203 @@
+/**
+ * Checks of the admission control of DeviceQueue: a request which finds the queue of its device or all queues together
+ * full is rejected at once with I2C_OVERLOADED_ERROR_CODE, the queued requests still get their turn. Every request
+ * opens its simulated bus while it has the turn, a bus can only be opened once, so two requests at the same time fail.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <cstring>
+#include <vector>
+
+#include "DeviceQueue.hpp"
+#include "SimulatedBackend.hpp"
+#include "RemoteAardvark.hpp"
+#include "Test.hpp"
+
+using namespace std;
+
+/*! Address of the register file of the simulated buses.*/
+#define REGISTER_FILE 0x20
+/*! Number of devices whose queues are filled for the global limit.*/
+#define FULL_DEVICES ((I2C_QUEUE_LIMIT + I2C_DEVICE_QUEUE_LIMIT - 1) / I2C_DEVICE_QUEUE_LIMIT)
+
+
+/**
+ * \struct Request
+ * Request which waits for its turn on a simulated bus in its own thread.
+ */
+struct Request{
+	/*! Shared queues.*/
+	DeviceQueue* queue;
+	/*! Backend of the buses.*/
+	SimulatedBackend* sim;
+	/*! Number of the bus.*/
+	int bus;
+	/*! True if the request was rejected or the bus was used by another request at the same time.*/
+	bool failed;
+};
+
+
+/** Thread function of a Request, writes a register of its bus during its turn.*/
+static void* useBus(void* arg)
+{
+	Request* request = (Request*)arg;
+	unsigned char data[2] = {0x01, (unsigned char)request->bus};
+	int handle = -1;
+
+	try
+	{
+		request->queue->enter(SIM_UNIQUE_ID_BASE + request->bus, request);
+	}
+	catch(Error &e)
+	{
+		request->failed = true;
+		return NULL;
+	}
+
+	try
+	{
+		handle = request->sim->open(request->bus);
+		request->sim->write(handle, REGISTER_FILE, AA_I2C_NO_FLAGS, data, 2);
+		request->sim->close(handle);
+	}
+	catch(Error &e)
+	{
+		request->failed = true;
+	}
+	request->queue->leave(SIM_UNIQUE_ID_BASE + request->bus, request);
+	return NULL;
+}
+
+
+/** Waits till a number of requests wait for any device, at most 5 s.*/
+static void waitForWaiting(DeviceQueue &queue, unsigned int waiting)
+{
+	DeviceQueue::Counters counters;
+
+	for(unsigned int i = 0; i < 500; i++)
+	{
+		queue.get(counters);
+		if(counters.waiting >= waiting)
+			return;
+		usleep(10000);
+	}
+}
+
+
+/** Starts requests for a bus in their own threads.*/
+static void startRequests(DeviceQueue &queue, SimulatedBackend &sim, int bus, unsigned int count, vector<Request> &requests,
+		vector<pthread_t> &threads, unsigned int &next)
+{
+	for(unsigned int i = 0; i < count; i++, next++)
+	{
+		requests[next].queue = &queue;
+		requests[next].sim = &sim;
+		requests[next].bus = bus;
+		requests[next].failed = false;
+		pthread_create(&threads[next], NULL, useBus, &requests[next]);
+	}
+}
+
+
+/**
+ * Checks that a further request is rejected.
+ * \param queue The queues.
+ * \param device Device of the request.
+ * \param reason Start of the expected message.
+ */
+static void checkRejected(DeviceQueue &queue, unsigned int device, const char* reason)
+{
+	int client = 0;
+
+	try
+	{
+		queue.enter(device, &client);
+		CHECK(false);
+		queue.leave(device, &client);
+	}
+	catch(Error &e)
+	{
+		CHECK(e.getErrorCode() == I2C_OVERLOADED_ERROR_CODE);
+		CHECK(strncmp(e.get(), reason, strlen(reason)) == 0);
+		CHECK(strstr(e.get(), "retry after") != NULL);
+	}
+}
+
+
+/** A full queue of a device rejects further requests, the queued ones get the device one after the other.*/
+static void testDeviceLimit()
+{
+	DeviceQueue queue;
+	SimulatedBackend sim(1, false);
+	vector<Request> requests(I2C_DEVICE_QUEUE_LIMIT);
+	vector<pthread_t> threads(I2C_DEVICE_QUEUE_LIMIT);
+	DeviceQueue::Counters counters;
+	unsigned int next = 0;
+	int holder = 0;
+
+	queue.enter(SIM_UNIQUE_ID_BASE, &holder);
+	startRequests(queue, sim, 0, I2C_DEVICE_QUEUE_LIMIT, requests, threads, next);
+	waitForWaiting(queue, I2C_DEVICE_QUEUE_LIMIT);
+
+	checkRejected(queue, SIM_UNIQUE_ID_BASE, "Queue of the device is full");
+	queue.leave(SIM_UNIQUE_ID_BASE, &holder);
+
+	for(unsigned int i = 0; i < threads.size(); i++)
+	{
+		pthread_join(threads[i], NULL);
+		CHECK(!requests[i].failed);
+	}
+
+	queue.get(counters);
+	CHECK(counters.rejected == 1);
+	CHECK(counters.queued == I2C_DEVICE_QUEUE_LIMIT);
+	CHECK(counters.waiting == 0);
+	CHECK(counters.maxWaiting == I2C_DEVICE_QUEUE_LIMIT);
+}
+
+
+/** If all queues together are full, a request is rejected even if the queue of its device is empty.*/
+static void testGlobalLimit()
+{
+	DeviceQueue queue;
+	SimulatedBackend sim(FULL_DEVICES + 1, false);
+	vector<Request> requests(I2C_QUEUE_LIMIT);
+	vector<pthread_t> threads(I2C_QUEUE_LIMIT);
+	DeviceQueue::Counters counters;
+	unsigned int next = 0;
+	unsigned int count = 0;
+	int holder = 0;
+
+	for(unsigned int bus = 0; bus <= FULL_DEVICES; bus++)
+		queue.enter(SIM_UNIQUE_ID_BASE + bus, &holder);
+	for(unsigned int bus = 0; bus < FULL_DEVICES; bus++)
+	{
+		count = I2C_QUEUE_LIMIT - next < I2C_DEVICE_QUEUE_LIMIT ? I2C_QUEUE_LIMIT - next : I2C_DEVICE_QUEUE_LIMIT;
+		startRequests(queue, sim, bus, count, requests, threads, next);
+	}
+	waitForWaiting(queue, I2C_QUEUE_LIMIT);
+
+	checkRejected(queue, SIM_UNIQUE_ID_BASE + FULL_DEVICES, "Too many queued requests");
+	for(unsigned int bus = 0; bus <= FULL_DEVICES; bus++)
+		queue.leave(SIM_UNIQUE_ID_BASE + bus, &holder);
+
+	for(unsigned int i = 0; i < threads.size(); i++)
+	{
+		pthread_join(threads[i], NULL);
+		CHECK(!requests[i].failed);
+	}
+
+	queue.get(counters);
+	CHECK(counters.rejected == 1);
+	CHECK(counters.queued == I2C_QUEUE_LIMIT);
+	CHECK(counters.waiting == 0);
+}
+
+
+int main(int argc, char** argv)
+{
+	testDeviceLimit();
+	testGlobalLimit();
+	return testResult("QueueLimitTest");
+}
@@ -0,0 +1,49 @@
+#ifndef TEST_TEST_HPP_
+#define TEST_TEST_HPP_
+
+#include <ctime>
+#include <cstdio>
+
+/**
+ * Minimal checks for the test programs of test/, which are built and run by make check (see makefile.targets).
+ * Every test program is a main() which runs its cases against the simulated buses and returns testResult().
+ */
+
+/*! Number of failed checks of the test program.*/
+static unsigned int testFailures = 0;
+
+/** Counts and prints a failed condition, the test program continues with the next check.*/
+#define CHECK(condition) \
+	do \
+	{ \
+		if(!(condition)) \
+		{ \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			++testFailures; \
+		} \
+	} \
+	while(0)
+
+
+/**
+ * Prints the result of a test program.
+ * \param name Name of the test program.
+ * \return Exit code of the test program, 0 if all checks passed.
+ */
+static inline int testResult(const char* name)
+{
+	printf("%s: %s\n", name, testFailures == 0 ? "passed" : "FAILED");
+	return testFailures == 0 ? 0 : 1;
+}
+
+
+/** \return Milliseconds of CLOCK_MONOTONIC.*/
+static inline unsigned long long testNow()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (unsigned long long)time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+#endif /* TEST_TEST_HPP_ */
@@ -0,0 +1,246 @@
+/**
+ * Checks of the write merging of i2c.transfer: writes with "mem_addr" to consecutive registers are merged into one bus
+ * write, writes with a gap, across a page or within a transaction with repeated starts are not. The requests are
+ * processed by I2c like requests of a client, the simulated bus counts the messages which reach it.
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "I2c.hpp"
+#include "SimulatedBackend.hpp"
+#include "IncomingMsg.hpp"
+#include "OutgoingMsg.hpp"
+#include "Test.hpp"
+
+using namespace std;
+
+/*! Address of the register file of the simulated bus.*/
+#define REGISTER_FILE 32
+
+
+/**
+ * \class CountingBackend
+ * Simulated buses which record the length of every message of every transfer.
+ */
+class CountingBackend : public SimulatedBackend{
+
+	public:
+
+		/*! Lengths of the messages of every transfer.*/
+		vector< vector<unsigned int> > transfers;
+
+
+		CountingBackend() : SimulatedBackend(1, false){}
+
+
+		void transfer(int handle, I2cMessage* messages, unsigned int numMessages)
+		{
+			transfers.push_back(vector<unsigned int>());
+			for(unsigned int i = 0; i < numMessages; i++)
+				transfers.back().push_back(messages[i].length);
+			SimulatedBackend::transfer(handle, messages, numMessages);
+		}
+};
+
+
+/**
+ * \class NoAardvarkBackend
+ * Stands for the backend of Aardvark devices, so that I2c does not send sub-requests to the Aardvark-Plugin.
+ */
+class NoAardvarkBackend : public I2cBackend{
+
+	public:
+
+		const char* getName(){return "Aardvark";}
+		void findDevices(list<I2cDevice*> &deviceList){}
+		int open(int port){throw Error("No Aardvark devices within the test.");}
+		void targetPower(int handle, int powerMask){}
+		void write(int handle, int slaveAddr, int flags, const unsigned char* data, unsigned int length){}
+		unsigned int read(int handle, int slaveAddr, int flags, unsigned char* data, unsigned int length){return 0;}
+		int configure(int handle, int bitrate){return 0;}
+		void close(int handle){}
+};
+
+
+/**
+ * Processes a main-request.
+ * \param i2c The connection.
+ * \param request Json rpc request.
+ * \param dom Gets the response.
+ * \return True if the response contains a result.
+ */
+static bool call(I2c &i2c, const string &request, Document &dom)
+{
+	OutgoingMsg* output = i2c.process(new IncomingMsg(NULL, request.c_str()));
+
+	if(output == NULL)
+		return false;
+	dom.Parse<0>(output->getContent()->c_str());
+	delete output;
+	return !dom.HasParseError() && dom.IsObject() && dom.HasMember("result");
+}
+
+
+/**
+ * Executes a i2c.transfer.
+ * \param i2c The connection.
+ * \param session Token of the session.
+ * \param ops Json array of the ops.
+ * \param dom Gets the response.
+ * \return True if the response contains a result.
+ */
+static bool transfer(I2c &i2c, unsigned int session, const char* ops, Document &dom)
+{
+	char request[1024];
+
+	snprintf(request, sizeof(request), "{\"jsonrpc\":\"2.0\",\"method\":\"i2c.transfer\",\"params\":{\"session\":%u,"
+			"\"ops\":%s},\"id\":2}", session, ops);
+	return call(i2c, request, dom);
+}
+
+
+/** \return The registers of the register file from first, read with a repeated start.*/
+static vector<unsigned int> readRegisters(I2c &i2c, unsigned int session, unsigned int first, unsigned int count)
+{
+	Document dom;
+	vector<unsigned int> values;
+	char ops[256];
+
+	snprintf(ops, sizeof(ops), "[{\"op\":\"write\",\"slave_addr\":%d,\"data_out\":[%u]},"
+			"{\"op\":\"read\",\"slave_addr\":%d,\"num_bytes\":%u,\"stop\":true}]", REGISTER_FILE, first, REGISTER_FILE, count);
+	if(transfer(i2c, session, ops, dom))
+	{
+		Value &dataIn = dom["result"]["results"][1]["data_in"];
+		for(SizeType i = 0; i < dataIn.Size(); i++)
+			values.push_back(dataIn[i].GetUint());
+	}
+	return values;
+}
+
+
+/** \return The "count" of every op of a i2c.transfer response.*/
+static vector<unsigned int> getCounts(Document &dom)
+{
+	vector<unsigned int> counts;
+	Value &results = dom["result"]["results"];
+
+	for(SizeType i = 0; i < results.Size(); i++)
+		counts.push_back(results[i]["count"].GetUint());
+	return counts;
+}
+
+
+/** Builds a vector from a array.*/
+static vector<unsigned int> makeVector(const unsigned int* values, unsigned int count)
+{
+	return vector<unsigned int>(values, values + count);
+}
+
+
+/** Writes to consecutive registers of the same slave become one message, every op keeps its count.*/
+static void testMerged(I2c &i2c, unsigned int session, CountingBackend &sim)
+{
+	Document dom;
+	const unsigned int counts[3] = {2, 2, 1};
+	const unsigned int values[5] = {1, 2, 3, 4, 5};
+
+	sim.transfers.clear();
+	CHECK(transfer(i2c, session, "[{\"op\":\"write\",\"slave_addr\":32,\"mem_addr\":16,\"data_out\":[1,2],\"stop\":true},"
+			"{\"op\":\"write\",\"slave_addr\":32,\"mem_addr\":18,\"data_out\":[3,4],\"stop\":true},"
+			"{\"op\":\"write\",\"slave_addr\":32,\"mem_addr\":20,\"data_out\":[5],\"stop\":true}]", dom));
+
+	CHECK(sim.transfers.size() == 1);
+	if(sim.transfers.size() == 1)
+	{
+		CHECK(sim.transfers[0].size() == 1);
+		CHECK(sim.transfers[0][0] == 6);
+	}
+	CHECK(getCounts(dom) == makeVector(counts, 3));
+	CHECK(readRegisters(i2c, session, 16, 5) == makeVector(values, 5));
+}
+
+
+/** Writes with a gap between the registers stay separate transactions.*/
+static void testGap(I2c &i2c, unsigned int session, CountingBackend &sim)
+{
+	Document dom;
+	const unsigned int values[4] = {6, 7, 0, 8};
+
+	sim.transfers.clear();
+	CHECK(transfer(i2c, session, "[{\"op\":\"write\",\"slave_addr\":32,\"mem_addr\":48,\"data_out\":[6,7],\"stop\":true},"
+			"{\"op\":\"write\",\"slave_addr\":32,\"mem_addr\":51,\"data_out\":[8],\"stop\":true}]", dom));
+
+	CHECK(sim.transfers.size() == 2);
+	CHECK(readRegisters(i2c, session, 48, 4) == makeVector(values, 4));
+}
+
+
+/** Writes are not merged across a page boundary, a EEPROM would wrap around within the page.*/
+static void testPageBoundary(I2c &i2c, unsigned int session, CountingBackend &sim)
+{
+	Document dom;
+	const unsigned int values[3] = {9, 10, 11};
+
+	sim.transfers.clear();
+	CHECK(transfer(i2c, session, "[{\"op\":\"write\",\"slave_addr\":32,\"mem_addr\":70,\"data_out\":[9,10],\"page_size\":8,"
+			"\"stop\":true},{\"op\":\"write\",\"slave_addr\":32,\"mem_addr\":72,\"data_out\":[11],\"stop\":true}]", dom));
+
+	CHECK(sim.transfers.size() == 2);
+	CHECK(readRegisters(i2c, session, 70, 3) == makeVector(values, 3));
+
+	//the same writes within one page are merged
+	sim.transfers.clear();
+	CHECK(transfer(i2c, session, "[{\"op\":\"write\",\"slave_addr\":32,\"mem_addr\":72,\"data_out\":[9,10],\"page_size\":8,"
+			"\"stop\":true},{\"op\":\"write\",\"slave_addr\":32,\"mem_addr\":74,\"data_out\":[11],\"stop\":true}]", dom));
+	CHECK(sim.transfers.size() == 1);
+}
+
+
+/** Writes within one transaction keep their repeated starts.*/
+static void testRepeatedStart(I2c &i2c, unsigned int session, CountingBackend &sim)
+{
+	Document dom;
+	const unsigned int lengths[2] = {3, 3};
+
+	sim.transfers.clear();
+	CHECK(transfer(i2c, session, "[{\"op\":\"write\",\"slave_addr\":32,\"mem_addr\":80,\"data_out\":[1,2]},"
+			"{\"op\":\"write\",\"slave_addr\":32,\"mem_addr\":82,\"data_out\":[3,4],\"stop\":true}]", dom));
+
+	CHECK(sim.transfers.size() == 1);
+	if(sim.transfers.size() == 1)
+		CHECK(sim.transfers[0] == makeVector(lengths, 2));
+}
+
+
+int main(int argc, char** argv)
+{
+	CountingBackend sim;
+	NoAardvarkBackend aardvark;
+	list<I2cBackend*> backends;
+	Document dom;
+	unsigned int session = 0;
+	char request[256];
+
+	backends.push_back(&aardvark);
+	backends.push_back(&sim);
+	I2c i2c(&backends);
+
+	snprintf(request, sizeof(request), "{\"jsonrpc\":\"2.0\",\"method\":\"i2c.open\",\"params\":{\"device\":%u},\"id\":1}",
+			SIM_UNIQUE_ID_BASE);
+	CHECK(call(i2c, request, dom));
+	if(testFailures > 0)
+		return testResult("TransferTest");
+	session = dom["result"]["session"].GetUint();
+
+	testMerged(i2c, session, sim);
+	testGap(i2c, session, sim);
+	testPageBoundary(i2c, session, sim);
+	testRepeatedStart(i2c, session, sim);
+
+	snprintf(request, sizeof(request), "{\"jsonrpc\":\"2.0\",\"method\":\"i2c.close\",\"params\":{\"session\":%u},\"id\":3}",
+			session);
+	CHECK(call(i2c, request, dom));
+	return testResult("TransferTest");
+}
@@ -0,0 +1,531 @@
+/**
+ * I2cLoad, load generator for I2c-Plugin.
+ * Opens many connections to the unix domain socket of the plugin and sends a weighted mix of requests, either
+ * with a fixed arrival rate (open loop) or as fast as the responses arrive (closed loop). The workload is read from a
+ * config file, see tools/load.conf.
+ *
+ * Latencies of the open loop are measured from the time a request should have been sent, not from the time it was
+ * sent, so a stalled plugin is not hidden by requests which were sent late (coordinated omission).
+ *
+ * Requests are send directly to the plugin, so they can only use devices of backends within the plugin (in-process
+ * Aardvark, i2c-dev, simulated buses). Devices of the Aardvark-Plugin need sub-requests, which are only routed by RSD.
+ *
+ * Build: make -C Release I2cLoad (also part of make all) or g++ -O2 -o I2cLoad tools/I2cLoad.cpp -lpthread
+ * Usage: I2cLoad <config file>
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*! Default socket of I2c-Plugin, see COM_PATH of I2cPlugin.hpp.*/
+#define LOAD_DEFAULT_SOCKET "/tmp/i2cdip.uds"
+/*! Size of the receive buffer of a connection.*/
+#define LOAD_RECEIVE_SIZE 65536
+
+
+/**
+ * \struct RequestType
+ * One entry of the workload mix.
+ */
+struct RequestType{
+	/*! Relative weight within the mix.*/
+	unsigned int weight;
+	/*! Json rpc method.*/
+	string method;
+	/*! Params, "$device" is replaced by a random device of the config.*/
+	string params;
+};
+
+
+/**
+ * \struct Config
+ * Content of the config file.
+ */
+struct Config{
+	/*! Unix domain socket of the plugin.*/
+	string socket;
+	/*! Number of connections.*/
+	unsigned int connections;
+	/*! True for a fixed arrival rate, false for closed loop.*/
+	bool openLoop;
+	/*! Requests per second of all connections together, only for the open loop.*/
+	double rate;
+	/*! Duration of the run in seconds.*/
+	double duration;
+	/*! Pause in milliseconds between a response and the next request, only for the closed loop.*/
+	double think;
+	/*! Unique ids of the devices.*/
+	vector<string> devices;
+	/*! Workload mix.*/
+	vector<RequestType> requests;
+	/*! Requests which every connection sends once before the run, like i2c.getI2cDevices.*/
+	vector<RequestType> init;
+	/*! Sum of all weights.*/
+	unsigned int totalWeight;
+};
+
+
+/**
+ * \struct Connection
+ * State and results of one connection, used by one thread.
+ */
+struct Connection{
+	/*! Index of the connection.*/
+	unsigned int index;
+	/*! Socket of the connection.*/
+	int fd;
+	/*! Seed for random numbers.*/
+	unsigned int seed;
+	/*! Latencies in microseconds for every request type.*/
+	vector< vector<unsigned long long> > latencies;
+	/*! Number of error responses for every request type.*/
+	vector<unsigned long long> errors;
+	/*! Number of requests which were not answered (connection closed or broken).*/
+	unsigned long long lost;
+	/*! Received bytes which do not belong to a complete response yet.*/
+	string pending;
+};
+
+
+static Config config;
+static unsigned long long startTime = 0;
+
+
+/** \return Microseconds of CLOCK_MONOTONIC.*/
+static unsigned long long now()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (unsigned long long)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+
+/** Sleeps till a point in time of now().*/
+static void sleepUntil(unsigned long long time)
+{
+	unsigned long long current = now();
+
+	if(time > current)
+		usleep(time - current);
+}
+
+
+/** \return The string without spaces at the beginning and end.*/
+static string trim(const string &text)
+{
+	size_t first = text.find_first_not_of(" \t\r\n");
+	size_t last = text.find_last_not_of(" \t\r\n");
+
+	if(first == string::npos)
+		return "";
+	return text.substr(first, last - first + 1);
+}
+
+
+/**
+ * Reads the config file.
+ * \return False if the file can not be read or contains a invalid line.
+ */
+static bool readConfig(const char* path)
+{
+	ifstream file(path);
+	string line;
+	string key;
+	string value;
+	size_t separator = 0;
+	RequestType request;
+	unsigned int lineNumber = 0;
+
+	config.socket = LOAD_DEFAULT_SOCKET;
+	config.connections = 1;
+	config.openLoop = false;
+	config.rate = 100;
+	config.duration = 10;
+	config.think = 0;
+	config.totalWeight = 0;
+
+	if(!file.is_open())
+	{
+		fprintf(stderr, "Could not open %s.\n", path);
+		return false;
+	}
+
+	while(getline(file, line))
+	{
+		++lineNumber;
+		line = trim(line.substr(0, line.find('#')));
+		if(line.empty())
+			continue;
+
+		//init <method> <params>
+		if(line.compare(0, 5, "init ") == 0)
+		{
+			line = trim(line.substr(5));
+			request.weight = 0;
+			request.method = line.substr(0, line.find_first_of(" \t"));
+			request.params = trim(line.substr(request.method.size()));
+			if(request.params.empty())
+				request.params = "{}";
+			config.init.push_back(request);
+			continue;
+		}
+
+		//request <weight> <method> <params>
+		if(line.compare(0, 8, "request ") == 0)
+		{
+			char method[128];
+			int consumed = 0;
+
+			if(sscanf(line.c_str() + 8, "%u %127s %n", &request.weight, method, &consumed) < 2 || request.weight == 0)
+			{
+				fprintf(stderr, "Invalid request in line %u.\n", lineNumber);
+				return false;
+			}
+			request.method = method;
+			request.params = trim(line.substr(8 + consumed));
+			if(request.params.empty())
+				request.params = "{}";
+			config.requests.push_back(request);
+			config.totalWeight += request.weight;
+			continue;
+		}
+
+		separator = line.find('=');
+		if(separator == string::npos)
+		{
+			fprintf(stderr, "Invalid line %u.\n", lineNumber);
+			return false;
+		}
+		key = trim(line.substr(0, separator));
+		value = trim(line.substr(separator + 1));
+
+		if(key == "socket")
+			config.socket = value;
+		else if(key == "connections")
+			config.connections = atoi(value.c_str());
+		else if(key == "mode")
+			config.openLoop = value == "open";
+		else if(key == "rate")
+			config.rate = atof(value.c_str());
+		else if(key == "duration")
+			config.duration = atof(value.c_str());
+		else if(key == "think")
+			config.think = atof(value.c_str());
+		else if(key == "devices")
+		{
+			size_t start = 0;
+			size_t end = 0;
+			while(start < value.size())
+			{
+				end = value.find(',', start);
+				if(end == string::npos)
+					end = value.size();
+				config.devices.push_back(trim(value.substr(start, end - start)));
+				start = end + 1;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "Unknown key %s in line %u.\n", key.c_str(), lineNumber);
+			return false;
+		}
+	}
+
+	if(config.requests.empty() || config.connections == 0 || config.rate <= 0 || config.duration <= 0)
+	{
+		fprintf(stderr, "The config needs at least one request, connections > 0, rate > 0 and duration > 0.\n");
+		return false;
+	}
+	return true;
+}
+
+
+/** \return Index of a random request type, according to the weights.*/
+static unsigned int pickRequest(Connection &connection)
+{
+	unsigned int value = rand_r(&connection.seed) % config.totalWeight;
+	unsigned int i = 0;
+
+	while(value >= config.requests[i].weight)
+	{
+		value -= config.requests[i].weight;
+		++i;
+	}
+	return i;
+}
+
+
+/** \return Text of a request, "$device" within the params is replaced by a random device.*/
+static string makeRequest(Connection &connection, RequestType &type, unsigned long long id)
+{
+	string params = type.params;
+	size_t position = params.find("$device");
+	char idText[32];
+
+	if(position != string::npos && !config.devices.empty())
+		params.replace(position, 7, config.devices[rand_r(&connection.seed) % config.devices.size()]);
+
+	snprintf(idText, sizeof(idText), "%llu", id);
+	return "{\"jsonrpc\":\"2.0\",\"method\":\"" + type.method + "\",\"params\":" + params + ",\"id\":" + idText + "}";
+}
+
+
+/**
+ * Receives one json object, the end is found by counting the braces outside of strings.
+ * \param response Will contain the json object.
+ * \return False if the connection was closed.
+ */
+static bool receiveResponse(Connection &connection, string &response)
+{
+	char buffer[LOAD_RECEIVE_SIZE];
+	int depth = 0;
+	bool inString = false;
+	bool escaped = false;
+	ssize_t received = 0;
+	size_t i = 0;
+
+	while(true)
+	{
+		for(; i < connection.pending.size(); i++)
+		{
+			char c = connection.pending[i];
+			if(inString)
+			{
+				if(escaped)
+					escaped = false;
+				else if(c == '\\')
+					escaped = true;
+				else if(c == '"')
+					inString = false;
+			}
+			else if(c == '"')
+				inString = true;
+			else if(c == '{')
+				++depth;
+			else if(c == '}' && --depth == 0)
+			{
+				response = connection.pending.substr(0, i + 1);
+				connection.pending.erase(0, i + 1);
+				return true;
+			}
+		}
+
+		received = recv(connection.fd, buffer, sizeof(buffer), 0);
+		if(received < 0 && errno == EINTR)
+			continue;
+		if(received <= 0)
+			return false;
+		connection.pending.append(buffer, received);
+	}
+}
+
+
+/**
+ * Sends one request and waits for its response.
+ * \return False if the connection was closed.
+ */
+static bool sendAndReceive(Connection &connection, const string &request, string &response)
+{
+	size_t sent = 0;
+	ssize_t result = 0;
+
+	while(sent < request.size())
+	{
+		result = send(connection.fd, request.c_str() + sent, request.size() - sent, MSG_NOSIGNAL);
+		if(result < 0 && errno == EINTR)
+			continue;
+		if(result <= 0)
+			return false;
+		sent += result;
+	}
+
+	return receiveResponse(connection, response);
+}
+
+
+/** Sends a random request of the mix and waits for its response, the latency is measured from intended.*/
+static bool execute(Connection &connection, unsigned long long id, unsigned long long intended)
+{
+	unsigned int type = pickRequest(connection);
+	string response;
+
+	if(!sendAndReceive(connection, makeRequest(connection, config.requests[type], id), response))
+	{
+		++connection.lost;
+		return false;
+	}
+
+	connection.latencies[type].push_back(now() - intended);
+	if(response.find("\"error\"") != string::npos)
+		++connection.errors[type];
+	return true;
+}
+
+
+/** Thread function of a connection.*/
+static void* runConnection(void* arg)
+{
+	Connection &connection = *(Connection*)arg;
+	unsigned long long end = startTime + (unsigned long long)(config.duration * 1000000);
+	//every connection sends rate / connections requests per second, the connections are shifted against each other
+	double interval = 1000000.0 * config.connections / config.rate;
+	unsigned long long intended = startTime + (unsigned long long)(interval * connection.index / config.connections);
+	unsigned long long id = (unsigned long long)connection.index << 32;
+	unsigned long long sendTime = 0;
+	unsigned long long requests = 0;
+	string response;
+
+	//every I2c instance needs its own device list
+	for(unsigned int i = 0; i < config.init.size(); i++)
+	{
+		if(!sendAndReceive(connection, makeRequest(connection, config.init[i], ++id), response))
+		{
+			++connection.lost;
+			return NULL;
+		}
+	}
+
+	while(true)
+	{
+		if(config.openLoop)
+		{
+			intended = startTime + (unsigned long long)(interval * connection.index / config.connections + interval * requests);
+			if(intended >= end)
+				break;
+			//a connection which is behind sends immediately, but its latency still starts at intended
+			sleepUntil(intended);
+			sendTime = intended;
+		}
+		else
+		{
+			sendTime = now();
+			if(sendTime >= end)
+				break;
+		}
+
+		if(!execute(connection, ++id, sendTime))
+			break;
+		++requests;
+
+		if(!config.openLoop && config.think > 0)
+			usleep((useconds_t)(config.think * 1000));
+	}
+	return NULL;
+}
+
+
+/** \return Latency at a percentile of sorted latencies.*/
+static unsigned long long percentile(vector<unsigned long long> &sorted, double percent)
+{
+	size_t index = 0;
+
+	if(sorted.empty())
+		return 0;
+	index = (size_t)(percent / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+
+/** Prints count, errors and latency percentiles of a request type.*/
+static void printLatencies(const char* name, vector<unsigned long long> &latencies, unsigned long long errors, double seconds)
+{
+	sort(latencies.begin(), latencies.end());
+	printf("%-24s %9lu %7llu %9.1f %9.3f %9.3f %9.3f %9.3f %9.3f\n", name, (unsigned long)latencies.size(), errors,
+			latencies.size() / seconds, percentile(latencies, 50) / 1000.0, percentile(latencies, 90) / 1000.0,
+			percentile(latencies, 99) / 1000.0, percentile(latencies, 99.9) / 1000.0,
+			latencies.empty() ? 0.0 : latencies.back() / 1000.0);
+}
+
+
+int main(int argc, const char** argv)
+{
+	vector<Connection> connections;
+	vector<pthread_t> threads;
+	vector<unsigned long long> all;
+	struct sockaddr_un address;
+	unsigned long long errors = 0;
+	unsigned long long allErrors = 0;
+	unsigned long long lost = 0;
+	double seconds = 0;
+	char name[64];
+
+	if(argc != 2)
+	{
+		fprintf(stderr, "Usage: %s <config file>\n", argv[0]);
+		return 1;
+	}
+	if(!readConfig(argv[1]))
+		return 1;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, config.socket.c_str(), sizeof(address.sun_path) - 1);
+
+	connections.resize(config.connections);
+	for(unsigned int i = 0; i < connections.size(); i++)
+	{
+		connections[i].index = i;
+		connections[i].seed = (unsigned int)time(NULL) ^ (i * 2654435761U);
+		connections[i].latencies.resize(config.requests.size());
+		connections[i].errors.resize(config.requests.size(), 0);
+		connections[i].lost = 0;
+		connections[i].fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(connections[i].fd < 0 || connect(connections[i].fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+		{
+			fprintf(stderr, "Could not connect to %s: %s\n", config.socket.c_str(), strerror(errno));
+			return 1;
+		}
+	}
+
+	threads.resize(connections.size());
+	startTime = now();
+	for(unsigned int i = 0; i < connections.size(); i++)
+		pthread_create(&threads[i], NULL, runConnection, &connections[i]);
+	for(unsigned int i = 0; i < connections.size(); i++)
+		pthread_join(threads[i], NULL);
+	seconds = (now() - startTime) / 1000000.0;
+
+	printf("%s loop, %u connections, %.1f s\n", config.openLoop ? "open" : "closed", config.connections, seconds);
+	printf("%-24s %9s %7s %9s %9s %9s %9s %9s %9s\n", "request", "count", "errors", "req/s", "p50 ms", "p90 ms", "p99 ms",
+			"p99.9 ms", "max ms");
+	for(unsigned int type = 0; type < config.requests.size(); type++)
+	{
+		vector<unsigned long long> latencies;
+		errors = 0;
+		for(unsigned int i = 0; i < connections.size(); i++)
+		{
+			latencies.insert(latencies.end(), connections[i].latencies[type].begin(), connections[i].latencies[type].end());
+			errors += connections[i].errors[type];
+		}
+		all.insert(all.end(), latencies.begin(), latencies.end());
+		allErrors += errors;
+		//the same method can be within the mix several times, with different params
+		snprintf(name, sizeof(name), "%u:%s", type + 1, config.requests[type].method.c_str());
+		printLatencies(name, latencies, errors, seconds);
+	}
+	printLatencies("all", all, allErrors, seconds);
+
+	for(unsigned int i = 0; i < connections.size(); i++)
+	{
+		lost += connections[i].lost;
+		close(connections[i].fd);
+	}
+	if(lost > 0)
+		printf("%llu requests were not answered, the plugin closed the connection.\n", lost);
+
+	return lost > 0 ? 2 : 0;
+}
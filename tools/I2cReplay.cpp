@@ -0,0 +1,432 @@
+/**
+ * I2cReplay, replays a recording of I2c-Plugin (build with I2C_RECORD, see Recorder.hpp).
+ * Every recorded connection gets its own I2c instance and thread, its main-requests are fed into I2c::process at the
+ * recorded times (divided by the speed) and the responses are compared with the recorded responses.
+ *
+ * The replay runs against simulated buses, because sub-requests to the Aardvark-Plugin are only routed by RSD. Devices of
+ * the recording are mapped to the simulated buses in the order they first appear, ids of simulated buses are kept.
+ * Recorded sub-requests and sub-responses are not replayed, they can be shown with -p.
+ *
+ * Build: make -C Release I2cReplay (also part of make all), it links all objects of the plugin except I2cPlugin.o.
+ * Usage: I2cReplay [-s speed] [-b buses] [-p] <recording>
+ * 	-s speed: 1 replays with the recorded timing, 10 ten times faster, 0 without any waiting (default 1)
+ * 	-b buses: number of simulated buses (default SIM_NUM_BUSES)
+ * 	-p: only print the records
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "I2c.hpp"
+#include "SimulatedBackend.hpp"
+#include "Recorder.hpp"
+#include "IncomingMsg.hpp"
+#include "OutgoingMsg.hpp"
+#include "stringbuffer.h"
+#include "writer.h"
+
+using namespace std;
+
+
+/**
+ * \struct Exchange
+ * A recorded main-request with its recorded response.
+ */
+struct Exchange{
+	/*! Main-request with the devices of the simulated buses.*/
+	string request;
+	/*! Recorded main-response, empty if the recording ended before it.*/
+	string response;
+	/*! Time of the main-request in microseconds since the first record.*/
+	unsigned long long requestTime;
+	/*! Time of the main-response in microseconds since the first record.*/
+	unsigned long long responseTime;
+};
+
+
+/**
+ * \struct Replay
+ * All exchanges of one recorded connection and the results of their replay.
+ */
+struct Replay{
+	/*! Number of the connection within the recording.*/
+	unsigned int connection;
+	/*! Exchanges in recorded order.*/
+	vector<Exchange> exchanges;
+	/*! Shared objects of all I2c instances, like within I2cPlugin.*/
+	list<I2cBackend*>* backends;
+	DeviceLockTable* locks;
+	ReadCoalescer* reads;
+	I2cStats* stats;
+	/*! Divisor of the recorded times, 0 for no waiting.*/
+	double speed;
+	/*! Start of the replay in microseconds of CLOCK_MONOTONIC.*/
+	unsigned long long start;
+	/*! Number of responses which are equal to the recording.*/
+	unsigned long long identical;
+	/*! Number of responses with the same outcome (result or error) as the recording, but other content.*/
+	unsigned long long sameOutcome;
+	/*! Number of responses with another outcome than the recording.*/
+	unsigned long long different;
+	/*! Recorded latencies in microseconds.*/
+	vector<unsigned long long> recorded;
+	/*! Latencies of the replay in microseconds.*/
+	vector<unsigned long long> replayed;
+};
+
+
+/**
+ * \class NoAardvarkBackend
+ * Stands for the backend of Aardvark devices, so that I2c does not use the Aardvark-Plugin through RSD, which does not
+ * exist within the replay.
+ */
+class NoAardvarkBackend : public I2cBackend{
+
+	public:
+
+		const char* getName(){return "Aardvark";}
+		void findDevices(list<I2cDevice*> &deviceList){}
+		int open(int port){throw Error("Aardvark devices are not replayed.");}
+		void targetPower(int handle, int powerMask){}
+		void write(int handle, int slaveAddr, int flags, const unsigned char* data, unsigned int length){}
+		unsigned int read(int handle, int slaveAddr, int flags, unsigned char* data, unsigned int length){return 0;}
+		int configure(int handle, int bitrate){return 0;}
+		void close(int handle){}
+};
+
+
+/** \return Microseconds of CLOCK_MONOTONIC.*/
+static unsigned long long now()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (unsigned long long)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+
+/** \return Name of a RecordType.*/
+static const char* getTypeName(unsigned char type)
+{
+	switch(type)
+	{
+		case RECORD_MAIN_REQUEST:
+			return "main-request";
+		case RECORD_MAIN_RESPONSE:
+			return "main-response";
+		case RECORD_SUB_REQUEST:
+			return "sub-request";
+		case RECORD_SUB_RESPONSE:
+			return "sub-response";
+		default:
+			return "unknown";
+	}
+}
+
+
+/**
+ * Replaces a recorded device by a simulated bus, new devices get the next bus.
+ * \param device "device" value of the params.
+ * \param devices Mapping of recorded devices to simulated buses.
+ * \param numBuses Number of simulated buses.
+ */
+static void mapDevice(Value &device, map<unsigned int, unsigned int> &devices, unsigned int numBuses)
+{
+	map<unsigned int, unsigned int>::iterator mapped;
+	unsigned int id = 0;
+
+	if(!device.IsUint())
+		return;
+	id = device.GetUint();
+	mapped = devices.find(id);
+	if(mapped == devices.end())
+	{
+		if(id >= SIM_UNIQUE_ID_BASE && id < SIM_UNIQUE_ID_BASE + numBuses)
+			mapped = devices.insert(pair<unsigned int, unsigned int>(id, id)).first;
+		else
+			mapped = devices.insert(pair<unsigned int, unsigned int>(id, SIM_UNIQUE_ID_BASE + devices.size() % numBuses)).first;
+	}
+	device.SetUint(mapped->second);
+}
+
+
+/**
+ * Maps "device" and "devices" of a main-request to simulated buses.
+ * \return The main-request with mapped devices, or the unchanged main-request if it is no valid json.
+ */
+static string mapRequest(string &request, map<unsigned int, unsigned int> &devices, unsigned int numBuses)
+{
+	Document dom;
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	Value* params = NULL;
+
+	dom.Parse<0>(request.c_str());
+	if(dom.HasParseError() || !dom.IsObject() || !dom.HasMember("params") || !dom["params"].IsObject())
+		return request;
+
+	params = &dom["params"];
+	if(params->HasMember("device"))
+		mapDevice((*params)["device"], devices, numBuses);
+	if(params->HasMember("devices") && (*params)["devices"].IsArray())
+	{
+		for(SizeType i = 0; i < (*params)["devices"].Size(); i++)
+			mapDevice((*params)["devices"][i], devices, numBuses);
+	}
+	dom.Accept(writer);
+	return string(buffer.GetString());
+}
+
+
+/** \return True if a response is a json rpc error response.*/
+static bool isError(const string &response)
+{
+	Document dom;
+
+	dom.Parse<0>(response.c_str());
+	return dom.HasParseError() || !dom.IsObject() || dom.HasMember("error");
+}
+
+
+/**
+ * Reads a recording and prints every record or groups the main-messages by connection.
+ * \param path Path of the recording.
+ * \param print If true, the records are only printed.
+ * \param numBuses Number of simulated buses.
+ * \param replays Gets one Replay for every connection.
+ * \return False if the file is no recording.
+ */
+static bool readRecording(const char* path, bool print, unsigned int numBuses, vector<Replay> &replays)
+{
+	ifstream file(path, ios::in | ios::binary);
+	vector<char> content;
+	map<unsigned int, size_t> connections;
+	map<unsigned int, unsigned int> devices;
+	map<unsigned int, size_t>::iterator connection;
+	RecordHeader header;
+	size_t offset = I2C_RECORD_HEADER_SIZE;
+	unsigned long long first = 0;
+	string message;
+	Replay* replay = NULL;
+
+	if(!file)
+		return false;
+	content.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+	if(content.size() < I2C_RECORD_HEADER_SIZE || memcmp(&content[0], I2C_RECORD_MAGIC, I2C_RECORD_HEADER_SIZE) != 0)
+		return false;
+
+	while(offset + I2C_RECORD_ENTRY_HEADER_SIZE <= content.size())
+	{
+		memcpy(&header, &content[offset], I2C_RECORD_ENTRY_HEADER_SIZE);
+		if(header.length == 0 || offset + I2C_RECORD_ENTRY_HEADER_SIZE + header.length > content.size())
+			break;
+		message.assign(&content[offset + I2C_RECORD_ENTRY_HEADER_SIZE], header.length);
+		offset += (I2C_RECORD_ENTRY_HEADER_SIZE + header.length + 7) & ~(size_t)7;
+
+		if(first == 0)
+			first = header.time;
+		if(print)
+		{
+			printf("%12.3f ms %4u %-14s %s\n", (header.time - first) / 1000.0, header.connection,
+					getTypeName(header.type), message.c_str());
+			continue;
+		}
+
+		connection = connections.find(header.connection);
+		if(connection == connections.end())
+		{
+			connection = connections.insert(pair<unsigned int, size_t>(header.connection, replays.size())).first;
+			replays.push_back(Replay());
+			replays.back().connection = header.connection;
+		}
+		replay = &replays[connection->second];
+
+		//I2c answers the main-requests of a connection one after the other
+		if(header.type == RECORD_MAIN_REQUEST)
+		{
+			replay->exchanges.push_back(Exchange());
+			replay->exchanges.back().request = mapRequest(message, devices, numBuses);
+			replay->exchanges.back().requestTime = header.time - first;
+			replay->exchanges.back().responseTime = 0;
+		}
+		else if(header.type == RECORD_MAIN_RESPONSE && !replay->exchanges.empty())
+		{
+			replay->exchanges.back().response = message;
+			replay->exchanges.back().responseTime = header.time - first;
+		}
+	}
+	return true;
+}
+
+
+/** Replays the main-requests of one connection.*/
+static void* replayThread(void* arg)
+{
+	Replay* replay = (Replay*)arg;
+	I2c* i2c = new I2c(replay->backends, replay->locks, replay->reads, replay->stats);
+	OutgoingMsg* output = NULL;
+	unsigned long long sendTime = 0;
+	unsigned long long current = 0;
+	string init = "{\"jsonrpc\":\"2.0\",\"method\":\"i2c.getI2cDevices\",\"params\":{},\"id\":0}";
+
+	replay->identical = 0;
+	replay->sameOutcome = 0;
+	replay->different = 0;
+
+	//I2c only knows devices after i2c.getI2cDevices
+	delete i2c->process(new IncomingMsg(NULL, init.c_str()));
+
+	for(unsigned int i = 0; i < replay->exchanges.size(); i++)
+	{
+		Exchange &exchange = replay->exchanges[i];
+
+		if(replay->speed > 0)
+		{
+			sendTime = replay->start + (unsigned long long)(exchange.requestTime / replay->speed);
+			current = now();
+			if(sendTime > current)
+				usleep((useconds_t)(sendTime - current));
+		}
+
+		current = now();
+		output = i2c->process(new IncomingMsg(NULL, exchange.request.c_str()));
+		replay->replayed.push_back(now() - current);
+		if(exchange.responseTime > 0)
+			replay->recorded.push_back(exchange.responseTime - exchange.requestTime);
+
+		if(output == NULL || exchange.response.empty())
+			++replay->different;
+		else if(*output->getContent() == exchange.response)
+			++replay->identical;
+		else if(isError(*output->getContent()) == isError(exchange.response))
+			++replay->sameOutcome;
+		else
+			++replay->different;
+		delete output;
+	}
+
+	delete i2c;
+	return NULL;
+}
+
+
+/** \return Latency at a percentile of sorted latencies.*/
+static unsigned long long percentile(vector<unsigned long long> &sorted, double percent)
+{
+	size_t index = 0;
+
+	if(sorted.empty())
+		return 0;
+	index = (size_t)(percent / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+
+/** Prints the latency percentiles of the recording or the replay.*/
+static void printLatencies(const char* name, vector<unsigned long long> &latencies)
+{
+	sort(latencies.begin(), latencies.end());
+	printf("%-10s %9lu %9.3f %9.3f %9.3f %9.3f %9.3f\n", name, (unsigned long)latencies.size(),
+			percentile(latencies, 50) / 1000.0, percentile(latencies, 90) / 1000.0, percentile(latencies, 99) / 1000.0,
+			percentile(latencies, 99.9) / 1000.0, latencies.empty() ? 0.0 : latencies.back() / 1000.0);
+}
+
+
+int main(int argc, char** argv)
+{
+	vector<Replay> replays;
+	vector<pthread_t> threads;
+	vector<unsigned long long> recorded;
+	vector<unsigned long long> replayed;
+	list<I2cBackend*> backends;
+	DeviceLockTable locks;
+	ReadCoalescer reads;
+	I2cStats stats;
+	double speed = 1;
+	unsigned int numBuses = SIM_NUM_BUSES;
+	bool print = false;
+	unsigned long long start = 0;
+	unsigned long long identical = 0;
+	unsigned long long sameOutcome = 0;
+	unsigned long long different = 0;
+	int option = 0;
+
+	while((option = getopt(argc, argv, "s:b:p")) != -1)
+	{
+		switch(option)
+		{
+			case 's':
+				speed = atof(optarg);
+				break;
+			case 'b':
+				numBuses = (unsigned int)atoi(optarg);
+				break;
+			case 'p':
+				print = true;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-s speed] [-b buses] [-p] <recording>\n", argv[0]);
+				return 1;
+		}
+	}
+	if(optind >= argc || numBuses == 0 || speed < 0)
+	{
+		fprintf(stderr, "Usage: %s [-s speed] [-b buses] [-p] <recording>\n", argv[0]);
+		return 1;
+	}
+
+	if(!readRecording(argv[optind], print, numBuses, replays))
+	{
+		fprintf(stderr, "%s is no recording of I2c-Plugin.\n", argv[optind]);
+		return 1;
+	}
+	if(print)
+		return 0;
+
+	backends.push_back(new SimulatedBackend(numBuses, speed > 0));
+	backends.push_back(new NoAardvarkBackend());
+
+	threads.resize(replays.size());
+	start = now();
+	for(unsigned int i = 0; i < replays.size(); i++)
+	{
+		replays[i].backends = &backends;
+		replays[i].locks = &locks;
+		replays[i].reads = &reads;
+		replays[i].stats = &stats;
+		replays[i].speed = speed;
+		replays[i].start = start;
+		pthread_create(&threads[i], NULL, replayThread, &replays[i]);
+	}
+	for(unsigned int i = 0; i < replays.size(); i++)
+	{
+		pthread_join(threads[i], NULL);
+		identical += replays[i].identical;
+		sameOutcome += replays[i].sameOutcome;
+		different += replays[i].different;
+		recorded.insert(recorded.end(), replays[i].recorded.begin(), replays[i].recorded.end());
+		replayed.insert(replayed.end(), replays[i].replayed.begin(), replays[i].replayed.end());
+	}
+
+	printf("%lu connections, %.3f s\n", (unsigned long)replays.size(), (now() - start) / 1000000.0);
+	printf("responses: %llu identical, %llu same outcome, %llu different\n", identical, sameOutcome, different);
+	printf("%-10s %9s %9s %9s %9s %9s %9s\n", "latency", "count", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms");
+	printLatencies("recorded", recorded);
+	printLatencies("replayed", replayed);
+
+	while(!backends.empty())
+	{
+		delete backends.front();
+		backends.pop_front();
+	}
+	return different > 0 ? 2 : 0;
+}